@@ -0,0 +1,77 @@
+#include "bin_builder.h"
+#include "proto.h"
+#include "vstr.h"
+#include <memory.h>
+
+/* the type byte and the longest header after it */
+#define BIN_HEADER_MAX 9
+
+static int bin_builder_add_len(vstr* b, bin_type type, size_t len);
+
+int bin_builder_add_null(vstr* b) { return vstr_push_char(b, BinNull); }
+
+int bin_builder_add_simple(vstr* b, const char* str, size_t len) {
+    if (bin_builder_add_len(b, BinSimple, len) == -1) {
+        return -1;
+    }
+    return vstr_push_string_len(b, str, len);
+}
+
+int bin_builder_add_err(vstr* b, const char* str, size_t len) {
+    if (bin_builder_add_len(b, BinErr, len) == -1) {
+        return -1;
+    }
+    return vstr_push_string_len(b, str, len);
+}
+
+int bin_builder_add_string(vstr* b, const char* str, size_t len) {
+    if (bin_builder_add_len(b, BinString, len) == -1) {
+        return -1;
+    }
+    return vstr_push_string_len(b, str, len);
+}
+
+int bin_builder_add_string_header(vstr* b, size_t len) {
+    return bin_builder_add_len(b, BinString, len);
+}
+
+int bin_builder_add_int(vstr* b, int64_t val) {
+    uint8_t buf[BIN_HEADER_MAX];
+    buf[0] = BinInt;
+    bin_put_u64(buf + 1, (uint64_t)val);
+    return vstr_push_string_len(b, (const char*)buf, sizeof buf);
+}
+
+int bin_builder_add_double(vstr* b, double val) {
+    uint8_t buf[BIN_HEADER_MAX];
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof bits);
+    buf[0] = BinDouble;
+    bin_put_u64(buf + 1, bits);
+    return vstr_push_string_len(b, (const char*)buf, sizeof buf);
+}
+
+int bin_builder_add_bool(vstr* b, int val) {
+    uint8_t buf[2];
+    buf[0] = BinBool;
+    buf[1] = val ? 1 : 0;
+    return vstr_push_string_len(b, (const char*)buf, sizeof buf);
+}
+
+int bin_builder_add_array(vstr* b, size_t len) {
+    return bin_builder_add_len(b, BinArray, len);
+}
+
+int bin_builder_add_ht(vstr* b, size_t len) {
+    return bin_builder_add_len(b, BinHt, len);
+}
+
+static int bin_builder_add_len(vstr* b, bin_type type, size_t len) {
+    uint8_t buf[5];
+    if (len > BIN_LEN_MAX) {
+        return -1;
+    }
+    buf[0] = type;
+    bin_put_u32(buf + 1, len);
+    return vstr_push_string_len(b, (const char*)buf, sizeof buf);
+}
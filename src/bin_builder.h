@@ -0,0 +1,26 @@
+#ifndef __BIN_BUILDER_H__
+
+#define __BIN_BUILDER_H__
+
+#include "proto.h"
+#include "vstr.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* encodes values in the binary protocol, see proto.h. builder uses these for
+ * a connection that switched to PROTO_BIN. Each returns -1 if it could not
+ * allocate or a length does not fit the protocol */
+
+int bin_builder_add_null(vstr* b);
+int bin_builder_add_simple(vstr* b, const char* str, size_t len);
+int bin_builder_add_err(vstr* b, const char* str, size_t len);
+int bin_builder_add_string(vstr* b, const char* str, size_t len);
+/* the type and length of a string whose contents are sent separately */
+int bin_builder_add_string_header(vstr* b, size_t len);
+int bin_builder_add_int(vstr* b, int64_t val);
+int bin_builder_add_double(vstr* b, double val);
+int bin_builder_add_bool(vstr* b, int val);
+int bin_builder_add_array(vstr* b, size_t len);
+int bin_builder_add_ht(vstr* b, size_t len);
+
+#endif /* __BIN_BUILDER_H__ */
@@ -0,0 +1,238 @@
+#include "bin_parser.h"
+#include "ht.h"
+#include "object.h"
+#include "proto.h"
+#include "vec.h"
+#include "vstr.h"
+#include <memory.h>
+
+/* values nested deeper than this are refused rather than recursed into */
+#define BIN_DEPTH_MAX 64
+
+static int bin_read_value(bin_reader* r, object* obj, size_t depth);
+static int bin_read_header(bin_reader* r, uint8_t* type,
+                           const uint8_t** header);
+static int bin_read_contents(bin_reader* r, uint64_t len, vstr* s);
+static void bin_reader_fail(bin_reader* r);
+static int bin_object_cmp(void* a, void* b);
+static void bin_free_object(void* ptr);
+
+size_t bin_header_len(uint8_t type) {
+    switch (type) {
+    case BinNull:
+        return 1;
+    case BinBool:
+        return 2;
+    case BinString:
+    case BinSimple:
+    case BinErr:
+    case BinArray:
+    case BinHt:
+        return 5;
+    case BinInt:
+    case BinDouble:
+        return 9;
+    default:
+        return 0;
+    }
+}
+
+bin_reader bin_reader_new(const uint8_t* input, size_t input_len) {
+    bin_reader r = {0};
+    r.input = input;
+    r.input_len = input_len;
+    return r;
+}
+
+int bin_reader_peek(const bin_reader* r) {
+    if (r->pos >= r->input_len) {
+        return -1;
+    }
+    return r->input[r->pos];
+}
+
+int bin_read_len(bin_reader* r, bin_type type, uint64_t* len) {
+    const uint8_t* header;
+    uint8_t got;
+    if (bin_read_header(r, &got, &header) == -1) {
+        return -1;
+    }
+    if (got != type) {
+        bin_reader_fail(r);
+        return -1;
+    }
+    *len = bin_get_u32(header);
+    return 0;
+}
+
+int bin_read_name(bin_reader* r, const uint8_t** name, size_t* name_len) {
+    const uint8_t* header;
+    uint8_t type;
+    uint64_t len;
+    if (bin_read_header(r, &type, &header) == -1) {
+        return -1;
+    }
+    len = bin_get_u32(header);
+    /* a detached string is far longer than any name */
+    if ((type != BinString && type != BinSimple) ||
+        (r->bulk != NULL && r->pos == r->bulk_at) ||
+        len > r->input_len - r->pos) {
+        bin_reader_fail(r);
+        return -1;
+    }
+    *name = r->input + r->pos;
+    *name_len = len;
+    r->pos += len;
+    return 0;
+}
+
+object bin_read_object(bin_reader* r) {
+    object obj = {0};
+    if (bin_read_value(r, &obj, 0) == -1) {
+        object null = {0};
+        return null;
+    }
+    return obj;
+}
+
+object bin_parse_from_server(const uint8_t* input, size_t input_len) {
+    bin_reader r = bin_reader_new(input, input_len);
+    return bin_read_object(&r);
+}
+
+/* obj is left Null if this fails */
+static int bin_read_value(bin_reader* r, object* obj, size_t depth) {
+    const uint8_t* header;
+    uint8_t type;
+
+    if (bin_read_header(r, &type, &header) == -1) {
+        return -1;
+    }
+
+    switch (type) {
+    case BinNull:
+        obj->type = Null;
+        return 0;
+    case BinString:
+    case BinSimple:
+    case BinErr: {
+        vstr s;
+        uint64_t len = bin_get_u32(header);
+        if (type == BinString && r->bulk != NULL && r->pos == r->bulk_at &&
+            vstr_len(r->bulk) == len) {
+            s = *(r->bulk);
+            *(r->bulk) = vstr_new();
+            r->bulk = NULL;
+        } else if (bin_read_contents(r, len, &s) == -1) {
+            return -1;
+        }
+        *obj = object_new(String, &s);
+        return 0;
+    }
+    case BinInt: {
+        int64_t val = (int64_t)bin_get_u64(header);
+        *obj = object_new(Int, &val);
+        return 0;
+    }
+    case BinDouble: {
+        uint64_t bits = bin_get_u64(header);
+        double val;
+        memcpy(&val, &bits, sizeof val);
+        *obj = object_new(Double, &val);
+        return 0;
+    }
+    case BinBool: {
+        int val = header[0] != 0;
+        *obj = object_new(Bool, &val);
+        return 0;
+    }
+    case BinArray: {
+        uint64_t i, len = bin_get_u32(header);
+        vec* vec;
+        if (depth == BIN_DEPTH_MAX) {
+            bin_reader_fail(r);
+            return -1;
+        }
+        vec = vec_new(sizeof(object));
+        if (vec == NULL) {
+            return -1;
+        }
+        obj->type = Array;
+        obj->data.vec = vec;
+        /* the count is not trusted to size anything, a frame that lies
+         * about it runs out of input first */
+        for (i = 0; i < len; ++i) {
+            object cur = {0};
+            if (bin_read_value(r, &cur, depth + 1) == -1 ||
+                vec_push(&(obj->data.vec), &cur) == -1) {
+                object_free(&cur);
+                object_free(obj);
+                obj->type = Null;
+                return -1;
+            }
+        }
+        return 0;
+    }
+    case BinHt: {
+        uint64_t i, len = bin_get_u32(header);
+        if (depth == BIN_DEPTH_MAX) {
+            bin_reader_fail(r);
+            return -1;
+        }
+        obj->type = Ht;
+        obj->data.ht = ht_new(sizeof(object), bin_object_cmp);
+        for (i = 0; i < len; ++i) {
+            object key = {0};
+            object value = {0};
+            if (bin_read_value(r, &key, depth + 1) == -1 ||
+                bin_read_value(r, &value, depth + 1) == -1) {
+                object_free(&key);
+                object_free(obj);
+                obj->type = Null;
+                return -1;
+            }
+            ht_insert(&(obj->data.ht), &key, sizeof(object), &value,
+                      bin_free_object, bin_free_object);
+        }
+        return 0;
+    }
+    default:
+        return -1;
+    }
+}
+
+/* reads the type byte and the header after it, leaving header pointing at
+ * the header in input */
+static int bin_read_header(bin_reader* r, uint8_t* type,
+                           const uint8_t** header) {
+    size_t len;
+    if (r->pos >= r->input_len) {
+        return -1;
+    }
+    *type = r->input[r->pos];
+    len = bin_header_len(*type);
+    if (len == 0 || len > r->input_len - r->pos) {
+        bin_reader_fail(r);
+        return -1;
+    }
+    *header = r->input + r->pos + 1;
+    r->pos += len;
+    return 0;
+}
+
+static int bin_read_contents(bin_reader* r, uint64_t len, vstr* s) {
+    if (len > r->input_len - r->pos) {
+        bin_reader_fail(r);
+        return -1;
+    }
+    *s = vstr_from_len((const char*)r->input + r->pos, len);
+    r->pos += len;
+    return 0;
+}
+
+/* moves r to the end of the input, so whatever is read next fails */
+static void bin_reader_fail(bin_reader* r) { r->pos = r->input_len; }
+
+static int bin_object_cmp(void* a, void* b) { return object_cmp(a, b); }
+
+static void bin_free_object(void* ptr) { object_free(ptr); }
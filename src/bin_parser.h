@@ -0,0 +1,57 @@
+#ifndef __BIN_PARSER_H__
+
+#define __BIN_PARSER_H__
+
+#include "object.h"
+#include "proto.h"
+#include "vstr.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* reads values in the binary protocol, see proto.h, from a frame that is
+ * already complete. A string too large to keep in the read buffer may be
+ * received apart from the frame, like a detached bulk string in RESP: its
+ * contents are then missing from input at bulk_at */
+typedef struct {
+    const uint8_t* input;
+    size_t input_len;
+    size_t pos;
+    vstr* bulk;     /* a string received apart from input, or NULL */
+    size_t bulk_at; /* where bulk's contents are missing from input */
+} bin_reader;
+
+/**
+ * @brief the size of the type byte and the header that follows it
+ * @param type the type byte
+ * @returns 0 if type is not a bin_type
+ */
+size_t bin_header_len(uint8_t type);
+bin_reader bin_reader_new(const uint8_t* input, size_t input_len);
+/**
+ * @brief the type of the next value, without reading it
+ * @returns -1 at the end of input
+ */
+int bin_reader_peek(const bin_reader* r);
+/**
+ * @brief reads the header of an array or ht
+ * @param type BinArray or BinHt
+ * @param len set to the number of elements or entries
+ * @returns -1 if the next value is not of type
+ */
+int bin_read_len(bin_reader* r, bin_type type, uint64_t* len);
+/**
+ * @brief reads a string or simple string without copying it
+ * @param name set to point at the contents in input
+ * @returns -1 if the next value is not a string in input
+ */
+int bin_read_name(bin_reader* r, const uint8_t** name, size_t* name_len);
+/**
+ * @brief reads the next value. Simple strings and errors become String
+ * objects, as they do in parse_from_server. A detached string is moved into
+ * the object, and r->bulk left empty
+ * @returns a Null object if the value is malformed
+ */
+object bin_read_object(bin_reader* r);
+object bin_parse_from_server(const uint8_t* input, size_t input_len);
+
+#endif /* __BIN_PARSER_H__ */
@@ -1,6 +1,9 @@
 #include "builder.h"
+#include "bin_builder.h"
 #include "object.h"
+#include "proto.h"
 #include "vstr.h"
+#include <memory.h>
 #include <stdio.h>
 
 #define STRING_TYPE_BYTE '$'
@@ -11,180 +14,240 @@
 #define BOOLEAN_TYPE_BYTE '#'
 #define HT_TYPE_BYTE '%'
 
-static int builder_add_end(builder* b);
+/* the most digits a uint64 has, or an int64 with its sign */
+#define INT_STR_MAX 20
+/* a type byte, a number, and the \r\n after it */
+#define HEADER_MAX (1 + INT_STR_MAX + 2)
+/* longer than anything %g prints */
+#define DOUBLE_STR_MAX 32
+/* a builder keeps its buffer between replies, unless a reply this large
+ * grew it or builder_release is called */
+#define BUILDER_KEEP_MAX (16 * 1024)
+
+#define const_len(str) (sizeof str - 1)
+
+static const char ok_reply[] = "+OK\r\n";
+static const char ping_reply[] = "+PING\r\n";
+static const char pong_reply[] = "+PONG\r\n";
+static const char none_reply[] = "+NONE\r\n";
+static const char true_reply[] = "#t\r\n";
+static const char false_reply[] = "#f\r\n";
+
+typedef struct {
+    char str[7];
+    uint8_t len;
+} small_int_reply;
+
+#define SMALL_INT_REPLIES 1000
+#define SMALL_INT(n) {":" #n "\r\n", const_len(":" #n "\r\n")}
+#define SMALL_INTS_10(t)                                                       \
+    SMALL_INT(t##0), SMALL_INT(t##1), SMALL_INT(t##2), SMALL_INT(t##3),        \
+        SMALL_INT(t##4), SMALL_INT(t##5), SMALL_INT(t##6), SMALL_INT(t##7),    \
+        SMALL_INT(t##8), SMALL_INT(t##9)
+#define SMALL_INTS_100(h)                                                      \
+    SMALL_INTS_10(h##0), SMALL_INTS_10(h##1), SMALL_INTS_10(h##2),             \
+        SMALL_INTS_10(h##3), SMALL_INTS_10(h##4), SMALL_INTS_10(h##5),         \
+        SMALL_INTS_10(h##6), SMALL_INTS_10(h##7), SMALL_INTS_10(h##8),         \
+        SMALL_INTS_10(h##9)
+
+/* ":0\r\n" through ":999\r\n", so most integer replies are a single copy */
+static const small_int_reply small_int_replies[SMALL_INT_REPLIES] = {
+    SMALL_INT(0),       SMALL_INT(1),       SMALL_INT(2),
+    SMALL_INT(3),       SMALL_INT(4),       SMALL_INT(5),
+    SMALL_INT(6),       SMALL_INT(7),       SMALL_INT(8),
+    SMALL_INT(9),       SMALL_INTS_10(1),   SMALL_INTS_10(2),
+    SMALL_INTS_10(3),   SMALL_INTS_10(4),   SMALL_INTS_10(5),
+    SMALL_INTS_10(6),   SMALL_INTS_10(7),   SMALL_INTS_10(8),
+    SMALL_INTS_10(9),   SMALL_INTS_100(1),  SMALL_INTS_100(2),
+    SMALL_INTS_100(3),  SMALL_INTS_100(4),  SMALL_INTS_100(5),
+    SMALL_INTS_100(6),  SMALL_INTS_100(7),  SMALL_INTS_100(8),
+    SMALL_INTS_100(9),
+};
+
+static const char digit_pairs[] = "00010203040506070809"
+                                  "10111213141516171819"
+                                  "20212223242526272829"
+                                  "30313233343536373839"
+                                  "40414243444546474849"
+                                  "50515253545556575859"
+                                  "60616263646566676869"
+                                  "70717273747576777879"
+                                  "80818283848586878889"
+                                  "90919293949596979899";
+
+static int builder_add_len(builder* b, char type, uint64_t len);
+static size_t builder_format_u64(char* buf, uint64_t val);
+
+builder builder_new() {
+    builder b;
+    b.buf = vstr_new();
+    b.proto = PROTO_RESP;
+    return b;
+}
 
-builder builder_new() { return vstr_new(); }
+void builder_set_proto(builder* b, int proto) { b->proto = proto; }
 
-const uint8_t* builder_out(builder* b) { return (const uint8_t*)vstr_data(b); }
+const uint8_t* builder_out(builder* b) {
+    return (const uint8_t*)vstr_data(&b->buf);
+}
 
-size_t builder_len(builder* b) { return vstr_len(b); }
+size_t builder_len(builder* b) { return vstr_len(&b->buf); }
 
-int builder_add_ok(builder* b) { return vstr_push_string_len(b, "+OK\r\n", 5); }
+int builder_add_ok(builder* b) {
+    if (b->proto == PROTO_BIN) {
+        return bin_builder_add_simple(&b->buf, "OK", 2);
+    }
+    return vstr_push_string_len(&b->buf, ok_reply, const_len(ok_reply));
+}
 
 int builder_add_ping(builder* b) {
-    return vstr_push_string_len(b, "+PING\r\n", 7);
+    if (b->proto == PROTO_BIN) {
+        return bin_builder_add_simple(&b->buf, "PING", 4);
+    }
+    return vstr_push_string_len(&b->buf, ping_reply, const_len(ping_reply));
 }
 
 int builder_add_pong(builder* b) {
-    return vstr_push_string_len(b, "+PONG\r\n", 7);
+    if (b->proto == PROTO_BIN) {
+        return bin_builder_add_simple(&b->buf, "PONG", 4);
+    }
+    return vstr_push_string_len(&b->buf, pong_reply, const_len(pong_reply));
 }
 
 int builder_add_none(builder* b) {
-    return vstr_push_string_len(b, "+NONE\r\n", 7);
-}
-
-int builder_add_array(builder* b, size_t arr_len) {
-    int res;
-    vstr len_vstr;
-    const char* len_str;
-    size_t len_str_len;
-
-    len_vstr = vstr_format("%lu", arr_len);
-    len_str_len = vstr_len(&len_vstr);
-    len_str = vstr_data(&len_vstr);
-
-    vstr_free(&len_vstr);
-
-    if (len_str == 0) {
-        return -1;
+    if (b->proto == PROTO_BIN) {
+        return bin_builder_add_null(&b->buf);
     }
+    return vstr_push_string_len(&b->buf, none_reply, const_len(none_reply));
+}
 
-    res = vstr_push_char(b, ARRAY_TYPE_BYTE);
-    if (res == -1) {
-        return -1;
-    }
+/* appends data that is already encoded in b's protocol, such as a reply
+ * built on another reactor */
+int builder_add_raw(builder* b, const uint8_t* data, size_t len) {
+    return vstr_push_string_len(&b->buf, (const char*)data, len);
+}
 
-    res = vstr_push_string_len(b, len_str, len_str_len);
-    if (res == -1) {
-        return -1;
+int builder_add_array(builder* b, size_t arr_len) {
+    if (b->proto == PROTO_BIN) {
+        return bin_builder_add_array(&b->buf, arr_len);
     }
-
-    res = builder_add_end(b);
-    return res;
+    return builder_add_len(b, ARRAY_TYPE_BYTE, arr_len);
 }
 
 int builder_add_err(builder* b, const char* str, size_t len) {
-    int res = 0;
-
-    res = vstr_push_char(b, SIMPLE_ERR_TYPE_BYTE);
-    if (res == -1) {
-        return -1;
+    char* buf;
+    if (b->proto == PROTO_BIN) {
+        return bin_builder_add_err(&b->buf, str, len);
     }
-
-    res = vstr_push_string_len(b, str, len);
-    if (res == -1) {
+    buf = vstr_reserve(&b->buf, 1 + len + 2);
+    if (buf == NULL) {
         return -1;
     }
-
-    res = builder_add_end(b);
-
-    return res;
+    buf[0] = SIMPLE_ERR_TYPE_BYTE;
+    memcpy(buf + 1, str, len);
+    memcpy(buf + 1 + len, "\r\n", 2);
+    vstr_commit(&b->buf, 1 + len + 2);
+    return 0;
 }
 
+/* the header and the contents go into one reservation */
 int builder_add_string(builder* b, const char* str, size_t str_len) {
-    vstr len_vstr;
-    const char* len_str;
-    size_t len_str_len;
-    int res;
-
-    res = vstr_push_char(b, STRING_TYPE_BYTE);
-
-    if (res == -1) {
-        return -1;
+    char* buf;
+    size_t n;
+    if (b->proto == PROTO_BIN) {
+        return bin_builder_add_string(&b->buf, str, str_len);
     }
-
-    len_vstr = vstr_format("%lu", str_len);
-    len_str = vstr_data(&len_vstr);
-    len_str_len = vstr_len(&len_vstr);
-    res = vstr_push_string_len(b, len_str, len_str_len);
-    vstr_free(&len_vstr);
-    if (res == -1) {
-        return -1;
-    }
-    res = builder_add_end(b);
-    if (res == -1) {
+    buf = vstr_reserve(&b->buf, HEADER_MAX + str_len + 2);
+    if (buf == NULL) {
         return -1;
     }
+    buf[0] = STRING_TYPE_BYTE;
+    n = 1 + builder_format_u64(buf + 1, str_len);
+    memcpy(buf + n, "\r\n", 2);
+    n += 2;
+    memcpy(buf + n, str, str_len);
+    n += str_len;
+    memcpy(buf + n, "\r\n", 2);
+    vstr_commit(&b->buf, n + 2);
+    return 0;
+}
 
-    res = vstr_push_string_len(b, str, str_len);
-    if (res == -1) {
-        return -1;
+int builder_add_string_header(builder* b, size_t str_len) {
+    if (b->proto == PROTO_BIN) {
+        return bin_builder_add_string_header(&b->buf, str_len);
     }
+    return builder_add_len(b, STRING_TYPE_BYTE, str_len);
+}
 
-    res = builder_add_end(b);
-    return res;
+/* binary strings are not terminated */
+int builder_add_string_end(builder* b) {
+    if (b->proto == PROTO_BIN) {
+        return 0;
+    }
+    return vstr_push_string_len(&b->buf, "\r\n", 2);
 }
 
 int builder_add_int(builder* b, int64_t val) {
-    int res = 0;
-    vstr int_str = vstr_format("%ld", val);
-    const char* int_str_s = vstr_data(&int_str);
-    size_t int_str_len = vstr_len(&int_str);
-    res = vstr_push_char(b, ':');
-    if (res == -1) {
-        vstr_free(&int_str);
-        return -1;
+    char* buf;
+    size_t n;
+    if (b->proto == PROTO_BIN) {
+        return bin_builder_add_int(&b->buf, val);
     }
-
-    res = vstr_push_string_len(b, int_str_s, int_str_len);
-    vstr_free(&int_str);
-    if (res == -1) {
+    if (val >= 0 && val < SMALL_INT_REPLIES) {
+        const small_int_reply* reply = &small_int_replies[val];
+        return vstr_push_string_len(&b->buf, reply->str, reply->len);
+    }
+    if (val >= 0) {
+        return builder_add_len(b, INT_TYPE_BYTE, val);
+    }
+    buf = vstr_reserve(&b->buf, HEADER_MAX);
+    if (buf == NULL) {
         return -1;
     }
-
-    res = builder_add_end(b);
-    return res;
+    buf[0] = INT_TYPE_BYTE;
+    buf[1] = '-';
+    n = 2 + builder_format_u64(buf + 2, 0 - (uint64_t)val);
+    memcpy(buf + n, "\r\n", 2);
+    vstr_commit(&b->buf, n + 2);
+    return 0;
 }
 
 int builder_add_boolean(builder* b, int boolean) {
-    int res = vstr_push_char(b, BOOLEAN_TYPE_BYTE);
-    if (res == -1) {
-        return -1;
+    if (b->proto == PROTO_BIN) {
+        return bin_builder_add_bool(&b->buf, boolean);
     }
-    res = boolean ? vstr_push_char(b, 't') : vstr_push_char(b, 'f');
-    if (res == -1) {
-        return -1;
+    if (boolean) {
+        return vstr_push_string_len(&b->buf, true_reply,
+                                    const_len(true_reply));
     }
-    res = builder_add_end(b);
-    return res;
+    return vstr_push_string_len(&b->buf, false_reply, const_len(false_reply));
 }
 
 int builder_add_double(builder* b, double val) {
-    vstr tmp = vstr_format("%g", val);
-    const char* tmp_data = vstr_data(&tmp);
-    size_t tmp_len = vstr_len(&tmp);
-    int res = vstr_push_char(b, DOUBLE_TYPE_BYTE);
-    if (res == -1) {
-        vstr_free(&tmp);
+    char* buf;
+    int n;
+    if (b->proto == PROTO_BIN) {
+        return bin_builder_add_double(&b->buf, val);
+    }
+    buf = vstr_reserve(&b->buf, 1 + DOUBLE_STR_MAX + 2);
+    if (buf == NULL) {
         return -1;
     }
-    res = vstr_push_string_len(b, tmp_data, tmp_len);
-    if (res == -1) {
-        vstr_free(&tmp);
+    buf[0] = DOUBLE_TYPE_BYTE;
+    n = snprintf(buf + 1, DOUBLE_STR_MAX, "%g", val);
+    if (n < 0 || n >= DOUBLE_STR_MAX) {
         return -1;
     }
-    vstr_free(&tmp);
-    res = builder_add_end(b);
-    return res;
+    memcpy(buf + 1 + n, "\r\n", 2);
+    vstr_commit(&b->buf, 1 + n + 2);
+    return 0;
 }
 
 int builder_add_ht(builder* b, size_t len) {
-    int add_res;
-    vstr len_str = vstr_format("%lu", len);
-    const char* len_str_s = vstr_data(&len_str);
-    size_t len_str_len = vstr_len(&len_str);
-    add_res = vstr_push_char(b, HT_TYPE_BYTE);
-    if (add_res == -1) {
-        vstr_free(&len_str);
-        return -1;
+    if (b->proto == PROTO_BIN) {
+        return bin_builder_add_ht(&b->buf, len);
     }
-    add_res = vstr_push_string_len(b, len_str_s, len_str_len);
-    if (add_res == -1) {
-        vstr_free(&len_str);
-        return -1;
-    }
-    vstr_free(&len_str);
-    return builder_add_end(b);
+    return builder_add_len(b, HT_TYPE_BYTE, len);
 }
 
 int builder_add_object(builder* b, const object* obj) {
@@ -234,6 +297,7 @@ int builder_add_object(builder* b, const object* obj) {
             if (add_res == -1) {
                 return -1;
             }
+            ht_iter_next(&iter);
         }
         return 0;
     }
@@ -241,19 +305,56 @@ int builder_add_object(builder* b, const object* obj) {
     return -1;
 }
 
-void builder_reset(builder* b) { vstr_reset(b); }
+/* builders are reset after every flush, so the buffer is kept for the next
+ * reply rather than freed and allocated again */
+void builder_reset(builder* b) {
+    if (vstr_len(&b->buf) > BUILDER_KEEP_MAX) {
+        vstr_reset(&b->buf);
+        return;
+    }
+    vstr_clear(&b->buf);
+}
 
-void builder_free(builder* b) { vstr_free(b); }
+void builder_release(builder* b) { vstr_reset(&b->buf); }
 
-static int builder_add_end(builder* b) {
-    int res = 0;
-    res = vstr_push_char(b, '\r');
-    if (res == -1) {
+void builder_free(builder* b) { vstr_free(&b->buf); }
+
+/* writes a type byte, len, and \r\n */
+static int builder_add_len(builder* b, char type, uint64_t len) {
+    char* buf = vstr_reserve(&b->buf, HEADER_MAX);
+    size_t n;
+    if (buf == NULL) {
         return -1;
     }
-    res = vstr_push_char(b, '\n');
-    if (res == -1) {
-        return -1;
+    buf[0] = type;
+    n = 1 + builder_format_u64(buf + 1, len);
+    memcpy(buf + n, "\r\n", 2);
+    vstr_commit(&b->buf, n + 2);
+    return 0;
+}
+
+/* writes val in decimal to buf, which must have room for INT_STR_MAX bytes,
+ * and returns the number of bytes written. The digits are produced two at a
+ * time from the back, so a 20 digit number takes 10 divisions */
+static size_t builder_format_u64(char* buf, uint64_t val) {
+    char tmp[INT_STR_MAX];
+    char* p = tmp + sizeof tmp;
+    size_t len;
+
+    while (val >= 100) {
+        size_t pair = (val % 100) * 2;
+        val /= 100;
+        p -= 2;
+        memcpy(p, digit_pairs + pair, 2);
+    }
+    if (val >= 10) {
+        p -= 2;
+        memcpy(p, digit_pairs + (val * 2), 2);
+    } else {
+        *--p = '0' + val;
     }
-    return res;
+
+    len = (tmp + sizeof tmp) - p;
+    memcpy(buf, p, len);
+    return len;
 }
@@ -3,11 +3,23 @@
 #define __BUILDER_H__
 
 #include "object.h"
+#include "proto.h"
 #include "vstr.h"
 
-typedef vstr builder;
+/* replies and requests are built in the connection's protocol, RESP until
+ * builder_set_proto says otherwise */
+typedef struct {
+    vstr buf;
+    int proto; /* PROTO_RESP or PROTO_BIN */
+} builder;
 
 builder builder_new(void);
+/**
+ * @brief switches the protocol the values added after this are encoded in
+ * @param b the builder
+ * @param proto PROTO_RESP or PROTO_BIN, see proto.h
+ */
+void builder_set_proto(builder* b, int proto);
 const uint8_t* builder_out(builder* b);
 size_t builder_len(builder* b);
 int builder_add_ok(builder* b);
@@ -18,10 +30,31 @@ int builder_add_array(builder* b, size_t arr_len);
 int builder_add_ht(builder* b, size_t len);
 int builder_add_err(builder* b, const char* str, size_t len);
 int builder_add_string(builder* b, const char* str, size_t str_len);
+/**
+ * @brief adds what comes before the contents of a string, for a reply whose
+ * contents are written from somewhere other than the builder. Must be
+ * followed by the contents and then builder_add_string_end
+ * @param b the builder
+ * @param str_len the length of the contents
+ */
+int builder_add_string_header(builder* b, size_t str_len);
+/**
+ * @brief adds what comes after the contents of a string started with
+ * builder_add_string_header
+ * @param b the builder
+ */
+int builder_add_string_end(builder* b);
 int builder_add_int(builder* b, int64_t val);
 int builder_add_double(builder* b, double val);
 int builder_add_object(builder* b, const object* obj);
+int builder_add_raw(builder* b, const uint8_t* data, size_t len);
 void builder_reset(builder* b);
+/**
+ * @brief empties the builder and frees its buffer, which builder_reset may
+ * keep for the next reply. The builder can still be used afterwards
+ * @param b the builder
+ */
+void builder_release(builder* b);
 void builder_free(builder* builder);
 
 #endif /* __BUILDER_H__ */
@@ -4,9 +4,14 @@
 
 #include "object.h"
 #include <stddef.h>
+#include <stdint.h>
 
 struct cmd_help;
 
+/* set in the json files in cmds/ */
+#define CMD_NO_AUTH (1 << 0)  /* may be run before authenticating */
+#define CMD_BLOCKING (1 << 1) /* may wait for another client */
+
 typedef struct {
     const char* name;
     size_t types_len;
@@ -33,6 +38,9 @@ typedef enum {
     ZSet,
     ZHas,
     ZDel,
+    Bpop,
+    Bdeque,
+    Hello,
 } cmdt;
 
 typedef struct {
@@ -53,6 +61,10 @@ typedef struct {
     object password;
 } auth_cmd;
 
+typedef struct {
+    int64_t timeout; /* milliseconds to wait, 0 to wait forever */
+} block_cmd;
+
 typedef struct {
     int wants_cmd_help;
     cmdt cmd_to_help;
@@ -67,6 +79,9 @@ typedef v_cmd zset_cmd;
 typedef v_cmd zhas_cmd;
 typedef v_cmd zdel_cmd;
 typedef v_cmd select_cmd;
+typedef v_cmd hello_cmd;
+typedef block_cmd bpop_cmd;
+typedef block_cmd bdeque_cmd;
 
 typedef struct {
     cmdt type;
@@ -82,6 +97,9 @@ typedef struct {
         zdel_cmd zdel;
         help_cmd help;
         select_cmd select;
+        bpop_cmd bpop;
+        bdeque_cmd bdeque;
+        hello_cmd hello;
     } data;
 } cmd;
 
@@ -8,6 +8,7 @@
 #include <ctype.h>
 #include <memory.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 typedef struct {
@@ -21,9 +22,20 @@ typedef struct {
     line_data_type type;
     union {
         vstr address;
+        vstr unixsocket;
         vstr loglevel;
         uint16_t port;
         size_t databases;
+        size_t max_clients;
+        size_t backlog;
+        size_t io_threads;
+        size_t reactors;
+        bool reply_cache;
+        bool io_uring;
+        struct {
+            client_class client_class;
+            output_limit limit;
+        } output_limit;
         user user;
     } data;
 } line_data;
@@ -39,13 +51,34 @@ result_t(line_data_type, vstr);
 result_t(user, vstr);
 result_t(size_t, vstr);
 result_t(uint16_t, vstr);
+result_t(client_class, vstr);
+result_t(bool, vstr);
 
 const line_data_type_lookup lookups[] = {
     {"port", 4, Port},           {"user", 4, User},
     {"address", 7, Address},     {"loglevel", 8, LogLevel},
-    {"databases", 9, Databases},
+    {"databases", 9, Databases}, {"maxclients", 10, MaxClients},
+    {"backlog", 7, Backlog},     {"io-threads", 10, IoThreads},
+    {"reactors", 8, Reactors},   {"unixsocket", 10, UnixSocket},
+    {"client-output-buffer-limit", 26, ClientOutputBufferLimit},
+    {"reply-cache", 11, ReplyCache},
+    {"io-uring", 8, IoUring},
 };
 
+typedef struct {
+    const char* str;
+    size_t str_len;
+    client_class client_class;
+} client_class_lookup;
+
+const client_class_lookup client_class_lookups[] = {
+    {"normal", 6, ClientNormal},
+    {"shm", 3, ClientShm},
+};
+
+const size_t client_class_lookups_len =
+    sizeof client_class_lookups / sizeof client_class_lookups[0];
+
 const size_t lookups_len = sizeof lookups / sizeof lookups[0];
 
 static config_parser config_parser_new(const char* input, size_t input_len);
@@ -57,8 +90,16 @@ static result(line_data_type)
 static result(user) config_parser_parse_user(config_parser* p);
 static result(size_t) config_parser_parse_num_databases(config_parser* p);
 static result(uint16_t) config_parser_parse_port(config_parser* p);
+static result(size_t) config_parser_parse_size(config_parser* p,
+                                               const char* name);
+static result(bool) config_parser_parse_bool(config_parser* p,
+                                             const char* name);
 static vstr config_parser_parse_address(config_parser* p);
 static vstr config_parser_parse_log_level(config_parser* p);
+static result(vstr) config_parser_parse_unix_socket(config_parser* p);
+static result(line_data) config_parser_parse_output_limit(config_parser* p);
+static result(client_class) config_parser_parse_client_class(config_parser* p);
+static result(size_t) config_parser_parse_bytes(config_parser* p);
 static vstr config_parser_read_string(config_parser* p);
 static void config_parser_read_char(config_parser* p);
 static void config_parser_skip_empty_lines_and_comments(config_parser* p);
@@ -77,6 +118,9 @@ void config_free(config* config) {
     if (vstr_len(&config->address) > 0) {
         vstr_free(&config->address);
     }
+    if (vstr_len(&config->unixsocket) > 0) {
+        vstr_free(&config->unixsocket);
+    }
     if (vstr_len(&config->loglevel) > 0) {
         vstr_free(&config->loglevel);
     }
@@ -87,6 +131,9 @@ void config_free_light(config* config) {
     if (vstr_len(&config->address) > 0) {
         vstr_free(&config->address);
     }
+    if (vstr_len(&config->unixsocket) > 0) {
+        vstr_free(&config->unixsocket);
+    }
     if (vstr_len(&config->loglevel) > 0) {
         vstr_free(&config->loglevel);
     }
@@ -107,6 +154,7 @@ static config config_new(void) {
     c.users = vec_new(sizeof(user));
     assert(c.users != NULL);
     c.address = vstr_new();
+    c.unixsocket = vstr_new();
     c.loglevel = vstr_new();
     return c;
 }
@@ -170,6 +218,84 @@ static result(config) config_parser_parse(config_parser* p) {
             }
             config.databases = line_data.data.databases;
             break;
+        case MaxClients:
+            if (config.max_clients != 0) {
+                config_free(&config);
+                res.type = Err;
+                res.data.err = vstr_from("maxclients set twice in config");
+                return res;
+            }
+            config.max_clients = line_data.data.max_clients;
+            break;
+        case Backlog:
+            if (config.backlog != 0) {
+                config_free(&config);
+                res.type = Err;
+                res.data.err = vstr_from("backlog set twice in config");
+                return res;
+            }
+            config.backlog = line_data.data.backlog;
+            break;
+        case IoThreads:
+            if (config.io_threads != 0) {
+                config_free(&config);
+                res.type = Err;
+                res.data.err = vstr_from("io-threads set twice in config");
+                return res;
+            }
+            config.io_threads = line_data.data.io_threads;
+            break;
+        case Reactors:
+            if (config.reactors != 0) {
+                config_free(&config);
+                res.type = Err;
+                res.data.err = vstr_from("reactors set twice in config");
+                return res;
+            }
+            config.reactors = line_data.data.reactors;
+            break;
+        case UnixSocket:
+            if (vstr_len(&config.unixsocket) != 0) {
+                vstr_free(&line_data.data.unixsocket);
+                config_free(&config);
+                res.type = Err;
+                res.data.err = vstr_from("unixsocket set twice in config");
+                return res;
+            }
+            config.unixsocket = line_data.data.unixsocket;
+            break;
+        case ClientOutputBufferLimit: {
+            client_class class = line_data.data.output_limit.client_class;
+            if (config.output_limits_set[class]) {
+                config_free(&config);
+                res.type = Err;
+                res.data.err = vstr_from(
+                    "client-output-buffer-limit set twice for a client class");
+                return res;
+            }
+            config.output_limits[class] = line_data.data.output_limit.limit;
+            config.output_limits_set[class] = true;
+        } break;
+        case ReplyCache:
+            if (config.reply_cache_set) {
+                config_free(&config);
+                res.type = Err;
+                res.data.err = vstr_from("reply-cache set twice in config");
+                return res;
+            }
+            config.reply_cache = line_data.data.reply_cache;
+            config.reply_cache_set = true;
+            break;
+        case IoUring:
+            if (config.io_uring_set) {
+                config_free(&config);
+                res.type = Err;
+                res.data.err = vstr_from("io-uring set twice in config");
+                return res;
+            }
+            config.io_uring = line_data.data.io_uring;
+            config.io_uring_set = true;
+            break;
         }
     }
     res.type = Ok;
@@ -241,6 +367,101 @@ static result(line_data) config_parser_parse_line(config_parser* p) {
         res.data.ok.type = Databases;
         res.data.ok.data.databases = databases_res.data.ok;
     } break;
+    case MaxClients: {
+        result(size_t) max_clients_res;
+        config_parser_skip_spaces(p);
+        max_clients_res = config_parser_parse_size(p, "maxclients");
+        if (max_clients_res.type == Err) {
+            res.type = Err;
+            res.data.err = max_clients_res.data.err;
+            break;
+        }
+        res.type = Ok;
+        res.data.ok.type = MaxClients;
+        res.data.ok.data.max_clients = max_clients_res.data.ok;
+    } break;
+    case Backlog: {
+        result(size_t) backlog_res;
+        config_parser_skip_spaces(p);
+        backlog_res = config_parser_parse_size(p, "backlog");
+        if (backlog_res.type == Err) {
+            res.type = Err;
+            res.data.err = backlog_res.data.err;
+            break;
+        }
+        res.type = Ok;
+        res.data.ok.type = Backlog;
+        res.data.ok.data.backlog = backlog_res.data.ok;
+    } break;
+    case IoThreads: {
+        result(size_t) io_threads_res;
+        config_parser_skip_spaces(p);
+        io_threads_res = config_parser_parse_size(p, "io-threads");
+        if (io_threads_res.type == Err) {
+            res.type = Err;
+            res.data.err = io_threads_res.data.err;
+            break;
+        }
+        res.type = Ok;
+        res.data.ok.type = IoThreads;
+        res.data.ok.data.io_threads = io_threads_res.data.ok;
+    } break;
+    case Reactors: {
+        result(size_t) reactors_res;
+        config_parser_skip_spaces(p);
+        reactors_res = config_parser_parse_size(p, "reactors");
+        if (reactors_res.type == Err) {
+            res.type = Err;
+            res.data.err = reactors_res.data.err;
+            break;
+        }
+        res.type = Ok;
+        res.data.ok.type = Reactors;
+        res.data.ok.data.reactors = reactors_res.data.ok;
+    } break;
+    case UnixSocket: {
+        result(vstr) path_res;
+        config_parser_skip_spaces(p);
+        path_res = config_parser_parse_unix_socket(p);
+        if (path_res.type == Err) {
+            res.type = Err;
+            res.data.err = path_res.data.err;
+            break;
+        }
+        res.type = Ok;
+        res.data.ok.type = UnixSocket;
+        res.data.ok.data.unixsocket = path_res.data.ok;
+    } break;
+    case ClientOutputBufferLimit:
+        config_parser_skip_spaces(p);
+        res = config_parser_parse_output_limit(p);
+        break;
+    case ReplyCache: {
+        result(bool) bool_res;
+        config_parser_skip_spaces(p);
+        bool_res = config_parser_parse_bool(p, "reply-cache");
+        if (bool_res.type == Err) {
+            res.type = Err;
+            res.data.err = bool_res.data.err;
+            break;
+        }
+        res.type = Ok;
+        res.data.ok.type = ReplyCache;
+        res.data.ok.data.reply_cache = bool_res.data.ok;
+    } break;
+    case IoUring: {
+        result(bool) bool_res;
+        config_parser_skip_spaces(p);
+        bool_res = config_parser_parse_bool(p, "io-uring");
+        if (bool_res.type == Err) {
+            res.type = Err;
+            res.data.err = bool_res.data.err;
+            break;
+        }
+        res.type = Ok;
+        res.data.ok.type = IoUring;
+        res.data.ok.data.io_uring = bool_res.data.ok;
+    } break;
     }
     return res;
 }
@@ -340,6 +561,208 @@ static result(uint16_t) config_parser_parse_port(config_parser* p) {
     return res;
 }
 
+static result(size_t) config_parser_parse_size(config_parser* p,
+                                               const char* name) {
+    result(size_t) res = {0};
+    size_t num = 0;
+    if (!isdigit(p->ch)) {
+        res.type = Err;
+        res.data.err = vstr_format("expected a number after %s", name);
+        return res;
+    }
+    while (isdigit(p->ch)) {
+        size_t digit = p->ch - '0';
+        if (num > (SIZE_MAX - digit) / 10) {
+            res.type = Err;
+            res.data.err = vstr_format("%s is too big", name);
+            return res;
+        }
+        num = (num * 10) + digit;
+        config_parser_read_char(p);
+    }
+    config_parser_skip_spaces(p);
+    if (p->ch != '\n' && p->ch != 0) {
+        res.type = Err;
+        res.data.err = vstr_format("expected only a number after %s", name);
+        return res;
+    }
+    /* 0 is what an unset option reads as */
+    if (num == 0) {
+        res.type = Err;
+        res.data.err = vstr_format("%s must be at least 1", name);
+        return res;
+    }
+    res.type = Ok;
+    res.data.ok = num;
+    return res;
+}
+
+/* client-output-buffer-limit <class> <hard> <soft> */
+static result(line_data) config_parser_parse_output_limit(config_parser* p) {
+    result(line_data) res = {0};
+    result(client_class) class_res;
+    result(size_t) hard_res, soft_res;
+
+    class_res = config_parser_parse_client_class(p);
+    if (class_res.type == Err) {
+        res.type = Err;
+        res.data.err = class_res.data.err;
+        return res;
+    }
+    config_parser_skip_spaces(p);
+
+    hard_res = config_parser_parse_bytes(p);
+    if (hard_res.type == Err) {
+        res.type = Err;
+        res.data.err = hard_res.data.err;
+        return res;
+    }
+    config_parser_skip_spaces(p);
+
+    soft_res = config_parser_parse_bytes(p);
+    if (soft_res.type == Err) {
+        res.type = Err;
+        res.data.err = soft_res.data.err;
+        return res;
+    }
+    config_parser_skip_spaces(p);
+
+    if (p->ch != '\n' && p->ch != 0) {
+        res.type = Err;
+        res.data.err = vstr_from("expected only a client class, a hard limit, "
+                                 "and a soft limit after "
+                                 "client-output-buffer-limit");
+        return res;
+    }
+
+    if (hard_res.data.ok != 0 && soft_res.data.ok > hard_res.data.ok) {
+        res.type = Err;
+        res.data.err = vstr_from(
+            "client-output-buffer-limit soft limit is above the hard limit");
+        return res;
+    }
+
+    res.type = Ok;
+    res.data.ok.type = ClientOutputBufferLimit;
+    res.data.ok.data.output_limit.client_class = class_res.data.ok;
+    res.data.ok.data.output_limit.limit.hard = hard_res.data.ok;
+    res.data.ok.data.output_limit.limit.soft = soft_res.data.ok;
+    return res;
+}
+
+static result(client_class) config_parser_parse_client_class(config_parser* p) {
+    result(client_class) res = {0};
+    vstr class_string = config_parser_read_string(p);
+    size_t slen = vstr_len(&class_string);
+    const char* s = vstr_data(&class_string);
+    size_t i;
+
+    for (i = 0; i < client_class_lookups_len; ++i) {
+        client_class_lookup lookup = client_class_lookups[i];
+        if (lookup.str_len != slen) {
+            continue;
+        }
+        if (memcmp(lookup.str, s, slen) != 0) {
+            continue;
+        }
+        vstr_free(&class_string);
+        res.type = Ok;
+        res.data.ok = lookup.client_class;
+        return res;
+    }
+    res.type = Err;
+    res.data.err = vstr_format("unknown client class: %s", s);
+    vstr_free(&class_string);
+    return res;
+}
+
+/* a number of bytes, optionally followed by k, kb, m, mb, g, or gb */
+static result(size_t) config_parser_parse_bytes(config_parser* p) {
+    result(size_t) res = {0};
+    size_t num = 0;
+    size_t mul = 1;
+
+    if (!isdigit(p->ch)) {
+        res.type = Err;
+        res.data.err = vstr_from("expected a size in bytes");
+        return res;
+    }
+    while (isdigit(p->ch)) {
+        size_t digit = p->ch - '0';
+        if (num > (SIZE_MAX - digit) / 10) {
+            res.type = Err;
+            res.data.err = vstr_from("size is too big");
+            return res;
+        }
+        num = (num * 10) + digit;
+        config_parser_read_char(p);
+    }
+
+    switch (tolower(p->ch)) {
+    case 'k':
+        mul = 1024;
+        break;
+    case 'm':
+        mul = 1024 * 1024;
+        break;
+    case 'g':
+        mul = 1024 * 1024 * 1024;
+        break;
+    }
+    if (mul != 1) {
+        config_parser_read_char(p);
+        if (tolower(p->ch) == 'b') {
+            config_parser_read_char(p);
+        }
+    }
+
+    if (p->ch != ' ' && p->ch != '\t' && p->ch != '\n' && p->ch != 0) {
+        res.type = Err;
+        res.data.err = vstr_format("unknown size unit '%c'", p->ch);
+        return res;
+    }
+
+    if (num > SIZE_MAX / mul) {
+        res.type = Err;
+        res.data.err = vstr_from("size is too big");
+        return res;
+    }
+
+    res.type = Ok;
+    res.data.ok = num * mul;
+    return res;
+}
+
+/* yes or no */
+static result(bool) config_parser_parse_bool(config_parser* p,
+                                             const char* name) {
+    result(bool) res = {0};
+    vstr str = config_parser_read_string(p);
+    const char* s = vstr_data(&str);
+    size_t len = vstr_len(&str);
+
+    if (len == 3 && memcmp(s, "yes", 3) == 0) {
+        res.data.ok = true;
+    } else if (len == 2 && memcmp(s, "no", 2) == 0) {
+        res.data.ok = false;
+    } else {
+        vstr_free(&str);
+        res.type = Err;
+        res.data.err = vstr_format("expected yes or no after %s", name);
+        return res;
+    }
+    vstr_free(&str);
+
+    config_parser_skip_spaces(p);
+    if (p->ch != '\n' && p->ch != 0) {
+        res.type = Err;
+        res.data.err = vstr_format("expected only yes or no after %s", name);
+        return res;
+    }
+    res.type = Ok;
+    return res;
+}
+
 static vstr config_parser_parse_address(config_parser* p) {
     vstr res = vstr_new();
     while (isdigit(p->ch) || p->ch == '.') {
@@ -364,6 +787,26 @@ static vstr config_parser_parse_log_level(config_parser* p) {
     return res;
 }
 
+static result(vstr) config_parser_parse_unix_socket(config_parser* p) {
+    result(vstr) res = {0};
+    vstr path = config_parser_read_string(p);
+    config_parser_skip_spaces(p);
+    if (vstr_len(&path) == 0) {
+        res.type = Err;
+        res.data.err = vstr_from("expected a path after unixsocket");
+        return res;
+    }
+    if (p->ch != '\n' && p->ch != 0) {
+        vstr_free(&path);
+        res.type = Err;
+        res.data.err = vstr_from("expected only a path after unixsocket");
+        return res;
+    }
+    res.type = Ok;
+    res.data.ok = path;
+    return res;
+}
+
 static vstr config_parser_read_string(config_parser* p) {
     vstr s = vstr_new();
     while (p->ch != ' ' && p->ch != '\n' && p->ch != 0) {
@@ -5,6 +5,7 @@
 #include "ht.h"
 #include "result.h"
 #include "vec.h"
+#include <stdbool.h>
 
 typedef enum {
     Address,
@@ -12,12 +13,43 @@ typedef enum {
     User,
     LogLevel,
     Databases,
+    MaxClients,
+    Backlog,
+    IoThreads,
+    Reactors,
+    UnixSocket,
+    ClientOutputBufferLimit,
+    ReplyCache,
+    IoUring,
 } line_data_type;
 
+typedef enum {
+    ClientNormal, /* tcp and unix socket clients */
+    ClientShm,    /* clients using shared memory */
+} client_class;
+
+#define CLIENT_CLASSES 2
+
+typedef struct {
+    size_t hard; /* the client is dropped past this many bytes, 0 for none */
+    size_t soft; /* reading stops past this many bytes, 0 for none */
+} output_limit;
+
 typedef struct {
     uint16_t port;
     size_t databases;
+    size_t max_clients;
+    size_t backlog;
+    size_t io_threads;
+    size_t reactors;
     vstr address;
+    vstr unixsocket;
+    output_limit output_limits[CLIENT_CLASSES];
+    bool output_limits_set[CLIENT_CLASSES];
+    bool reply_cache; /* cache the RESP replies to GET of arrays and maps */
+    bool reply_cache_set;
+    bool io_uring; /* use io_uring for the event loop when the kernel has it */
+    bool io_uring_set;
     vec* users;
     vstr loglevel;
 } config;
@@ -1,7 +1,15 @@
+#define _DEFAULT_SOURCE
 #include "ev.h"
 #include "config.h"
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
+
+#define EV_TIMERS_INITIAL_CAP 8
+
+#if HAVE_IO_URING
+#include "ev_uring.c"
+#endif
 
 #if HAVE_EPOLL
 #include "ev_epoll.c"
@@ -9,7 +17,70 @@
 #include "ev_select.c"
 #endif
 
-ev* ev_new(int num_fds) {
+/* io_uring is only used when asked for with EV_OPT_URING and the kernel
+ * lets us have it. Everything else uses the backend chosen at build time */
+
+static int ev_backend_new(ev* ev, int opts) {
+#if HAVE_IO_URING
+    if ((opts & EV_OPT_URING) && ev_uring_supported() &&
+        ev_uring_api_new(ev) == 0) {
+        ev->uring = 1;
+        return 0;
+    }
+#else
+    ev_unused(opts);
+#endif
+    return ev_api_new(ev);
+}
+
+static int ev_backend_resize(ev* ev, int num_fds) {
+#if HAVE_IO_URING
+    if (ev->uring) {
+        return ev_uring_api_resize(ev, num_fds);
+    }
+#endif
+    return ev_api_resize(ev, num_fds);
+}
+
+static int ev_backend_add_event(ev* ev, int fd, int mask) {
+#if HAVE_IO_URING
+    if (ev->uring) {
+        return ev_uring_api_add_event(ev, fd, mask);
+    }
+#endif
+    return ev_api_add_event(ev, fd, mask);
+}
+
+static void ev_backend_del_event(ev* ev, int fd, int mask) {
+#if HAVE_IO_URING
+    if (ev->uring) {
+        ev_uring_api_del_event(ev, fd, mask);
+        return;
+    }
+#endif
+    ev_api_del_event(ev, fd, mask);
+}
+
+static int ev_backend_poll(ev* ev, struct timeval* tvp) {
+#if HAVE_IO_URING
+    if (ev->uring) {
+        return ev_uring_api_poll(ev, tvp);
+    }
+#endif
+    return ev_api_poll(ev, tvp);
+}
+
+static void ev_backend_free(ev* ev) {
+#if HAVE_IO_URING
+    if (ev->uring) {
+        ev_uring_api_free(ev);
+        return;
+    }
+#endif
+    ev_api_free(ev);
+}
+
+ev* ev_new(int num_fds, int opts) {
     ev* ev;
     int i;
 
@@ -33,7 +104,7 @@ ev* ev_new(int num_fds) {
         return NULL;
     }
 
-    if (ev_api_new(ev) == -1) {
+    if (ev_backend_new(ev, opts) == -1) {
         free(ev->fired);
         free(ev->events);
         free(ev);
@@ -45,6 +116,7 @@ ev* ev_new(int num_fds) {
     }
 
     ev->max_fd = -1;
+    ev->running_timer = -1;
     return ev;
 }
 
@@ -52,7 +124,7 @@ int ev_get_num_fds(ev* ev) { return ev->num_fds; }
 
 int ev_resize_num_fds(ev* ev, int num_fds) {
     void* tmp;
-    int i;
+    int i, old_num_fds = ev->num_fds;
     if (ev->num_fds == num_fds) {
         return 0;
     }
@@ -61,7 +133,7 @@ int ev_resize_num_fds(ev* ev, int num_fds) {
         return -1;
     }
 
-    if (ev_api_resize(ev, num_fds) == -1) {
+    if (ev_backend_resize(ev, num_fds) == -1) {
         return -1;
     }
 
@@ -77,22 +149,29 @@ int ev_resize_num_fds(ev* ev, int num_fds) {
     }
     ev->fired = tmp;
 
-    for (i = 0; i < num_fds; ++i) {
+    for (i = old_num_fds; i < num_fds; ++i) {
         ev->events[i].mask = EV_NONE;
     }
 
+    ev->num_fds = num_fds;
     return 0;
 }
 
 int ev_add_event(ev* ev, int fd, int mask, ev_file_fn* fn, void* client_data) {
     ev_file_event* e;
     if (fd >= ev->num_fds) {
-        return -1;
+        int num_fds = ev->num_fds > 0 ? ev->num_fds : 1;
+        while (num_fds <= fd) {
+            num_fds <<= 1;
+        }
+        if (ev_resize_num_fds(ev, num_fds) == -1) {
+            return -1;
+        }
     }
 
     e = &(ev->events[fd]);
 
-    if (ev_api_add_event(ev, fd, mask) == -1) {
+    if (ev_backend_add_event(ev, fd, mask) == -1) {
         return -1;
     }
 
@@ -130,7 +209,7 @@ void ev_delete_event(ev* ev, int fd, int mask) {
         mask |= EV_BOTH;
     }
 
-    ev_api_del_event(ev, fd, mask);
+    ev_backend_del_event(ev, fd, mask);
     e->mask = e->mask & (~mask);
 
     if (fd == ev->max_fd && e->mask == EV_NONE) {
@@ -143,18 +222,247 @@ void ev_delete_event(ev* ev, int fd, int mask) {
         ev->max_fd = i;
     }
 
-    ev_api_del_event(ev, fd, mask);
+    ev_backend_del_event(ev, fd, mask);
+}
+
+/* fn runs once per loop iteration, right before blocking in poll. It lets
+ * the caller finish work batched up by the previous round of events */
+void ev_set_before_poll(ev* ev, ev_before_poll_fn* fn, void* data) {
+    ev->before_poll = fn;
+    ev->before_poll_data = data;
+}
+
+static long long ev_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((long long)ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+#define ev_timer_slot_of(id) ((size_t)((id) & UINT32_MAX))
+
+/* puts timer at i in the heap and tells its slot */
+static void ev_timer_place(ev* ev, size_t i, ev_timer timer) {
+    ev->timers[i] = timer;
+    ev->timer_slots[ev_timer_slot_of(timer.id)].pos = i;
+}
+
+static void ev_timer_swap(ev* ev, size_t a, size_t b) {
+    ev_timer tmp = ev->timers[a];
+    ev_timer_place(ev, a, ev->timers[b]);
+    ev_timer_place(ev, b, tmp);
 }
 
+static void ev_timer_sift_up(ev* ev, size_t i) {
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (ev->timers[parent].when <= ev->timers[i].when) {
+            break;
+        }
+        ev_timer_swap(ev, parent, i);
+        i = parent;
+    }
+}
+
+static void ev_timer_sift_down(ev* ev, size_t i) {
+    for (;;) {
+        size_t left = i * 2 + 1, right = left + 1, min = i;
+        if (left < ev->num_timers &&
+            ev->timers[left].when < ev->timers[min].when) {
+            min = left;
+        }
+        if (right < ev->num_timers &&
+            ev->timers[right].when < ev->timers[min].when) {
+            min = right;
+        }
+        if (min == i) {
+            break;
+        }
+        ev_timer_swap(ev, min, i);
+        i = min;
+    }
+}
+
+/* takes a free slot for a new timer and returns its id, or -1 if the slots
+ * could not grow */
+static long long ev_timer_slot_take(ev* ev) {
+    size_t slot = ev->free_timer_slot;
+    if (slot == ev->num_timer_slots) {
+        size_t new_num = ev->num_timer_slots ? ev->num_timer_slots << 1
+                                             : EV_TIMERS_INITIAL_CAP;
+        size_t i;
+        void* tmp;
+        if (new_num > UINT32_MAX) {
+            return -1;
+        }
+        tmp = realloc(ev->timer_slots, sizeof(ev_timer_slot) * new_num);
+        if (tmp == NULL) {
+            return -1;
+        }
+        ev->timer_slots = tmp;
+        for (i = ev->num_timer_slots; i < new_num; ++i) {
+            ev->timer_slots[i].pos = i + 1;
+            ev->timer_slots[i].gen = 0;
+        }
+        ev->num_timer_slots = new_num;
+    }
+    ev->free_timer_slot = ev->timer_slots[slot].pos;
+    /* ids stay positive, -1 is the error */
+    return (((long long)(ev->timer_slots[slot].gen & INT32_MAX)) << 32) |
+           (long long)slot;
+}
+
+static void ev_timer_slot_free(ev* ev, long long id) {
+    size_t slot = ev_timer_slot_of(id);
+    ev->timer_slots[slot].gen++;
+    ev->timer_slots[slot].pos = ev->free_timer_slot;
+    ev->free_timer_slot = slot;
+}
+
+static int ev_timer_push(ev* ev, ev_timer timer) {
+    if (ev->num_timers == ev->timers_cap) {
+        size_t new_cap =
+            ev->timers_cap ? ev->timers_cap << 1 : EV_TIMERS_INITIAL_CAP;
+        void* tmp = realloc(ev->timers, sizeof(ev_timer) * new_cap);
+        if (tmp == NULL) {
+            return -1;
+        }
+        ev->timers = tmp;
+        ev->timers_cap = new_cap;
+    }
+    ev_timer_place(ev, ev->num_timers, timer);
+    ev->num_timers++;
+    ev_timer_sift_up(ev, ev->num_timers - 1);
+    return 0;
+}
+
+/* takes the timer at i out of the heap, its slot stays taken */
+static void ev_timer_remove_at(ev* ev, size_t i) {
+    ev->num_timers--;
+    if (i == ev->num_timers) {
+        return;
+    }
+    ev_timer_place(ev, i, ev->timers[ev->num_timers]);
+    ev_timer_sift_up(ev, i);
+    ev_timer_sift_down(ev, i);
+}
+
+/* fn first runs ms milliseconds from now, and then again after however many
+ * milliseconds it returns. returns the id of the timer, or -1 on failure */
+long long ev_add_timer(ev* ev, long long ms, ev_timer_fn* fn, void* data) {
+    ev_timer timer;
+    timer.id = ev_timer_slot_take(ev);
+    if (timer.id == -1) {
+        return -1;
+    }
+    timer.when = ev_now_ms() + ms;
+    timer.fn = fn;
+    timer.data = data;
+    if (ev_timer_push(ev, timer) == -1) {
+        ev_timer_slot_free(ev, timer.id);
+        return -1;
+    }
+    return timer.id;
+}
+
+/* every blocked client with a timeout has a timer, and they are deleted as
+ * the clients are woken, so the timer is found through its slot */
+int ev_del_timer(ev* ev, long long id) {
+    size_t slot = ev_timer_slot_of(id), pos;
+    if (id < 0) {
+        return -1;
+    }
+    if (id == ev->running_timer) {
+        ev->running_deleted = 1;
+        return 0;
+    }
+    if (slot >= ev->num_timer_slots) {
+        return -1;
+    }
+    /* a free slot, or one reused since, holds no timer with this id */
+    pos = ev->timer_slots[slot].pos;
+    if (pos >= ev->num_timers || ev->timers[pos].id != id) {
+        return -1;
+    }
+    ev_timer_remove_at(ev, pos);
+    ev_timer_slot_free(ev, id);
+    return 0;
+}
+
+/* the milliseconds until the nearest timer is due, 0 if one already is, or
+ * -1 if there are no timers */
+long long ev_next_timeout(ev* ev) {
+    long long ms;
+    if (ev->num_timers == 0) {
+        return -1;
+    }
+    ms = ev->timers[0].when - ev_now_ms();
+    return ms < 0 ? 0 : ms;
+}
+
+/* runs every timer that is due. A timer that is rescheduled to a time that
+ * has already passed waits for the next call, so a timer returning 0 can not
+ * keep the loop from polling */
+static int ev_process_timers(ev* ev) {
+    long long now = ev_now_ms();
+    int processed = 0;
+
+    while (ev->num_timers > 0 && ev->timers[0].when <= now) {
+        ev_timer timer = ev->timers[0];
+        long long next;
+
+        ev_timer_remove_at(ev, 0);
+
+        ev->running_timer = timer.id;
+        ev->running_deleted = 0;
+        next = timer.fn(ev, timer.id, timer.data);
+        ev->running_timer = -1;
+        processed++;
+
+        if (next == EV_TIMER_NOMORE || ev->running_deleted) {
+            ev_timer_slot_free(ev, timer.id);
+            continue;
+        }
+
+        timer.when = ev_now_ms() + next;
+        if (timer.when <= now) {
+            timer.when = now + 1;
+        }
+        if (ev_timer_push(ev, timer) == -1) {
+            ev_timer_slot_free(ev, timer.id);
+        }
+    }
+
+    return processed;
+}
+
+/* returns the number of events and timers handled, or -1 once there is
+ * nothing left to wait for or the poll was interrupted */
 static int ev_process_events(ev* ev) {
     int num_events, processed = 0;
-    struct timeval* tv = NULL;
+    struct timeval tv;
+    struct timeval* tvp = NULL;
     int i;
 
-    if (ev->max_fd == -1) {
-        return processed;
+    if (ev->max_fd == -1 && ev->num_timers == 0) {
+        return -1;
     }
-    num_events = ev_api_poll(ev, tv);
+
+    if (ev->before_poll) {
+        ev->before_poll(ev, ev->before_poll_data);
+    }
+
+    if (ev->num_timers > 0) {
+        long long ms = ev_next_timeout(ev);
+        tv.tv_sec = ms / 1000;
+        tv.tv_usec = (ms % 1000) * 1000;
+        tvp = &tv;
+    }
+
+    num_events = ev_backend_poll(ev, tvp);
+    if (num_events == -1) {
+        return -1;
+    }
+
     for (i = 0; i < num_events; ++i) {
         int fd = ev->fired[i].fd;
         int mask = ev->fired[i].mask;
@@ -186,23 +494,42 @@ static int ev_process_events(ev* ev) {
 
         processed++;
     }
+
+    processed += ev_process_timers(ev);
     return processed;
 }
 
 void ev_await(ev* ev) {
-    for (;;) {
-        int num_processed = ev_process_events(ev);
-        if (num_processed == 0) {
+    ev->stop = 0;
+    while (!ev->stop) {
+        if (ev_process_events(ev) == -1) {
             break;
         }
     }
 }
 
+/* makes ev_await return once the events currently being handled are done.
+ * Must be called from the thread running ev_await */
+void ev_stop(ev* ev) { ev->stop = 1; }
+
 void ev_free(ev* ev) {
-    ev_api_free(ev);
+    ev_backend_free(ev);
+    free(ev->timers);
+    free(ev->timer_slots);
     free(ev->fired);
     free(ev->events);
     free(ev);
 }
 
-const char* ev_api_name(void) { return api_name(); }
+/* the backend ev_new settled on, which is not io_uring if setting it up
+ * failed even though the kernel has it */
+const char* ev_api_name(ev* ev) {
+#if HAVE_IO_URING
+    if (ev->uring) {
+        return ev_uring_api_name();
+    }
+#else
+    ev_unused(ev);
+#endif
+    return api_name();
+}
@@ -2,17 +2,31 @@
 
 #define __EV_H__
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define EV_NONE 0
 #define EV_READ 1
 #define EV_WRITE 2
 #define EV_BOTH 4
 
+#define EV_TIMER_NOMORE -1
+
+/* options for ev_new */
+#define EV_OPT_URING 1 /* use io_uring, when the kernel lets us have it */
+
 #define ev_unused(v) ((void)v)
 
 struct ev;
 
 typedef void ev_file_fn(struct ev* ev, int fd, void* client_data, int mask);
 
+typedef void ev_before_poll_fn(struct ev* ev, void* data);
+
+/* returns the number of milliseconds until the timer should fire again, or
+ * EV_TIMER_NOMORE to delete it */
+typedef long long ev_timer_fn(struct ev* ev, long long id, void* data);
+
 typedef struct {
     int mask;
     ev_file_fn* read_fn;
@@ -25,21 +39,53 @@ typedef struct {
     int mask;
 } ev_fired_event;
 
+typedef struct {
+    long long id;   /* the generation of its slot, then the slot */
+    long long when; /* monotonic time in milliseconds */
+    ev_timer_fn* fn;
+    void* data;
+} ev_timer;
+
+/* where a timer is, so it can be found by id. A slot is reused once its
+ * timer is gone, with a new generation so the old id no longer matches */
+typedef struct {
+    size_t pos;   /* the timer's index in timers, or once the slot is free,
+                     the next free slot */
+    uint32_t gen; /* bumped every time the slot is freed */
+} ev_timer_slot;
+
 typedef struct ev {
     int max_fd;
     int num_fds;
     ev_file_event* events;
     ev_fired_event* fired;
+    ev_before_poll_fn* before_poll;
+    void* before_poll_data;
+    ev_timer* timers;        /* a min-heap ordered by when */
+    size_t num_timers;
+    size_t timers_cap;
+    ev_timer_slot* timer_slots; /* indexed by the low 32 bits of an id */
+    size_t num_timer_slots;
+    size_t free_timer_slot; /* the first free slot, or num_timer_slots */
+    long long running_timer; /* the id of the timer being run, or -1 */
+    int running_deleted;     /* set if the running timer deleted itself */
+    int stop;
+    int uring; /* set when io_uring is the backend */
     void* api;
 } ev;
 
-ev* ev_new(int num_fds);
+ev* ev_new(int num_fds, int opts);
 int ev_get_num_fds(ev* ev);
 int ev_resize_num_fds(ev* ev, int num_fds);
 int ev_add_event(ev* ev, int fd, int mask, ev_file_fn* fn, void* client_data);
 void ev_delete_event(ev* ev, int fd, int mask);
+void ev_set_before_poll(ev* ev, ev_before_poll_fn* fn, void* data);
+long long ev_add_timer(ev* ev, long long ms, ev_timer_fn* fn, void* data);
+int ev_del_timer(ev* ev, long long id);
+long long ev_next_timeout(ev* ev);
 void ev_await(ev* ev);
+void ev_stop(ev* ev);
 void ev_free(ev* ev);
-const char* ev_api_name(void);
+const char* ev_api_name(ev* ev);
 
 #endif /* __EV_H__ */
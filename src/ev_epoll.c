@@ -16,7 +16,7 @@ static int ev_api_new(ev* ev) {
     if (state == NULL) {
         return -1;
     }
-    state->events = calloc(ev->num_fds, sizeof(ev_api));
+    state->events = calloc(ev->num_fds, sizeof(struct epoll_event));
     if (state->events == NULL) {
         free(state);
         return -1;
@@ -113,8 +113,11 @@ static int ev_api_poll(ev* ev, struct timeval* tvp) {
             ev->fired[j].fd = e->data.fd;
             ev->fired[j].mask = mask;
         }
-    } else if (retval == -1 && errno != EINTR) {
-        fprintf(stderr, "epoll_wait: %s", strerror(errno));
+    } else if (retval == -1) {
+        if (errno != EINTR) {
+            fprintf(stderr, "epoll_wait: %s", strerror(errno));
+        }
+        return -1;
     }
     return num_events;
 }
@@ -84,8 +84,11 @@ static int ev_api_poll(ev* ev, struct timeval* tvp) {
             ev->fired[numevents].mask = mask;
             numevents++;
         }
-    } else if (retval == -1 && errno != EINTR) {
-        fprintf(stderr, "ev_api_poll: select, %s", strerror(errno));
+    } else if (retval == -1) {
+        if (errno != EINTR) {
+            fprintf(stderr, "ev_api_poll: select, %s", strerror(errno));
+        }
+        return -1;
     }
 
     return numevents;
@@ -0,0 +1,447 @@
+#include "ev.h"
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* readiness on top of io_uring. Every registered fd has one single-shot
+ * IORING_OP_POLL_ADD in flight. When it completes the fd is reported like
+ * epoll would report it and re-armed on the next call to poll, so the
+ * semantics stay level triggered. All of the (re)arming and cancelling done
+ * during a loop iteration is submitted by the same io_uring_enter that waits
+ * for the next completions, which replaces epoll_ctl + epoll_wait with a
+ * single syscall */
+
+#define EV_URING_ENTRIES 1024
+#define EV_URING_REMOVE_DATA UINT64_MAX
+
+typedef struct {
+    int ring_fd;
+    unsigned sq_entries;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;
+    size_t sq_ring_len;
+    void* cq_ring;
+    size_t cq_ring_len;
+    size_t sqes_len;
+    int* armed;        /* per fd, the mask of the poll in flight */
+    uint32_t* gen;     /* per fd, bumped when its poll is cancelled */
+    int* dirty;        /* fds whose poll has to be (re)armed */
+    uint8_t* is_dirty; /* per fd, whether it is in dirty */
+    int num_dirty;
+} ev_uring;
+
+/* -1 until probed, then whether io_uring can be used */
+static int ev_uring_usable = -1;
+
+static int ev_uring_setup(unsigned entries, struct io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int ev_uring_enter(int ring_fd, unsigned to_submit,
+                          unsigned min_complete, unsigned flags, void* arg,
+                          size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                        flags, arg, argsz);
+}
+
+/* the header being present says nothing about the running kernel, and
+ * seccomp filters commonly block io_uring in containers */
+static int ev_uring_supported(void) {
+    struct io_uring_params p;
+    int ring_fd;
+
+    if (ev_uring_usable != -1) {
+        return ev_uring_usable;
+    }
+
+    memset(&p, 0, sizeof p);
+    ring_fd = ev_uring_setup(2, &p);
+    if (ring_fd == -1) {
+        ev_uring_usable = 0;
+        return ev_uring_usable;
+    }
+    close(ring_fd);
+
+    /* EXT_ARG for timeouts without an extra sqe, NODROP so a burst of
+     * completions can never be lost */
+    ev_uring_usable = (p.features & IORING_FEAT_EXT_ARG) &&
+                      (p.features & IORING_FEAT_NODROP);
+    return ev_uring_usable;
+}
+
+static void ev_uring_unmap(ev_uring* state) {
+    if (state->sqes != NULL && state->sqes != MAP_FAILED) {
+        munmap(state->sqes, state->sqes_len);
+    }
+    if (state->cq_ring != NULL && state->cq_ring != MAP_FAILED &&
+        state->cq_ring != state->sq_ring) {
+        munmap(state->cq_ring, state->cq_ring_len);
+    }
+    if (state->sq_ring != NULL && state->sq_ring != MAP_FAILED) {
+        munmap(state->sq_ring, state->sq_ring_len);
+    }
+}
+
+static void ev_uring_api_free(ev* ev) {
+    ev_uring* state = ev->api;
+    ev_uring_unmap(state);
+    close(state->ring_fd);
+    free(state->armed);
+    free(state->gen);
+    free(state->dirty);
+    free(state->is_dirty);
+    free(state);
+}
+
+static int ev_uring_api_new(ev* ev) {
+    ev_uring* state;
+    struct io_uring_params p;
+    char* sq;
+    char* cq;
+
+    state = calloc(1, sizeof *state);
+    if (state == NULL) {
+        return -1;
+    }
+
+    memset(&p, 0, sizeof p);
+    p.flags = IORING_SETUP_CLAMP;
+    state->ring_fd = ev_uring_setup(EV_URING_ENTRIES, &p);
+    if (state->ring_fd == -1) {
+        free(state);
+        ev_uring_usable = 0;
+        return -1;
+    }
+    ev->api = state;
+
+    state->sq_entries = p.sq_entries;
+    state->sq_ring_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    state->cq_ring_len =
+        p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (state->cq_ring_len > state->sq_ring_len) {
+            state->sq_ring_len = state->cq_ring_len;
+        }
+        state->cq_ring_len = state->sq_ring_len;
+    }
+
+    state->sq_ring = mmap(NULL, state->sq_ring_len, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, state->ring_fd, IORING_OFF_SQ_RING);
+    if (state->sq_ring == MAP_FAILED) {
+        goto err;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        state->cq_ring = state->sq_ring;
+    } else {
+        state->cq_ring =
+            mmap(NULL, state->cq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+                 state->ring_fd, IORING_OFF_CQ_RING);
+        if (state->cq_ring == MAP_FAILED) {
+            goto err;
+        }
+    }
+
+    state->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    state->sqes = mmap(NULL, state->sqes_len, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, state->ring_fd, IORING_OFF_SQES);
+    if (state->sqes == MAP_FAILED) {
+        goto err;
+    }
+
+    sq = state->sq_ring;
+    state->sq_head = (unsigned*)(sq + p.sq_off.head);
+    state->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    state->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    state->sq_array = (unsigned*)(sq + p.sq_off.array);
+
+    cq = state->cq_ring;
+    state->cq_head = (unsigned*)(cq + p.cq_off.head);
+    state->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    state->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    state->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+    state->armed = calloc(ev->num_fds, sizeof(int));
+    state->gen = calloc(ev->num_fds, sizeof(uint32_t));
+    state->dirty = calloc(ev->num_fds, sizeof(int));
+    state->is_dirty = calloc(ev->num_fds, sizeof(uint8_t));
+    if (state->armed == NULL || state->gen == NULL || state->dirty == NULL ||
+        state->is_dirty == NULL) {
+        goto err;
+    }
+
+    return 0;
+
+err:
+    ev_uring_api_free(ev);
+    ev->api = NULL;
+    return -1;
+}
+
+static int ev_uring_api_resize(ev* ev, int setsize) {
+    ev_uring* state = ev->api;
+    int old_size = ev->num_fds;
+    void* tmp;
+
+    if (setsize <= old_size) {
+        return 0;
+    }
+
+    tmp = realloc(state->armed, setsize * sizeof(int));
+    if (tmp == NULL) {
+        return -1;
+    }
+    state->armed = tmp;
+    memset(state->armed + old_size, 0, (setsize - old_size) * sizeof(int));
+
+    tmp = realloc(state->gen, setsize * sizeof(uint32_t));
+    if (tmp == NULL) {
+        return -1;
+    }
+    state->gen = tmp;
+    memset(state->gen + old_size, 0, (setsize - old_size) * sizeof(uint32_t));
+
+    tmp = realloc(state->dirty, setsize * sizeof(int));
+    if (tmp == NULL) {
+        return -1;
+    }
+    state->dirty = tmp;
+
+    tmp = realloc(state->is_dirty, setsize * sizeof(uint8_t));
+    if (tmp == NULL) {
+        return -1;
+    }
+    state->is_dirty = tmp;
+    memset(state->is_dirty + old_size, 0, setsize - old_size);
+
+    return 0;
+}
+
+/* hands every queued sqe to the kernel without waiting */
+static int ev_uring_submit(ev_uring* state) {
+    unsigned to_submit =
+        *state->sq_tail - __atomic_load_n(state->sq_head, __ATOMIC_ACQUIRE);
+    if (to_submit == 0) {
+        return 0;
+    }
+    if (ev_uring_enter(state->ring_fd, to_submit, 0, 0, NULL, 0) == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+static struct io_uring_sqe* ev_uring_get_sqe(ev_uring* state) {
+    unsigned head = __atomic_load_n(state->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *state->sq_tail;
+    unsigned idx;
+    struct io_uring_sqe* sqe;
+
+    if (tail - head >= state->sq_entries) {
+        if (ev_uring_submit(state) == -1) {
+            return NULL;
+        }
+        head = __atomic_load_n(state->sq_head, __ATOMIC_ACQUIRE);
+        if (tail - head >= state->sq_entries) {
+            return NULL;
+        }
+    }
+
+    idx = tail & *state->sq_mask;
+    sqe = &(state->sqes[idx]);
+    memset(sqe, 0, sizeof *sqe);
+    state->sq_array[idx] = idx;
+    __atomic_store_n(state->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+static uint64_t ev_uring_user_data(ev_uring* state, int fd) {
+    return (((uint64_t)state->gen[fd]) << 32) | (uint32_t)fd;
+}
+
+static void ev_uring_mark_dirty(ev_uring* state, int fd) {
+    if (state->is_dirty[fd]) {
+        return;
+    }
+    state->is_dirty[fd] = 1;
+    state->dirty[state->num_dirty++] = fd;
+}
+
+/* returns -1 if there was no room for the sqe, and the fd has to be armed
+ * again later */
+static int ev_uring_arm(ev* ev, ev_uring* state, int fd) {
+    int mask = ev->events[fd].mask & (EV_READ | EV_WRITE);
+    struct io_uring_sqe* sqe;
+
+    if (mask == EV_NONE || state->armed[fd] != EV_NONE) {
+        return 0;
+    }
+
+    sqe = ev_uring_get_sqe(state);
+    if (sqe == NULL) {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    if (mask & EV_READ) {
+        sqe->poll32_events |= POLLIN;
+    }
+    if (mask & EV_WRITE) {
+        sqe->poll32_events |= POLLOUT;
+    }
+    sqe->user_data = ev_uring_user_data(state, fd);
+    state->armed[fd] = mask;
+    return 0;
+}
+
+/* a completion for the old poll may still be on its way, bumping the
+ * generation makes sure it is ignored */
+static void ev_uring_cancel(ev_uring* state, int fd) {
+    struct io_uring_sqe* sqe;
+
+    if (state->armed[fd] == EV_NONE) {
+        return;
+    }
+
+    sqe = ev_uring_get_sqe(state);
+    if (sqe != NULL) {
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->addr = ev_uring_user_data(state, fd);
+        sqe->user_data = EV_URING_REMOVE_DATA;
+    }
+
+    state->gen[fd]++;
+    state->armed[fd] = EV_NONE;
+}
+
+static int ev_uring_api_add_event(ev* ev, int fd, int mask) {
+    ev_uring* state = ev->api;
+    int want = (ev->events[fd].mask | mask) & (EV_READ | EV_WRITE);
+
+    if ((state->armed[fd] & want) == want) {
+        return 0;
+    }
+
+    ev_uring_cancel(state, fd);
+    ev_uring_mark_dirty(state, fd);
+    return 0;
+}
+
+static void ev_uring_api_del_event(ev* ev, int fd, int delmask) {
+    ev_uring* state = ev->api;
+    int want = ev->events[fd].mask & (~delmask) & (EV_READ | EV_WRITE);
+
+    if ((state->armed[fd] & (~want)) == EV_NONE) {
+        return;
+    }
+
+    ev_uring_cancel(state, fd);
+    if (want != EV_NONE) {
+        ev_uring_mark_dirty(state, fd);
+    }
+}
+
+static int ev_uring_api_poll(ev* ev, struct timeval* tvp) {
+    ev_uring* state = ev->api;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned head, tail, to_submit;
+    int i, num_dirty, retval, num_events = 0;
+
+    /* an fd that could not be armed stays dirty, or it would never get
+     * another event */
+    num_dirty = state->num_dirty;
+    state->num_dirty = 0;
+    for (i = 0; i < num_dirty; ++i) {
+        int fd = state->dirty[i];
+        if (ev_uring_arm(ev, state, fd) == -1) {
+            state->dirty[state->num_dirty++] = fd;
+            continue;
+        }
+        state->is_dirty[fd] = 0;
+    }
+
+    memset(&arg, 0, sizeof arg);
+    if (state->num_dirty != 0) {
+        /* come straight back to retry them once the queue has drained */
+        ts.tv_sec = 0;
+        ts.tv_nsec = 0;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    } else if (tvp) {
+        ts.tv_sec = tvp->tv_sec;
+        ts.tv_nsec = tvp->tv_usec * 1000;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+
+    to_submit =
+        *state->sq_tail - __atomic_load_n(state->sq_head, __ATOMIC_ACQUIRE);
+    retval = ev_uring_enter(state->ring_fd, to_submit, 1,
+                            IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                            &arg, sizeof arg);
+    if (retval == -1) {
+        if (errno == EINTR) {
+            /* the same as epoll_wait being interrupted */
+            return -1;
+        }
+        if (errno != ETIME) {
+            fprintf(stderr, "io_uring_enter: %s", strerror(errno));
+        }
+    }
+
+    head = *state->cq_head;
+    tail = __atomic_load_n(state->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail && num_events < ev->num_fds) {
+        struct io_uring_cqe* cqe = &(state->cqes[head & *state->cq_mask]);
+        uint64_t user_data = cqe->user_data;
+        int fd = (int)(uint32_t)user_data;
+        int res = cqe->res;
+        int mask = 0;
+        head++;
+
+        if (user_data == EV_URING_REMOVE_DATA || fd >= ev->num_fds ||
+            (uint32_t)(user_data >> 32) != state->gen[fd]) {
+            continue;
+        }
+
+        state->armed[fd] = EV_NONE;
+        ev_uring_mark_dirty(state, fd);
+
+        if (res < 0) {
+            mask |= (EV_READ | EV_WRITE);
+        } else {
+            if (res & POLLIN) {
+                mask |= EV_READ;
+            }
+            if (res & POLLOUT) {
+                mask |= EV_WRITE;
+            }
+            if (res & (POLLERR | POLLHUP)) {
+                mask |= (EV_READ | EV_WRITE);
+            }
+        }
+
+        ev->fired[num_events].fd = fd;
+        ev->fired[num_events].mask = mask;
+        num_events++;
+    }
+    __atomic_store_n(state->cq_head, head, __ATOMIC_RELEASE);
+
+    return num_events;
+}
+
+static const char* ev_uring_api_name(void) { return "io_uring"; }
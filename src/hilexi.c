@@ -1,9 +1,13 @@
 #include "hilexi.h"
+#include "bin_parser.h"
 #include "builder.h"
 #include "networking.h"
 #include "parser.h"
+#include "proto.h"
 #include "result.h"
+#include "shm_ring.h"
 #include <errno.h>
+#include <poll.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,24 +16,75 @@
 
 #define READ_BUF_INITIAL_CAP 4096
 
+static result(object) hilexi_block(hilexi* l, const char* name,
+                                   size_t name_len, int64_t timeout);
+static int hilexi_hello(hilexi* l, int proto);
 static object hilexi_parse(hilexi* l);
+static ssize_t hilexi_feed(hilexi* l);
 static ssize_t hilexi_read(hilexi* l);
 static ssize_t hilexi_write(hilexi* l);
+static ssize_t hilexi_read_shm(hilexi* l);
+static int hilexi_wait_readable(hilexi* l);
+static ssize_t hilexi_write_shm(hilexi* l);
+static int hilexi_shm_wait(hilexi* l);
 static int realloc_read_buf(hilexi* l);
+static result(hilexi) hilexi_new_from_socket(hilexi l, int sfd);
 
 result(hilexi) hilexi_new(const char* addr, uint16_t port) {
-    result(hilexi) rl = {0};
     hilexi l = {0};
-    int sfd;
-
     l.addr = parse_addr(addr);
     l.port = port;
+    l.path = vstr_new();
+    return hilexi_new_from_socket(l, create_tcp_socket(1));
+}
+
+/* connects over a unix socket instead, for clients on the same host */
+result(hilexi) hilexi_new_unix(const char* path) {
+    hilexi l = {0};
+    l.path = vstr_from(path);
+    return hilexi_new_from_socket(l, create_unix_socket(1));
+}
+
+/* connects over the server's unix socket, then hands it a shared memory
+ * region and uses that for every request from then on */
+result(hilexi) hilexi_new_shm(const char* path) {
+    result(hilexi) rl = hilexi_new_unix(path);
+    shm_ring* shm;
+
+    if (rl.type == Err) {
+        return rl;
+    }
+
+    shm = malloc(sizeof *shm);
+    if (shm == NULL) {
+        hilexi_close(&(rl.data.ok));
+        rl.type = Err;
+        rl.data.err = vstr_format("failed to allocate shared memory ring");
+        return rl;
+    }
+
+    if (shm_ring_create(shm, SHM_RING_DEFAULT_CAP) == -1) {
+        int err = errno;
+        free(shm);
+        hilexi_close(&(rl.data.ok));
+        rl.type = Err;
+        rl.data.err = vstr_format(
+            "failed to create shared memory (errno %d) %s", err, strerror(err));
+        return rl;
+    }
+
+    rl.data.ok.shm = shm;
+    return rl;
+}
+
+static result(hilexi) hilexi_new_from_socket(hilexi l, int sfd) {
+    result(hilexi) rl = {0};
 
-    sfd = create_tcp_socket(1);
     if (sfd == -1) {
         rl.type = Err;
         rl.data.err = vstr_format("failed to make socket (errno %d) %s", errno,
                                   strerror(errno));
+        vstr_free(&l.path);
         return rl;
     }
 
@@ -39,12 +94,14 @@ result(hilexi) hilexi_new(const char* addr, uint16_t port) {
     if (l.read_buf == NULL) {
         rl.type = Err;
         rl.data.err = vstr_format("failed to allocate read buffer");
+        vstr_free(&l.path);
         close(sfd);
         return rl;
     }
 
     l.read_pos = 0;
     l.read_cap = READ_BUF_INITIAL_CAP;
+    l.parser = frame_parser_new();
 
     l.builder = builder_new();
 
@@ -56,18 +113,31 @@ result(hilexi) hilexi_new(const char* addr, uint16_t port) {
 
 int hilexi_connect(hilexi* l) {
     int res;
-    while (1) {
-        res = tcp_connect(l->sfd, l->addr, l->port);
-        if (res == 0) {
-            break;
-        } else if (res == -1) {
-            if (errno == EINPROGRESS) {
-                continue;
-            } else {
+    if (vstr_len(&l->path) != 0) {
+        /* a full backlog is the only way this can be in progress */
+        do {
+            res = unix_connect(l->sfd, vstr_data(&l->path));
+        } while (res == -1 && errno == EAGAIN);
+        if (res == 0 && l->shm != NULL) {
+            res = unix_send_fds(l->sfd, l->shm->fds, SHM_RING_NUM_FDS);
+        }
+    } else {
+        while (1) {
+            res = tcp_connect(l->sfd, l->addr, l->port);
+            if (res == 0) {
                 break;
+            } else if (res == -1) {
+                if (errno == EINPROGRESS) {
+                    continue;
+                } else {
+                    break;
+                }
             }
         }
     }
+    if (res == 0 && (l->flags & HILEXI_BINARY)) {
+        res = hilexi_hello(l, PROTO_BIN);
+    }
     return res;
 }
 
@@ -481,6 +551,16 @@ result(object) hilexi_deque(hilexi* l) {
     return res;
 }
 
+/* the reply only comes once there is something to pop, or the timeout
+ * passes */
+result(object) hilexi_bpop(hilexi* l, int64_t timeout) {
+    return hilexi_block(l, "BPOP", 4, timeout);
+}
+
+result(object) hilexi_bdeque(hilexi* l, int64_t timeout) {
+    return hilexi_block(l, "BDEQUE", 6, timeout);
+}
+
 result(object) hilexi_zset(hilexi* l, object* value) {
     result(object) res = {0};
     object obj;
@@ -602,10 +682,84 @@ void hilexi_close(hilexi* l) {
     free(l->read_buf);
     close(l->sfd);
     builder_free(&(l->builder));
+    vstr_free(&(l->path));
+    if (l->shm != NULL) {
+        shm_ring_free(l->shm);
+        free(l->shm);
+    }
+}
+
+static result(object) hilexi_block(hilexi* l, const char* name,
+                                   size_t name_len, int64_t timeout) {
+    result(object) res = {0};
+    object obj;
+    int add = builder_add_array(&l->builder, 2);
+    if (add == -1) {
+        res.type = Err;
+        res.data.err = vstr_from("failed to add array to builder");
+        return res;
+    }
+    add = builder_add_string(&l->builder, name, name_len);
+    if (add == -1) {
+        res.type = Err;
+        res.data.err = vstr_format("failed to add %s to builder", name);
+        return res;
+    }
+    add = builder_add_int(&l->builder, timeout);
+    if (add == -1) {
+        res.type = Err;
+        res.data.err = vstr_from("failed to add timeout to builder");
+        return res;
+    }
+    if (hilexi_write(l) == -1) {
+        res.type = Err;
+        res.data.err = vstr_format("failed to write to server (errno %d) %s",
+                                   errno, strerror(errno));
+        return res;
+    }
+    if (hilexi_read(l) == -1) {
+        res.type = Err;
+        res.data.err = vstr_format("failed to read from server (errno %d) %s",
+                                   errno, strerror(errno));
+        return res;
+    }
+    obj = hilexi_parse(l);
+    res.type = Ok;
+    res.data.ok = obj;
+    return res;
+}
+
+/* asks the server to speak proto, and switches to it once the server agrees.
+ * The reply still comes in the old protocol */
+static int hilexi_hello(hilexi* l, int proto) {
+    object obj;
+    int res = -1;
+    if (builder_add_array(&l->builder, 2) == -1 ||
+        builder_add_string(&l->builder, "HELLO", 5) == -1 ||
+        builder_add_int(&l->builder, proto) == -1) {
+        builder_reset(&l->builder);
+        return -1;
+    }
+    if (hilexi_write(l) == -1) {
+        return -1;
+    }
+    if (hilexi_read(l) <= 0) {
+        return -1;
+    }
+    obj = hilexi_parse(l);
+    if (obj.type == String && vstr_len(&obj.data.string) == 2 &&
+        memcmp(vstr_data(&obj.data.string), "OK", 2) == 0) {
+        builder_set_proto(&l->builder, proto);
+        res = 0;
+    }
+    object_free(&obj);
+    return res;
 }
 
 static object hilexi_parse(hilexi* l) {
-    object obj = parse_from_server(l->read_buf, l->read_pos);
+    object obj = l->builder.proto == PROTO_BIN
+                     ? bin_parse_from_server(l->read_buf, l->read_pos)
+                     : parse_from_server(l->read_buf, l->read_pos);
     memset(l->read_buf, 0, l->read_pos);
     l->read_pos = 0;
     return obj;
@@ -613,8 +767,11 @@ static object hilexi_parse(hilexi* l) {
 
 static ssize_t hilexi_read(hilexi* l) {
     ssize_t amt_read;
-    int received_data = 0;
+    if (l->shm != NULL) {
+        return hilexi_read_shm(l);
+    }
     for (;;) {
+        ssize_t frame_len;
         if (l->read_pos == l->read_cap) {
             if (realloc_read_buf(l) == -1) {
                 return -1;
@@ -627,25 +784,62 @@ static ssize_t hilexi_read(hilexi* l) {
         }
         if (amt_read == -1) {
             if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
-                if (received_data) {
-                    break;
-                } else {
-                    continue;
+                if (hilexi_wait_readable(l) == -1) {
+                    return -1;
                 }
+                continue;
+            }
+            if (errno == EINTR) {
+                continue;
             }
             return -1;
         }
-        received_data = 1;
         l->read_pos += amt_read;
+        frame_len = hilexi_feed(l);
+        if (frame_len == -1) {
+            l->parser = frame_parser_new();
+            return -1;
+        }
+        if (frame_len > 0) {
+            break;
+        }
     }
 
     return l->read_pos;
 }
 
+/* blocks until the socket has something to read. returns -1 on error */
+static int hilexi_wait_readable(hilexi* l) {
+    struct pollfd pfd;
+    pfd.fd = l->sfd;
+    pfd.events = POLLIN;
+    for (;;) {
+        int res = poll(&pfd, 1, -1);
+        if (res == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        return 0;
+    }
+}
+
+/* replies come in the protocol requests are built in */
+static ssize_t hilexi_feed(hilexi* l) {
+    if (l->builder.proto == PROTO_BIN) {
+        return bin_frame_parser_feed(&l->parser, l->read_buf, l->read_pos);
+    }
+    return frame_parser_feed(&l->parser, l->read_buf, l->read_pos);
+}
+
 static ssize_t hilexi_write(hilexi* l) {
     const uint8_t* write_buf = builder_out(&(l->builder));
     size_t write_size = builder_len(&(l->builder));
     ssize_t amount_written = 0;
+    if (l->shm != NULL) {
+        return hilexi_write_shm(l);
+    }
     while (amount_written < write_size) {
         ssize_t amt = write(l->sfd, write_buf + amount_written,
                             write_size - amount_written);
@@ -659,6 +853,87 @@ static ssize_t hilexi_write(hilexi* l) {
     return amount_written;
 }
 
+static ssize_t hilexi_read_shm(hilexi* l) {
+    for (;;) {
+        ssize_t amt_read, frame_len;
+        if (l->read_pos == l->read_cap) {
+            if (realloc_read_buf(l) == -1) {
+                return -1;
+            }
+        }
+        amt_read = shm_ring_read(l->shm, l->read_buf + l->read_pos,
+                                 l->read_cap - l->read_pos);
+        if (amt_read == -1) {
+            return -1;
+        }
+        if (amt_read == 0) {
+            int wait_res = hilexi_shm_wait(l);
+            if (wait_res != 1) {
+                return wait_res;
+            }
+            continue;
+        }
+        l->read_pos += amt_read;
+        frame_len = hilexi_feed(l);
+        if (frame_len == -1) {
+            l->parser = frame_parser_new();
+            return -1;
+        }
+        if (frame_len > 0) {
+            break;
+        }
+    }
+
+    return l->read_pos;
+}
+
+static ssize_t hilexi_write_shm(hilexi* l) {
+    const uint8_t* write_buf = builder_out(&(l->builder));
+    size_t write_size = builder_len(&(l->builder));
+    size_t amount_written = 0;
+    while (amount_written < write_size) {
+        ssize_t amt = shm_ring_write(l->shm, write_buf + amount_written,
+                                     write_size - amount_written);
+        if (amt == -1) {
+            builder_reset(&(l->builder));
+            return -1;
+        }
+        if (amt == 0 && shm_ring_wait_space(l->shm) &&
+            hilexi_shm_wait(l) != 1) {
+            builder_reset(&(l->builder));
+            return -1;
+        }
+        amount_written += amt;
+    }
+    builder_reset(&(l->builder));
+    return amount_written;
+}
+
+/* blocks until the server signals us. returns 1 once it has, 0 if the server
+ * went away, and -1 on error */
+static int hilexi_shm_wait(hilexi* l) {
+    struct pollfd fds[2];
+    fds[0].fd = l->shm->wait_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = l->sfd;
+    fds[1].events = POLLIN;
+    for (;;) {
+        int res = poll(fds, 2, -1);
+        if (res == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        /* the socket is only ever readable once the server closes it */
+        if (fds[1].revents != 0) {
+            return 0;
+        }
+        shm_ring_clear_wakeup(l->shm);
+        return 1;
+    }
+}
+
 static int realloc_read_buf(hilexi* l) {
     size_t new_cap = l->read_cap << 1;
     void* tmp = realloc(l->read_buf, new_cap);
@@ -4,24 +4,33 @@
 
 #include "builder.h"
 #include "object.h"
+#include "parser.h"
 #include "result.h"
 #include "vstr.h"
 
+/* set in flags before hilexi_connect */
+#define HILEXI_BINARY (1 << 0) /* speak the binary protocol, see proto.h */
+
 typedef struct {
     int sfd;
     uint32_t addr;
     uint16_t port;
     uint16_t flags;
+    vstr path; /* the unix socket to connect to, empty for tcp */
+    struct shm_ring* shm; /* set when talking over shared memory */
     builder builder;
     uint8_t* read_buf;
     size_t read_pos;
     size_t read_cap;
+    frame_parser parser;
 } hilexi;
 
 result_t(hilexi, vstr);
 result_t(object, vstr);
 
 result(hilexi) hilexi_new(const char* addr, uint16_t port);
+result(hilexi) hilexi_new_unix(const char* path);
+result(hilexi) hilexi_new_shm(const char* path);
 int hilexi_authenticate(hilexi* l, const char* username, const char* password);
 int hilexi_connect(hilexi* l);
 
@@ -36,6 +45,8 @@ result(object) hilexi_push(hilexi* l, object* value);
 result(object) hilexi_pop(hilexi* l);
 result(object) hilexi_enque(hilexi* l, object* value);
 result(object) hilexi_deque(hilexi* l);
+result(object) hilexi_bpop(hilexi* l, int64_t timeout);
+result(object) hilexi_bdeque(hilexi* l, int64_t timeout);
 result(object) hilexi_zset(hilexi* l, object* value);
 result(object) hilexi_zhas(hilexi* l, object* value);
 result(object) hilexi_zdel(hilexi* l, object* value);
@@ -368,3 +368,40 @@ void ht_iter_next(ht_iter* iter) {
     iter->next = NULL;
     iter->next_slot = iter->end_slot;
 }
+
+/* the table only ever doubles, and the capacity is a power of 2, so a key
+ * stays in a slot whose low bits are the slot it was in when the scan
+ * started. Each step of the scan takes one of those starting slots, along
+ * with all the slots it has been split into since */
+ht_scan_cursor ht_scan_new(ht* ht) {
+    ht_scan_cursor cursor;
+    cursor.slot = 0;
+    cursor.end = ht->capacity;
+    return cursor;
+}
+
+int ht_scan(ht* ht, ht_scan_cursor* cursor, ht_scan_fn* fn, void* arg) {
+    size_t slot;
+
+    if (cursor->slot == cursor->end) {
+        return 0;
+    }
+
+    for (slot = cursor->slot; slot < ht->capacity; slot += cursor->end) {
+        ht_entry* cur = ht->entries[slot];
+        while (cur) {
+            ht_entry* next = cur->next;
+            fn(cur, arg);
+            cur = next;
+        }
+    }
+
+    cursor->slot++;
+    return cursor->slot != cursor->end;
+}
+
+int ht_scan_visited(ht* ht, const ht_scan_cursor* cursor, void* key,
+                    size_t key_size) {
+    size_t slot = ht_hash(ht, key, key_size);
+    return (slot & (cursor->end - 1)) < cursor->slot;
+}
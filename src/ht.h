@@ -28,6 +28,13 @@ typedef struct {
     ht_entry** entries;
 } ht;
 
+typedef void ht_scan_fn(ht_entry* e, void* arg);
+
+typedef struct {
+    size_t slot; /* the next slot to scan, of the table as it was */
+    size_t end;  /* the capacity when the scan started */
+} ht_scan_cursor;
+
 typedef struct {
     ht_entry* cur;
     ht_entry* next;
@@ -50,4 +57,31 @@ void ht_free(ht* ht, free_fn* free_key, free_fn* free_data);
 ht_iter ht_iter_new(ht* ht);
 void ht_iter_next(ht_iter* iter);
 
+/**
+ * @brief starts a scan, which goes over the table a little at a time.
+ * Entries may be added and removed between calls to ht_scan, and the table
+ * may grow. Every entry that is in the table for the whole scan is passed to
+ * fn exactly once
+ * @param ht the table
+ */
+ht_scan_cursor ht_scan_new(ht* ht);
+/**
+ * @brief calls fn on every entry in the next slot of the scan
+ * @param ht the table
+ * @param cursor the scan, moved on to the slot after
+ * @param fn called with each entry in the slot. Must not change the table
+ * @param arg passed to fn
+ * @returns 1 if there is more to scan, 0 once the scan is done
+ */
+int ht_scan(ht* ht, ht_scan_cursor* cursor, ht_scan_fn* fn, void* arg);
+/**
+ * @brief whether the scan has already been through the slot key is in
+ * @param ht the table
+ * @param cursor the scan
+ * @param key the key
+ * @param key_size the size of the key
+ */
+int ht_scan_visited(ht* ht, const ht_scan_cursor* cursor, void* key,
+                    size_t key_size);
+
 #endif /* __HT_H__ */
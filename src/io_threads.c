@@ -0,0 +1,172 @@
+#define _XOPEN_SOURCE 600
+#include "io_threads.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct {
+    struct io_threads* pool;
+    size_t id;
+    pthread_t thread;
+} io_thread;
+
+struct io_threads {
+    size_t num_threads;   /* the number of threads, including the caller */
+    io_thread* threads;   /* num_threads - 1 workers */
+    pthread_mutex_t lock; /* guards everything below */
+    pthread_cond_t start; /* signalled when a new batch is ready */
+    pthread_cond_t done;  /* signalled when the last worker finishes */
+    uint64_t generation;  /* bumped once per batch */
+    size_t num_running;   /* workers still working on the current batch */
+    int stop;             /* set when the pool is being freed */
+    io_threads_fn* fn;
+    void** items;
+    size_t num_items;
+};
+
+static void io_threads_run_share(io_threads* t, size_t id);
+static void* io_thread_main(void* arg);
+
+io_threads* io_threads_new(size_t num_threads) {
+    io_threads* t;
+    size_t i;
+
+    if (num_threads == 0) {
+        num_threads = 1;
+    }
+
+    t = calloc(1, sizeof *t);
+    if (t == NULL) {
+        return NULL;
+    }
+
+    t->num_threads = num_threads;
+
+    if (num_threads == 1) {
+        return t;
+    }
+
+    t->threads = calloc(num_threads - 1, sizeof(io_thread));
+    if (t->threads == NULL) {
+        free(t);
+        return NULL;
+    }
+
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->start, NULL);
+    pthread_cond_init(&t->done, NULL);
+
+    for (i = 0; i < num_threads - 1; ++i) {
+        io_thread* thread = &(t->threads[i]);
+        thread->pool = t;
+        /* the caller works on share 0 */
+        thread->id = i + 1;
+        if (pthread_create(&thread->thread, NULL, io_thread_main, thread) !=
+            0) {
+            /* run with the threads that did start */
+            t->num_threads = i + 1;
+            break;
+        }
+    }
+
+    return t;
+}
+
+size_t io_threads_len(io_threads* t) { return t->num_threads; }
+
+void io_threads_run(io_threads* t, io_threads_fn* fn, void** items,
+                    size_t num_items) {
+    size_t i;
+
+    if (num_items == 0) {
+        return;
+    }
+
+    /* not worth waking anyone */
+    if (t->num_threads == 1 || num_items == 1) {
+        for (i = 0; i < num_items; ++i) {
+            fn(items[i]);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&t->lock);
+    t->fn = fn;
+    t->items = items;
+    t->num_items = num_items;
+    t->num_running = t->num_threads - 1;
+    t->generation++;
+    pthread_cond_broadcast(&t->start);
+    pthread_mutex_unlock(&t->lock);
+
+    io_threads_run_share(t, 0);
+
+    pthread_mutex_lock(&t->lock);
+    while (t->num_running > 0) {
+        pthread_cond_wait(&t->done, &t->lock);
+    }
+    pthread_mutex_unlock(&t->lock);
+}
+
+void io_threads_free(io_threads* t) {
+    size_t i;
+
+    if (t->threads == NULL) {
+        free(t);
+        return;
+    }
+
+    pthread_mutex_lock(&t->lock);
+    t->stop = 1;
+    pthread_cond_broadcast(&t->start);
+    pthread_mutex_unlock(&t->lock);
+
+    for (i = 0; i < t->num_threads - 1; ++i) {
+        pthread_join(t->threads[i].thread, NULL);
+    }
+
+    pthread_cond_destroy(&t->done);
+    pthread_cond_destroy(&t->start);
+    pthread_mutex_destroy(&t->lock);
+    free(t->threads);
+    free(t);
+}
+
+/* items are striped across the threads so that each thread touches a fixed
+ * set of items without any further coordination */
+static void io_threads_run_share(io_threads* t, size_t id) {
+    size_t i;
+    for (i = id; i < t->num_items; i += t->num_threads) {
+        t->fn(t->items[i]);
+    }
+}
+
+static void* io_thread_main(void* arg) {
+    io_thread* self = arg;
+    io_threads* t = self->pool;
+    uint64_t seen = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&t->lock);
+        while (t->generation == seen && !t->stop) {
+            pthread_cond_wait(&t->start, &t->lock);
+        }
+        if (t->stop) {
+            pthread_mutex_unlock(&t->lock);
+            return NULL;
+        }
+        seen = t->generation;
+        pthread_mutex_unlock(&t->lock);
+
+        io_threads_run_share(t, self->id);
+
+        pthread_mutex_lock(&t->lock);
+        t->num_running--;
+        if (t->num_running == 0) {
+            pthread_cond_signal(&t->done);
+        }
+        pthread_mutex_unlock(&t->lock);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,23 @@
+#ifndef __IO_THREADS_H__
+
+#define __IO_THREADS_H__
+
+#include <stddef.h>
+
+struct io_threads;
+
+typedef struct io_threads io_threads;
+
+typedef void io_threads_fn(void* item);
+
+/* num_threads includes the calling thread, so a pool of 1 starts no threads
+ * and io_threads_run simply runs every item inline */
+io_threads* io_threads_new(size_t num_threads);
+size_t io_threads_len(io_threads* t);
+/* calls fn on every item, spreading the items across the pool, and returns
+ * once every call has finished */
+void io_threads_run(io_threads* t, io_threads_fn* fn, void** items,
+                    size_t num_items);
+void io_threads_free(io_threads* t);
+
+#endif /* __IO_THREADS_H__ */
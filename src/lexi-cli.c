@@ -141,6 +141,12 @@ static result(object) execute_cmd(hilexi* l, cmd* cmd) {
     case Deque:
         cmd_res = hilexi_deque(l);
         break;
+    case Bpop:
+        cmd_res = hilexi_bpop(l, cmd->data.bpop.timeout);
+        break;
+    case Bdeque:
+        cmd_res = hilexi_bdeque(l, cmd->data.bdeque.timeout);
+        break;
     case ZSet: {
         object value = cmd->data.zset.value;
         cmd_res = hilexi_zset(l, &value);
@@ -19,16 +19,18 @@ typedef struct {
 } lookup;
 
 const lookup lookups[] = {
-    {"set", 3, Set},     {"SET", 3, Set},       {"get", 3, Get},
-    {"GET", 3, Get},     {"del", 3, Del},       {"DEL", 3, Del},
-    {"pop", 3, Pop},     {"POP", 3, Pop},       {"ping", 4, Ping},
-    {"PING", 4, Ping},   {"info", 4, Infoc},    {"INFO", 4, Infoc},
-    {"HELP", 4, Help},   {"help", 4, Help},     {"keys", 4, Keys},
-    {"KEYS", 4, Keys},   {"push", 4, Push},     {"PUSH", 4, Push},
-    {"zset", 4, ZSet},   {"ZSET", 4, ZSet},     {"zhas", 4, ZHas},
-    {"ZHAS", 4, ZHas},   {"zdel", 4, ZDel},     {"ZDEL", 4, ZDel},
-    {"enque", 5, Enque}, {"ENQUE", 5, Enque},   {"deque", 5, Deque},
-    {"DEQUE", 5, Deque}, {"select", 6, Select}, {"SELECT", 6, Select},
+    {"set", 3, Set},       {"SET", 3, Set},       {"get", 3, Get},
+    {"GET", 3, Get},       {"del", 3, Del},       {"DEL", 3, Del},
+    {"pop", 3, Pop},       {"POP", 3, Pop},       {"ping", 4, Ping},
+    {"PING", 4, Ping},     {"info", 4, Infoc},    {"INFO", 4, Infoc},
+    {"HELP", 4, Help},     {"help", 4, Help},     {"keys", 4, Keys},
+    {"KEYS", 4, Keys},     {"push", 4, Push},     {"PUSH", 4, Push},
+    {"zset", 4, ZSet},     {"ZSET", 4, ZSet},     {"zhas", 4, ZHas},
+    {"ZHAS", 4, ZHas},     {"zdel", 4, ZDel},     {"ZDEL", 4, ZDel},
+    {"bpop", 4, Bpop},     {"BPOP", 4, Bpop},     {"enque", 5, Enque},
+    {"ENQUE", 5, Enque},   {"deque", 5, Deque},   {"DEQUE", 5, Deque},
+    {"select", 6, Select}, {"SELECT", 6, Select}, {"bdeque", 6, Bdeque},
+    {"BDEQUE", 6, Bdeque},
 };
 
 size_t lookups_len = sizeof lookups / sizeof lookups[0];
@@ -137,6 +139,26 @@ static cmd parse_cmd(line_parser* p) {
         cmd.data.select.value = value;
         cmd.type = Select;
     } break;
+    case Bpop:
+    case Bdeque: {
+        object timeout = parse_object(p);
+        block_cmd block = {0};
+        if (timeout.type == Int) {
+            block.timeout = timeout.data.num;
+        } else if (timeout.type != Null) {
+            object_free(&timeout);
+            return cmd;
+        }
+        if (block.timeout < 0) {
+            return cmd;
+        }
+        if (type == Bpop) {
+            cmd.data.bpop = block;
+        } else {
+            cmd.data.bdeque = block;
+        }
+        cmd.type = type;
+    } break;
     default:
         cmd.type = Illegal;
         break;
@@ -0,0 +1,55 @@
+#include "mpsc_queue.h"
+#include <stddef.h>
+
+/* Dmitry Vyukov's intrusive mpsc queue. Producers only ever swap the head,
+ * so a push is a single atomic exchange followed by a store */
+
+void mpsc_queue_init(mpsc_queue* q) {
+    q->stub.next = NULL;
+    q->head = &q->stub;
+    q->tail = &q->stub;
+}
+
+void mpsc_queue_push(mpsc_queue* q, mpsc_node* node) {
+    mpsc_node* prev;
+    __atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+    prev = __atomic_exchange_n(&q->head, node, __ATOMIC_ACQ_REL);
+    /* the node is unreachable by the consumer until this store */
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+mpsc_node* mpsc_queue_pop(mpsc_queue* q) {
+    mpsc_node* tail = q->tail;
+    mpsc_node* next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    mpsc_node* head;
+
+    if (tail == &q->stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+        q->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next != NULL) {
+        q->tail = next;
+        return tail;
+    }
+
+    head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    if (tail != head) {
+        /* a producer has swapped the head but not linked its node yet */
+        return NULL;
+    }
+
+    /* tail is the last node, put the stub behind it so it can be popped */
+    mpsc_queue_push(q, &q->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next != NULL) {
+        q->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
@@ -0,0 +1,43 @@
+#ifndef __MPSC_QUEUE_H__
+
+#define __MPSC_QUEUE_H__
+
+/**
+ * @brief a lock-free multi-producer single-consumer queue
+ *
+ * The queue is intrusive: callers embed an mpsc_node as the first member of
+ * their own struct and cast back after popping. Any thread may push, but
+ * only one thread may pop. Pushing never blocks and never allocates.
+ */
+typedef struct mpsc_node {
+    struct mpsc_node* next;
+} mpsc_node;
+
+typedef struct {
+    mpsc_node* head; /* the most recently pushed node, written by producers */
+    mpsc_node* tail; /* the next node to pop, owned by the consumer */
+    mpsc_node stub;  /* keeps the queue non-empty so push never sees NULL */
+} mpsc_queue;
+
+/**
+ * @brief initialize an empty queue. The queue must not be moved after this
+ * @param q the queue to initialize
+ */
+void mpsc_queue_init(mpsc_queue* q);
+/**
+ * @brief push a node onto the queue. Safe to call from any thread
+ * @param q the queue
+ * @param node the node to push
+ */
+void mpsc_queue_push(mpsc_queue* q, mpsc_node* node);
+/**
+ * @brief pop the oldest node off of the queue. Only the consumer may call
+ * this
+ * @param q the queue
+ * @returns the popped node, or NULL if the queue is empty or a push is still
+ * in progress. In the latter case the pushing thread is expected to notify
+ * the consumer once it is done
+ */
+mpsc_node* mpsc_queue_pop(mpsc_queue* q);
+
+#endif /* __MPSC_QUEUE_H__ */
@@ -1,4 +1,5 @@
 #include "networking.h"
+#include <errno.h>
 #include <fcntl.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
@@ -7,6 +8,9 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 int create_tcp_socket(int non_blocking) {
     if (non_blocking) {
@@ -45,11 +49,154 @@ int tcp_connect(int socket, uint32_t addr, uint16_t port) {
     return res;
 }
 
+int create_unix_socket(int non_blocking) {
+    if (non_blocking) {
+        return socket(AF_UNIX, (SOCK_STREAM | SOCK_NONBLOCK), 0);
+    }
+    return socket(AF_UNIX, SOCK_STREAM, 0);
+}
+
+static int unix_sockaddr(struct sockaddr_un* sa, const char* path) {
+    size_t len = strlen(path);
+    if (len >= sizeof sa->sun_path) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    sa->sun_family = AF_UNIX;
+    memcpy(sa->sun_path, path, len + 1);
+    return 0;
+}
+
+int unix_bind(int sfd, const char* path) {
+    struct sockaddr_un sa = {0};
+    if (sfd < 0 || unix_sockaddr(&sa, path) == -1) {
+        return -1;
+    }
+    return bind(sfd, (struct sockaddr*)(&sa), sizeof sa);
+}
+
+int unix_connect(int socket, const char* path) {
+    struct sockaddr_un sa = {0};
+    if (unix_sockaddr(&sa, path) == -1) {
+        return -1;
+    }
+    return connect(socket, (struct sockaddr*)(&sa), sizeof sa);
+}
+
+#define UNIX_MAX_FDS 8
+
+/* sends fds along with a single byte, since ancillary data can not be sent
+ * on its own */
+int unix_send_fds(int socket, const int* fds, size_t num_fds) {
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int) * UNIX_MAX_FDS)];
+    } control;
+    struct msghdr msg = {0};
+    struct iovec iov;
+    struct cmsghdr* cmsg;
+    char b = 0;
+
+    if (num_fds > UNIX_MAX_FDS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(&control, 0, sizeof control);
+    iov.iov_base = &b;
+    iov.iov_len = 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * num_fds);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * num_fds);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * num_fds);
+
+    return sendmsg(socket, &msg, 0) == -1 ? -1 : 0;
+}
+
+/* reads like read(), also collecting any fds sent with the data. *num_fds is
+ * the capacity of fds going in and the number received coming out. If more
+ * fds arrive than fit, they are all closed and -1 is returned */
+ssize_t unix_recv_fds(int socket, void* buf, size_t len, int* fds,
+                      size_t* num_fds) {
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int) * UNIX_MAX_FDS)];
+    } control;
+    struct msghdr msg = {0};
+    struct iovec iov;
+    struct cmsghdr* cmsg;
+    size_t cap = *num_fds;
+    ssize_t res;
+    int overflow = 0;
+
+    *num_fds = 0;
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof control.buf;
+
+    res = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+    if (res == -1) {
+        return -1;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        size_t i, n;
+        int* data;
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        data = (int*)CMSG_DATA(cmsg);
+        for (i = 0; i < n; ++i) {
+            int fd;
+            memcpy(&fd, data + i, sizeof fd);
+            if (*num_fds < cap) {
+                fds[(*num_fds)++] = fd;
+            } else {
+                close(fd);
+                overflow = 1;
+            }
+        }
+    }
+
+    if (overflow || (msg.msg_flags & MSG_CTRUNC)) {
+        size_t i;
+        for (i = 0; i < *num_fds; ++i) {
+            close(fds[i]);
+        }
+        *num_fds = 0;
+        errno = EBADMSG;
+        return -1;
+    }
+
+    return res;
+}
+
 int set_reuse_addr(int sfd) {
     int yes = 1;
     return setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof yes);
 }
 
+int set_reuse_port(int sfd) {
+#ifdef SO_REUSEPORT
+    int yes = 1;
+    return setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof yes);
+#else
+    errno = ENOPROTOOPT;
+    return -1;
+#endif
+}
+
 int make_socket_nonblocking(int sfd) {
     int flags = fcntl(sfd, F_GETFL, 0);
     if (flags == -1) {
@@ -2,6 +2,7 @@
 
 #define __NETWORKING_H__
 
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -13,7 +14,15 @@ int tcp_listen(int sfd, int backlog);
 int tcp_accept(int socket, struct sockaddr_in* addr_in, socklen_t* addr_len);
 int tcp_connect(int socket, uint32_t addr, uint16_t port);
 
+int create_unix_socket(int non_blocking);
+int unix_bind(int sfd, const char* path);
+int unix_connect(int socket, const char* path);
+int unix_send_fds(int socket, const int* fds, size_t num_fds);
+ssize_t unix_recv_fds(int socket, void* buf, size_t len, int* fds,
+                      size_t* num_fds);
+
 int set_reuse_addr(int sfd);
+int set_reuse_port(int sfd);
 int make_socket_nonblocking(int sfd);
 
 uint32_t parse_addr(const char* addr_str);
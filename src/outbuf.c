@@ -0,0 +1,198 @@
+#define _DEFAULT_SOURCE
+#include "outbuf.h"
+#include <memory.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+
+/* the most chunks handed to a single writev. Well below IOV_MAX, and more
+ * than a socket buffer holds anyway */
+#define OUTBUF_IOV_MAX 64
+
+typedef struct outbuf_chunk {
+    struct outbuf_chunk* next;
+    size_t len; /* the amount of data used */
+    size_t cap; /* the allocation size of data */
+    const uint8_t* ref;         /* bytes owned elsewhere, NULL for data */
+    outbuf_release_fn* release; /* drops ref once it has been written */
+    void* release_arg;
+    uint8_t data[];
+} outbuf_chunk;
+
+static outbuf_chunk* outbuf_chunk_new(size_t cap);
+static const uint8_t* outbuf_chunk_bytes(const outbuf_chunk* chunk);
+static void outbuf_chunk_free(outbuf_chunk* chunk);
+
+outbuf outbuf_new(void) {
+    outbuf b = {0};
+    return b;
+}
+
+size_t outbuf_len(const outbuf* b) { return b->len; }
+
+int outbuf_push(outbuf* b, const void* data, size_t len) {
+    const uint8_t* bytes = data;
+    outbuf_chunk* tail = b->tail;
+    size_t tail_amt = 0;
+
+    if (len == 0) {
+        return 0;
+    }
+
+    if (tail != NULL) {
+        tail_amt = tail->cap - tail->len;
+        if (tail_amt > len) {
+            tail_amt = len;
+        }
+    }
+
+    if (tail_amt < len) {
+        size_t rest = len - tail_amt;
+        /* a large reply gets a chunk of its own rather than many small
+         * ones */
+        outbuf_chunk* chunk = outbuf_chunk_new(
+            rest > OUTBUF_CHUNK_SIZE ? rest : OUTBUF_CHUNK_SIZE);
+        if (chunk == NULL) {
+            return -1;
+        }
+        memcpy(chunk->data, bytes + tail_amt, rest);
+        chunk->len = rest;
+        if (tail == NULL) {
+            b->head = chunk;
+        } else {
+            tail->next = chunk;
+        }
+        b->tail = chunk;
+    }
+
+    if (tail_amt != 0) {
+        memcpy(tail->data + tail->len, bytes, tail_amt);
+        tail->len += tail_amt;
+    }
+
+    b->len += len;
+    return 0;
+}
+
+/* the reference gets a chunk of its own, and since it is full nothing is
+ * ever appended to it */
+int outbuf_push_ref(outbuf* b, const void* data, size_t len,
+                    outbuf_release_fn* release, void* arg) {
+    outbuf_chunk* chunk;
+
+    if (len == 0) {
+        return 0;
+    }
+
+    chunk = outbuf_chunk_new(0);
+    if (chunk == NULL) {
+        return -1;
+    }
+    chunk->len = chunk->cap = len;
+    chunk->ref = data;
+    chunk->release = release;
+    chunk->release_arg = arg;
+
+    if (b->tail == NULL) {
+        b->head = chunk;
+    } else {
+        b->tail->next = chunk;
+    }
+    b->tail = chunk;
+    b->len += len;
+    return 0;
+}
+
+ssize_t outbuf_write(outbuf* b, int fd) {
+    struct iovec iov[OUTBUF_IOV_MAX];
+    outbuf_chunk* cur = b->head;
+    size_t pos = b->head_pos;
+    int iovcnt = 0;
+    ssize_t amt_sent;
+
+    while (cur != NULL && iovcnt < OUTBUF_IOV_MAX) {
+        iov[iovcnt].iov_base = (uint8_t*)outbuf_chunk_bytes(cur) + pos;
+        iov[iovcnt].iov_len = cur->len - pos;
+        iovcnt++;
+        pos = 0;
+        cur = cur->next;
+    }
+
+    if (iovcnt == 0) {
+        return 0;
+    }
+
+    amt_sent = writev(fd, iov, iovcnt);
+    if (amt_sent == -1) {
+        return -1;
+    }
+
+    outbuf_consume(b, amt_sent);
+    return amt_sent;
+}
+
+size_t outbuf_peek(const outbuf* b, const void** data) {
+    if (b->head == NULL) {
+        *data = NULL;
+        return 0;
+    }
+    *data = outbuf_chunk_bytes(b->head) + b->head_pos;
+    return b->head->len - b->head_pos;
+}
+
+void outbuf_consume(outbuf* b, size_t len) {
+    b->len -= len;
+    while (len > 0) {
+        outbuf_chunk* head = b->head;
+        size_t head_left = head->len - b->head_pos;
+        if (len < head_left) {
+            b->head_pos += len;
+            break;
+        }
+        len -= head_left;
+        b->head = head->next;
+        b->head_pos = 0;
+        outbuf_chunk_free(head);
+    }
+
+    if (b->head == NULL) {
+        b->tail = NULL;
+    }
+}
+
+void outbuf_free(outbuf* b) {
+    outbuf_chunk* cur = b->head;
+    while (cur != NULL) {
+        outbuf_chunk* next = cur->next;
+        outbuf_chunk_free(cur);
+        cur = next;
+    }
+    b->head = b->tail = NULL;
+    b->head_pos = 0;
+    b->len = 0;
+}
+
+static outbuf_chunk* outbuf_chunk_new(size_t cap) {
+    outbuf_chunk* chunk = malloc(sizeof *chunk + cap);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->len = 0;
+    chunk->cap = cap;
+    chunk->ref = NULL;
+    chunk->release = NULL;
+    chunk->release_arg = NULL;
+    return chunk;
+}
+
+static const uint8_t* outbuf_chunk_bytes(const outbuf_chunk* chunk) {
+    return chunk->ref != NULL ? chunk->ref : chunk->data;
+}
+
+static void outbuf_chunk_free(outbuf_chunk* chunk) {
+    if (chunk->release != NULL) {
+        chunk->release(chunk->release_arg);
+    }
+    free(chunk);
+}
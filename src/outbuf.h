@@ -0,0 +1,92 @@
+#ifndef __OUTBUF_H__
+
+#define __OUTBUF_H__
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define OUTBUF_CHUNK_SIZE (16 * 1024)
+
+struct outbuf_chunk;
+
+typedef void outbuf_release_fn(void* arg);
+
+/**
+ * @brief output waiting to be written to a socket
+ *
+ * The output is kept in a chain of chunks so that appending never moves
+ * bytes that are already buffered, and so the chain can be handed to
+ * writev as is. Chunks are freed as soon as they have been written. A chunk
+ * can also refer to bytes owned by someone else, which are then written
+ * without ever being copied.
+ */
+typedef struct {
+    struct outbuf_chunk* head; /* the oldest chunk, written from first */
+    struct outbuf_chunk* tail; /* the chunk new output is appended to */
+    size_t head_pos;           /* the amount of head already written */
+    size_t len;                /* the number of bytes not yet written */
+} outbuf;
+
+/**
+ * @brief create an empty output buffer. Nothing is allocated until the first
+ * push
+ */
+outbuf outbuf_new(void);
+/**
+ * @brief the number of buffered bytes that have not been written yet
+ * @param b the output buffer
+ */
+size_t outbuf_len(const outbuf* b);
+/**
+ * @brief copy data onto the end of the buffer
+ * @param b the output buffer
+ * @param data the bytes to append
+ * @param len the number of bytes to append
+ * @returns 0 on success, -1 if a chunk could not be allocated, in which case
+ * nothing was appended
+ */
+int outbuf_push(outbuf* b, const void* data, size_t len);
+/**
+ * @brief append a reference to data rather than a copy of it
+ * @param b the output buffer
+ * @param data the bytes to append, which must stay valid until release is
+ * called
+ * @param len the number of bytes to append
+ * @param release called with arg once the bytes have been written, or when
+ * the buffer is freed
+ * @param arg passed to release
+ * @returns 0 on success, -1 if a chunk could not be allocated, in which case
+ * nothing was appended and release is not called
+ */
+int outbuf_push_ref(outbuf* b, const void* data, size_t len,
+                    outbuf_release_fn* release, void* arg);
+/**
+ * @brief write as much of the buffer as the fd will take with writev
+ * @param b the output buffer
+ * @param fd the file descriptor to write to
+ * @returns the number of bytes written, or -1 with errno set. Written bytes
+ * are dropped from the buffer, so the next call resumes where this one left
+ * off
+ */
+ssize_t outbuf_write(outbuf* b, int fd);
+/**
+ * @brief get the oldest unwritten bytes, for writing somewhere other than an
+ * fd
+ * @param b the output buffer
+ * @param data set to the start of the bytes
+ * @returns the number of contiguous bytes at data, 0 if the buffer is empty
+ */
+size_t outbuf_peek(const outbuf* b, const void** data);
+/**
+ * @brief drop bytes from the front of the buffer once they have been written
+ * @param b the output buffer
+ * @param len the number of bytes written. Must not be more than outbuf_len
+ */
+void outbuf_consume(outbuf* b, size_t len);
+/**
+ * @brief free every chunk, leaving the buffer empty and usable
+ * @param b the output buffer
+ */
+void outbuf_free(outbuf* b);
+
+#endif /* __OUTBUF_H__ */
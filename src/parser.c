@@ -1,8 +1,13 @@
 #include "parser.h"
+#include "cmd_lookup.c"
+#include "bin_parser.h"
 #include "cmd.h"
 #include "object.h"
+#include "proto.h"
+#include "scan.h"
 #include "vstr.h"
 #include <ctype.h>
+#include <float.h>
 #include <memory.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -22,38 +27,63 @@ typedef struct {
     size_t input_len;
     size_t pos;
     uint8_t ch;
+    vstr* bulk;      /* a bulk string received apart from input, or NULL */
+    size_t bulk_at;  /* where bulk's contents are missing from input */
+    bin_reader* bin; /* reads the arguments instead, for the binary protocol */
 } parser;
 
-typedef struct {
-    const char* cmd;
-    size_t cmd_len;
-    cmdt type;
-} cmdt_lookup;
-
-const cmdt_lookup lookup[] = {
-    {"OK", 2, Okc},      {"SET", 3, Set},       {"GET", 3, Get},
-    {"DEL", 3, Del},     {"POP", 3, Pop},       {"HELP", 4, Help},
-    {"AUTH", 4, Auth},   {"PING", 4, Ping},     {"INFO", 4, Infoc},
-    {"KEYS", 4, Keys},   {"PUSH", 4, Push},     {"ZSET", 4, ZSet},
-    {"ZHAS", 4, ZHas},   {"ZDEL", 4, ZDel},     {"ENQUE", 5, Enque},
-    {"DEQUE", 5, Deque}, {"SELECT", 6, Select},
+static const uint64_t powers_of_10[SCAN_DIGITS_MAX + 1] = {
+    1ULL,
+    10ULL,
+    100ULL,
+    1000ULL,
+    10000ULL,
+    100000ULL,
+    1000000ULL,
+    10000000ULL,
+    100000000ULL,
+    1000000000ULL,
+    10000000000ULL,
+    100000000000ULL,
+    1000000000000ULL,
+    10000000000000ULL,
+    100000000000000ULL,
+    1000000000000000ULL,
+    10000000000000000ULL,
+    100000000000000000ULL,
+    1000000000000000000ULL,
+    10000000000000000000ULL,
+};
+
+/* every power of 10 a double holds exactly */
+static const double exact_powers_of_10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
 };
 
-const size_t lookup_len = sizeof lookup / sizeof lookup[0];
+#define EXACT_POW10_MAX                                                        \
+    ((int64_t)(sizeof exact_powers_of_10 / sizeof exact_powers_of_10[0]) - 1)
+#define DOUBLE_MANTISSA_MAX (1ULL << 53)
+/* long enough for any double a client would reasonably send */
+#define DOUBLE_BUF_LEN 64
 
 static parser parser_new(const uint8_t* input, size_t input_len);
 static cmd parse_cmd(parser* p);
 static cmd parse_array_cmd(parser* p);
+static cmd parse_bin_cmd(parser* p);
+static cmd parse_cmd_args(parser* p, uint64_t len);
 static cmdt parse_cmd_type(parser* p);
-static cmdt lookup_cmd(vstr* s);
-static cmdt parse_simple_string_cmd(parser* p);
-static cmdt parse_bulk_string_cmd(parser* p);
+static const cmd_spec* parse_arg_spec(parser* p);
+static const cmd_spec* parse_cmd_spec(parser* p);
+static object parse_arg(parser* p);
 static object parse_object(parser* p);
 static vstr parse_string(parser* p, uint64_t len);
 static vstr parse_simple_string(parser* p);
 static vstr parse_error(parser* p);
+static vstr parse_line(parser* p);
 static int64_t parse_integer(parser* p);
 static double parse_double(parser* p);
+static int parse_double_fast(const uint8_t* s, size_t len, double* out);
 static uint64_t parse_len(parser* p);
 static uint8_t peek_byte(parser* p);
 static inline bool cur_byte_is(parser* p, uint8_t byte);
@@ -61,6 +91,7 @@ static inline bool peek_byte_is(parser* p, uint8_t byte);
 static bool expect_peek_byte(parser* p, uint8_t byte);
 static bool expect_peek_byte_to_be_num(parser* p);
 static inline void parser_read_char(parser* p);
+static void parser_fail(parser* p);
 static int parser_object_cmp(void* a, void* b);
 static void parser_free_object(void* ptr);
 
@@ -69,11 +100,268 @@ cmd parse(const uint8_t* input, size_t input_len) {
     return parse_cmd(&p);
 }
 
+/* the same as parse, for a frame with one large bulk string that was received
+ * separately, see frame_parser_detach_bulk. Its contents are missing from
+ * input, which goes straight from the bulk string's header to the \r\n that
+ * ends it at bulk_at. bulk is moved into the cmd, and left empty if it was
+ * used */
+cmd parse_with_bulk(const uint8_t* input, size_t input_len, vstr* bulk,
+                    size_t bulk_at) {
+    parser p = parser_new(input, input_len);
+    p.bulk = bulk;
+    p.bulk_at = bulk_at;
+    return parse_cmd(&p);
+}
+
+/* the same as parse, for a frame in the binary protocol. A command name on
+ * its own is taken to be a command without arguments */
+cmd parse_bin(const uint8_t* input, size_t input_len) {
+    return parse_bin_with_bulk(input, input_len, NULL, 0);
+}
+
+/* the same as parse_with_bulk, for a frame in the binary protocol. The frame
+ * goes straight from the string's header to whatever follows the string */
+cmd parse_bin_with_bulk(const uint8_t* input, size_t input_len, vstr* bulk,
+                        size_t bulk_at) {
+    parser p = {0};
+    bin_reader r = bin_reader_new(input, input_len);
+    r.bulk = bulk;
+    r.bulk_at = bulk_at;
+    p.bin = &r;
+    return parse_bin_cmd(&p);
+}
+
 object parse_from_server(const uint8_t* input, size_t input_len) {
     parser p = parser_new(input, input_len);
     return parse_object(&p);
 }
 
+frame_parser frame_parser_new(void) {
+    frame_parser fp = {0};
+    fp.state = FrameType;
+    fp.pending = 1;
+    return fp;
+}
+
+/* scans input, which starts at the beginning of a frame, from where the last
+ * call left off. returns the length of the frame once it is complete and
+ * resets fp for the next frame, 0 if more input is needed, and -1 if the frame
+ * is malformed */
+ssize_t frame_parser_feed(frame_parser* fp, const uint8_t* input,
+                          size_t input_len) {
+    while (fp->pos < input_len) {
+        uint8_t ch = input[fp->pos];
+        switch (fp->state) {
+        case FrameType:
+            switch (ch) {
+            case '*':
+            case '%':
+            case '$':
+                fp->state = FrameLen;
+                fp->len = 0;
+                fp->has_digits = 0;
+                break;
+            case '+':
+            case '-':
+            case ':':
+            case ',':
+            case '#':
+                fp->state = FrameLine;
+                break;
+            default:
+                return -1;
+            }
+            fp->type = ch;
+            fp->pos++;
+            break;
+        case FrameLen: {
+            uint64_t val;
+            size_t n =
+                scan_digits(input + fp->pos, input_len - fp->pos, &val);
+            if (n != 0) {
+                /* a run that may have been split between reads. Past the
+                 * first digits, no more than fit under the limit */
+                if (n > SCAN_DIGITS_MAX || (fp->len != 0 && n > 9)) {
+                    return -1;
+                }
+                fp->len = (fp->len * powers_of_10[n]) + val;
+                if (fp->len > FRAME_MAX_LEN) {
+                    return -1;
+                }
+                fp->has_digits = 1;
+                fp->pos += n;
+                break;
+            }
+            if (ch != '\r' || !fp->has_digits) {
+                return -1;
+            }
+            fp->state = FrameLineEnd;
+            fp->pos++;
+        } break;
+        case FrameLine: {
+            size_t cr = scan_cr(input + fp->pos, input_len - fp->pos);
+            if (fp->pos + cr == input_len) {
+                fp->pos = input_len;
+                break;
+            }
+            fp->pos += cr + 1;
+            fp->state = FrameLineEnd;
+        } break;
+        case FrameLineEnd:
+            if (ch != '\n') {
+                return -1;
+            }
+            fp->pos++;
+            fp->pending--;
+            if (fp->type == '*') {
+                fp->pending += fp->len;
+            } else if (fp->type == '%') {
+                fp->pending += fp->len << 1;
+            } else if (fp->type == '$') {
+                fp->bulk_remaining = fp->len;
+                fp->state = FrameBulk;
+                break;
+            }
+            fp->state = FrameType;
+            break;
+        case FrameBulk: {
+            size_t avail = input_len - fp->pos;
+            if (avail < fp->bulk_remaining) {
+                fp->bulk_remaining -= avail;
+                fp->pos = input_len;
+                break;
+            }
+            fp->pos += fp->bulk_remaining;
+            fp->bulk_remaining = 0;
+            fp->state = FrameBulkCr;
+        } break;
+        case FrameBulkCr:
+            if (ch != '\r') {
+                return -1;
+            }
+            fp->pos++;
+            fp->state = FrameBulkLf;
+            break;
+        case FrameBulkLf:
+            if (ch != '\n') {
+                return -1;
+            }
+            fp->pos++;
+            fp->state = FrameType;
+            break;
+        }
+
+        if (fp->pending == 0 && fp->state == FrameType) {
+            ssize_t frame_len = fp->pos;
+            *fp = frame_parser_new();
+            return frame_len;
+        }
+    }
+    return 0;
+}
+
+/* the same as frame_parser_feed, for the binary protocol. Every header has a
+ * fixed size, so nothing is scanned for: a header that is not all there yet
+ * is left for the next call, and string contents are skipped whole */
+ssize_t bin_frame_parser_feed(frame_parser* fp, const uint8_t* input,
+                              size_t input_len) {
+    for (;;) {
+        if (fp->pending == 0 && fp->state == FrameType) {
+            size_t frame_len = fp->pos;
+            *fp = frame_parser_new();
+            return frame_len;
+        }
+        if (fp->pos >= input_len) {
+            return 0;
+        }
+
+        switch (fp->state) {
+        case FrameType: {
+            uint8_t type = input[fp->pos];
+            size_t header_len = bin_header_len(type);
+            const uint8_t* header = input + fp->pos + 1;
+            if (header_len == 0) {
+                return -1;
+            }
+            if (input_len - fp->pos < header_len) {
+                return 0;
+            }
+            fp->type = type;
+            fp->pos += header_len;
+            fp->pending--;
+            switch (type) {
+            case BinString:
+            case BinSimple:
+            case BinErr:
+                fp->len = bin_get_u32(header);
+                if (fp->len > FRAME_MAX_LEN) {
+                    return -1;
+                }
+                if (fp->len > 0) {
+                    fp->bulk_remaining = fp->len;
+                    fp->state = FrameBulk;
+                }
+                break;
+            case BinArray:
+                fp->len = bin_get_u32(header);
+                if (fp->len > FRAME_MAX_LEN) {
+                    return -1;
+                }
+                fp->pending += fp->len;
+                break;
+            case BinHt:
+                fp->len = bin_get_u32(header);
+                if (fp->len > FRAME_MAX_LEN) {
+                    return -1;
+                }
+                fp->pending += fp->len * 2;
+                break;
+            default:
+                break;
+            }
+        } break;
+        case FrameBulk: {
+            size_t avail = input_len - fp->pos;
+            if (avail > fp->bulk_remaining) {
+                avail = fp->bulk_remaining;
+            }
+            fp->pos += avail;
+            fp->bulk_remaining -= avail;
+            if (fp->bulk_remaining == 0) {
+                fp->state = FrameType;
+            }
+        } break;
+        default:
+            return -1;
+        }
+    }
+}
+
+/* called while fp is in the middle of a bulk string, to have the rest of it
+ * received somewhere other than the input. returns the offset in the frame
+ * where the bulk string's contents start. The contents fed so far run from
+ * there to the end of the input, and fp now takes the input to end there.
+ * The rest of the contents are reported with frame_parser_skip_bulk, and the
+ * input then continues with the \r\n that ends the bulk string */
+size_t frame_parser_detach_bulk(frame_parser* fp) {
+    fp->pos -= fp->len - fp->bulk_remaining;
+    return fp->pos;
+}
+
+/* accounts for len bytes of a detached bulk string */
+void frame_parser_skip_bulk(frame_parser* fp, size_t len) {
+    fp->bulk_remaining -= len;
+    if (fp->bulk_remaining == 0) {
+        /* only RESP ends a string with \r\n */
+        fp->state = fp->type == '$' ? FrameBulkCr : FrameType;
+    }
+}
+
+ssize_t parse_frame_len(const uint8_t* input, size_t input_len) {
+    frame_parser fp = frame_parser_new();
+    return frame_parser_feed(&fp, input, input_len);
+}
+
 static parser parser_new(const uint8_t* input, size_t input_len) {
     parser p = {0};
     p.input = input;
@@ -89,10 +377,8 @@ static cmd parse_cmd(parser* p) {
         cmd = parse_array_cmd(p);
         break;
     case '+':
-        cmd.type = parse_simple_string_cmd(p);
-        break;
     case '$':
-        cmd.type = parse_bulk_string_cmd(p);
+        cmd.type = parse_cmd_type(p);
         break;
     default:
         break;
@@ -103,7 +389,6 @@ static cmd parse_cmd(parser* p) {
 static cmd parse_array_cmd(parser* p) {
     cmd cmd = {0};
     uint64_t len;
-    cmdt type;
 
     if (!expect_peek_byte_to_be_num(p)) {
         return cmd;
@@ -123,20 +408,46 @@ static cmd parse_array_cmd(parser* p) {
     }
 
     parser_read_char(p);
+    return parse_cmd_args(p, len);
+}
 
-    type = parse_cmd_type(p);
+static cmd parse_bin_cmd(parser* p) {
+    cmd cmd = {0};
+    uint64_t len = 1;
 
-    if (type == Illegal) {
+    if (bin_reader_peek(p->bin) == BinArray) {
+        if (bin_read_len(p->bin, BinArray, &len) == -1 || len == 0) {
+            return cmd;
+        }
+    }
+    return parse_cmd_args(p, len);
+}
+
+/* parses the len elements of a command, the name included, in either
+ * protocol */
+static cmd parse_cmd_args(parser* p, uint64_t len) {
+    cmd cmd = {0};
+    const cmd_spec* spec;
+    cmdt type;
+
+    spec = parse_arg_spec(p);
+    if (spec == NULL || len < spec->min_len || len > spec->max_len) {
         return cmd;
     }
+    type = spec->type;
 
     switch (type) {
     case Help: {
-        cmdt help_cmd = parse_bulk_string_cmd(p);
+        cmdt help_cmd;
+        cmd.type = Help;
+        if (len == 1) {
+            break;
+        }
+        help_cmd = parse_cmd_type(p);
         if (help_cmd == Illegal) {
+            cmd.type = Illegal;
             return cmd;
         }
-        cmd.type = Help;
         cmd.data.help.wants_cmd_help = 1;
         cmd.data.help.cmd_to_help = help_cmd;
     } break;
@@ -144,14 +455,11 @@ static cmd parse_array_cmd(parser* p) {
         object username;
         object password;
         auth_cmd auth = {0};
-        if (len != 3) {
-            return cmd;
-        }
-        username = parse_object(p);
+        username = parse_arg(p);
         if (username.type == Null) {
             return cmd;
         }
-        password = parse_object(p);
+        password = parse_arg(p);
         if (password.type == Null) {
             object_free(&username);
             return cmd;
@@ -165,14 +473,11 @@ static cmd parse_array_cmd(parser* p) {
         object key;
         object value;
         set_cmd set = {0};
-        if (len != 3) {
-            return cmd;
-        }
-        key = parse_object(p);
+        key = parse_arg(p);
         if (key.type == Null) {
             return cmd;
         }
-        value = parse_object(p);
+        value = parse_arg(p);
         if (value.type == Null) {
             object_free(&key);
             return cmd;
@@ -185,10 +490,7 @@ static cmd parse_array_cmd(parser* p) {
     case Get: {
         object key;
         get_cmd get = {0};
-        if (len != 2) {
-            return cmd;
-        }
-        key = parse_object(p);
+        key = parse_arg(p);
         if (key.type == Null) {
             return cmd;
         }
@@ -199,10 +501,7 @@ static cmd parse_array_cmd(parser* p) {
     case Del: {
         object key;
         del_cmd del = {0};
-        if (len != 2) {
-            return cmd;
-        }
-        key = parse_object(p);
+        key = parse_arg(p);
         if (key.type == Null) {
             return cmd;
         }
@@ -213,10 +512,7 @@ static cmd parse_array_cmd(parser* p) {
     case Push: {
         object value;
         push_cmd push = {0};
-        if (len != 2) {
-            return cmd;
-        }
-        value = parse_object(p);
+        value = parse_arg(p);
         if (value.type == Null) {
             return cmd;
         }
@@ -227,10 +523,7 @@ static cmd parse_array_cmd(parser* p) {
     case Enque: {
         object value;
         enque_cmd enque = {0};
-        if (len != 2) {
-            return cmd;
-        }
-        value = parse_object(p);
+        value = parse_arg(p);
         if (value.type == Null) {
             return cmd;
         }
@@ -241,10 +534,7 @@ static cmd parse_array_cmd(parser* p) {
     case ZSet: {
         object value;
         zset_cmd zset = {0};
-        if (len != 2) {
-            return cmd;
-        }
-        value = parse_object(p);
+        value = parse_arg(p);
         if (value.type == Null) {
             return cmd;
         }
@@ -255,10 +545,7 @@ static cmd parse_array_cmd(parser* p) {
     case ZHas: {
         object value;
         zhas_cmd zhas = {0};
-        if (len != 2) {
-            return cmd;
-        }
-        value = parse_object(p);
+        value = parse_arg(p);
         if (value.type == Null) {
             return cmd;
         }
@@ -269,10 +556,7 @@ static cmd parse_array_cmd(parser* p) {
     case ZDel: {
         object value;
         zdel_cmd zdel = {0};
-        if (len != 2) {
-            return cmd;
-        }
-        value = parse_object(p);
+        value = parse_arg(p);
         if (value.type == Null) {
             return cmd;
         }
@@ -283,10 +567,7 @@ static cmd parse_array_cmd(parser* p) {
     case Select: {
         object value;
         select_cmd select = {0};
-        if (len != 2) {
-            return cmd;
-        }
-        value = parse_object(p);
+        value = parse_arg(p);
         if (value.type != Int) {
             object_free(&value);
             return cmd;
@@ -295,7 +576,40 @@ static cmd parse_array_cmd(parser* p) {
         cmd.type = Select;
         cmd.data.select = select;
     } break;
+    case Hello: {
+        object version;
+        hello_cmd hello = {0};
+        version = parse_arg(p);
+        if (version.type != Int) {
+            object_free(&version);
+            return cmd;
+        }
+        hello.value = version;
+        cmd.type = Hello;
+        cmd.data.hello = hello;
+    } break;
+    case Bpop:
+    case Bdeque: {
+        object timeout;
+        block_cmd block = {0};
+        if (len == 2) {
+            timeout = parse_arg(p);
+            if (timeout.type != Int || timeout.data.num < 0) {
+                object_free(&timeout);
+                return cmd;
+            }
+            block.timeout = timeout.data.num;
+        }
+        cmd.type = type;
+        if (type == Bpop) {
+            cmd.data.bpop = block;
+        } else {
+            cmd.data.bdeque = block;
+        }
+    } break;
     default:
+        /* nothing follows the name */
+        cmd.type = type;
         break;
     }
 
@@ -303,39 +617,74 @@ static cmd parse_array_cmd(parser* p) {
 }
 
 static cmdt parse_cmd_type(parser* p) {
-    cmdt type = Illegal;
+    const cmd_spec* spec = parse_arg_spec(p);
+    return spec != NULL ? spec->type : Illegal;
+}
+
+static const cmd_spec* parse_arg_spec(parser* p) {
+    const uint8_t* name;
+    size_t name_len;
+    if (p->bin == NULL) {
+        return parse_cmd_spec(p);
+    }
+    if (bin_read_name(p->bin, &name, &name_len) == -1) {
+        return NULL;
+    }
+    return cmd_spec_lookup(name, name_len);
+}
+
+static object parse_arg(parser* p) {
+    if (p->bin == NULL) {
+        return parse_object(p);
+    }
+    return bin_read_object(p->bin);
+}
+
+/* matches a command name given as a bulk or simple string against the
+ * generated table, straight from the input. p is left after the name */
+static const cmd_spec* parse_cmd_spec(parser* p) {
+    size_t start;
+    uint64_t len;
+
     switch (p->ch) {
-    case '$': {
-        object obj = parse_object(p);
-        if (obj.type != String) {
-            return type;
+    case '$':
+        if (!expect_peek_byte_to_be_num(p)) {
+            return NULL;
         }
-        type = lookup_cmd(&obj.data.string);
-        object_free(&obj);
-    } break;
+        len = parse_len(p);
+        if (!cur_byte_is(p, '\r') || !expect_peek_byte(p, '\n')) {
+            return NULL;
+        }
+        start = p->pos;
+        /* a detached bulk string is far longer than any name */
+        if ((p->bulk != NULL && start == p->bulk_at) ||
+            len > p->input_len - start) {
+            parser_fail(p);
+            return NULL;
+        }
+        break;
     case '+':
-        type = parse_simple_string_cmd(p);
+        start = p->pos;
+        len = scan_cr(p->input + start, p->input_len - start);
         break;
     default:
-        break;
+        return NULL;
     }
-    return type;
+
+    p->pos = start + len;
+    parser_read_char(p);
+    if (!cur_byte_is(p, '\r') || !expect_peek_byte(p, '\n')) {
+        return NULL;
+    }
+    parser_read_char(p);
+    return cmd_spec_lookup(p->input + start, len);
 }
 
-static cmdt lookup_cmd(vstr* s) {
-    size_t i;
-    size_t s_len = vstr_len(s);
-    const char* s_data = vstr_data(s);
-    for (i = 0; i < lookup_len; ++i) {
-        cmdt_lookup l = lookup[i];
-        if (l.cmd_len != s_len) {
-            continue;
-        }
-        if (memcmp(s_data, l.cmd, s_len) == 0) {
-            return l.type;
-        }
+uint32_t cmd_flags(cmdt type) {
+    if ((size_t)type >= sizeof cmd_specs / sizeof cmd_specs[0]) {
+        return 0;
     }
-    return Illegal;
+    return cmd_specs[type].flags;
 }
 
 static object parse_object(parser* p) {
@@ -361,10 +710,8 @@ static object parse_object(parser* p) {
 
         s = parse_string(p, len);
 
-        if (!cur_byte_is(p, '\r')) {
-            return obj;
-        }
-        if (!expect_peek_byte(p, '\n')) {
+        if (!cur_byte_is(p, '\r') || !expect_peek_byte(p, '\n')) {
+            vstr_free(&s);
             return obj;
         }
         obj = object_new(String, &s);
@@ -493,36 +840,48 @@ static object parse_object(parser* p) {
     return obj;
 }
 
+/* p->ch is the first byte of the string. The whole string is copied at once,
+ * and p is left on the byte after it */
 static vstr parse_string(parser* p, uint64_t len) {
-    size_t i;
-    vstr s = vstr_new_len(len + 1);
-    for (i = 0; i < len; ++i) {
-        vstr_push_char(&s, p->ch);
-        parser_read_char(p);
+    size_t start = p->pos - 1;
+    vstr s;
+
+    /* the contents are in p->bulk, and p->ch is already the \r after them */
+    if (p->bulk != NULL && start == p->bulk_at && vstr_len(p->bulk) == len) {
+        s = *(p->bulk);
+        *(p->bulk) = vstr_new();
+        p->bulk = NULL;
+        return s;
     }
 
+    if (p->ch == 0 && p->pos >= p->input_len) {
+        start = p->input_len;
+    }
+    /* a truncated string leaves p at the end of input, where the caller's
+     * check for the \r after it fails */
+    if (len > p->input_len - start) {
+        len = p->input_len - start;
+    }
+
+    s = vstr_from_len((const char*)p->input + start, len);
+    p->pos = start + len;
+    parser_read_char(p);
     return s;
 }
 
-static cmdt parse_bulk_string_cmd(parser* p) { return parse_cmd_type(p); }
-
-static cmdt parse_simple_string_cmd(parser* p) {
-    cmdt type = Illegal;
-    vstr s = vstr_new_len(5);
-    s = parse_simple_string(p);
+/* copies everything up to the next \r, starting after p->ch. p is left on the
+ * \r, or at the end of input if there is none */
+static vstr parse_line(parser* p) {
+    const uint8_t* start = p->input + p->pos;
+    size_t len = scan_cr(start, p->input_len - p->pos);
+    vstr s = vstr_from_len((const char*)start, len);
+    p->pos += len;
     parser_read_char(p);
-    type = lookup_cmd(&s);
-    vstr_free(&s);
-    return type;
+    return s;
 }
 
 static vstr parse_simple_string(parser* p) {
-    vstr s = vstr_new_len(5);
-    parser_read_char(p);
-    while (p->ch != '\r' && p->ch != 0) {
-        vstr_push_char(&s, p->ch);
-        parser_read_char(p);
-    }
+    vstr s = parse_line(p);
     if (!cur_byte_is(p, '\r')) {
         vstr_free(&s);
         return s;
@@ -535,12 +894,7 @@ static vstr parse_simple_string(parser* p) {
 }
 
 static vstr parse_error(parser* p) {
-    vstr s = vstr_new();
-    parser_read_char(p);
-    while (p->ch != '\r' && p->ch != 0) {
-        vstr_push_char(&s, p->ch);
-        parser_read_char(p);
-    }
+    vstr s = parse_line(p);
     if (!cur_byte_is(p, '\r')) {
         vstr_free(&s);
         return s;
@@ -552,43 +906,152 @@ static vstr parse_error(parser* p) {
     return s;
 }
 
+/* p->ch is the ':'. A value that does not fit in an int64 fails the
+ * caller's check for the \r after it */
 static int64_t parse_integer(parser* p) {
-    int64_t res;
-    vstr int_str = vstr_new();
-    char* end_ptr = NULL;
-    const char* int_str_s;
+    int negative = 0;
+    uint64_t mag = 0;
+    size_t start, n;
+
     parser_read_char(p);
-    while (p->ch != '\r' && p->ch != 0) {
-        vstr_push_char(&int_str, p->ch);
+    if (p->ch == '-' || p->ch == '+') {
+        negative = p->ch == '-';
         parser_read_char(p);
     }
-    int_str_s = vstr_data(&int_str);
-    res = strtold(int_str_s, &end_ptr);
-    vstr_free(&int_str);
-    return res;
+
+    start = p->pos - 1;
+    n = scan_digits(p->input + start, p->input_len - start, &mag);
+    if (n == 0 || n > SCAN_DIGITS_MAX ||
+        mag > ((uint64_t)INT64_MAX) + negative) {
+        parser_fail(p);
+        return 0;
+    }
+
+    p->pos = start + n;
+    parser_read_char(p);
+    if (negative) {
+        return mag == 0 ? 0 : -((int64_t)(mag - 1)) - 1;
+    }
+    return mag;
 }
 
+/* p->ch is the ','. Anything that is not a whole double up to the \r fails
+ * the parser */
 static double parse_double(parser* p) {
-    double res = 0;
-    vstr number_string = vstr_new();
+    const uint8_t* start = p->input + p->pos;
+    size_t len = scan_cr(start, p->input_len - p->pos);
+    char buf[DOUBLE_BUF_LEN];
     char* end_ptr = NULL;
-    const char* num_str;
-    parser_read_char(p);
-    while (p->ch != '\r') {
-        vstr_push_char(&number_string, p->ch);
+    double res;
+
+    if (parse_double_fast(start, len, &res)) {
+        p->pos += len;
         parser_read_char(p);
+        return res;
+    }
+
+    /* strtod needs a terminated string. A copy on the stack does, since
+     * the input is not */
+    if (len == 0 || len >= sizeof buf) {
+        parser_fail(p);
+        return 0;
+    }
+    memcpy(buf, start, len);
+    buf[len] = '\0';
+    res = strtod(buf, &end_ptr);
+    if (end_ptr != buf + len) {
+        parser_fail(p);
+        return 0;
     }
-    num_str = vstr_data(&number_string);
-    res = strtod(num_str, &end_ptr);
+
+    p->pos += len;
+    parser_read_char(p);
     return res;
 }
 
+/* a decimal with at most 53 bits worth of digits and a power of 10 that is
+ * exact as a double converts with one correctly rounded multiply or divide.
+ * returns 0 for everything else, like inf, nan or too many digits, which is
+ * left to strtod */
+static int parse_double_fast(const uint8_t* s, size_t len, double* out) {
+    uint64_t mantissa = 0, frac = 0, exp = 0;
+    int64_t exp10 = 0;
+    size_t pos = 0, n, digits;
+    int negative = 0, exp_negative = 0;
+    double res;
+
+    /* with extra precision the multiply would round twice */
+    if (FLT_EVAL_METHOD != 0) {
+        return 0;
+    }
+
+    if (pos < len && (s[pos] == '-' || s[pos] == '+')) {
+        negative = s[pos] == '-';
+        pos++;
+    }
+
+    digits = scan_digits(s + pos, len - pos, &mantissa);
+    if (digits > SCAN_DIGITS_MAX) {
+        return 0;
+    }
+    pos += digits;
+
+    if (pos < len && s[pos] == '.') {
+        pos++;
+        n = scan_digits(s + pos, len - pos, &frac);
+        if (digits + n > SCAN_DIGITS_MAX) {
+            return 0;
+        }
+        mantissa = (mantissa * powers_of_10[n]) + frac;
+        exp10 = -(int64_t)n;
+        digits += n;
+        pos += n;
+    }
+
+    if (digits == 0) {
+        return 0;
+    }
+
+    if (pos < len && (s[pos] == 'e' || s[pos] == 'E')) {
+        pos++;
+        if (pos < len && (s[pos] == '-' || s[pos] == '+')) {
+            exp_negative = s[pos] == '-';
+            pos++;
+        }
+        n = scan_digits(s + pos, len - pos, &exp);
+        if (n == 0 || n > 3) {
+            return 0;
+        }
+        exp10 += exp_negative ? -(int64_t)exp : (int64_t)exp;
+        pos += n;
+    }
+
+    if (pos != len || mantissa > DOUBLE_MANTISSA_MAX ||
+        exp10 < -EXACT_POW10_MAX || exp10 > EXACT_POW10_MAX) {
+        return 0;
+    }
+
+    res = (double)mantissa;
+    if (exp10 < 0) {
+        res /= exact_powers_of_10[-exp10];
+    } else {
+        res *= exact_powers_of_10[exp10];
+    }
+    *out = negative ? -res : res;
+    return 1;
+}
+
+/* p->ch is the first digit. A length too long for a uint64 leaves p on a
+ * digit, where the caller's check for the \r fails */
 static uint64_t parse_len(parser* p) {
+    size_t start = p->pos - 1;
     uint64_t res = 0;
-    while (isdigit(p->ch)) {
-        res = (res * 10) + (p->ch - '0');
-        parser_read_char(p);
+    size_t n = scan_digits(p->input + start, p->input_len - start, &res);
+    if (n > SCAN_DIGITS_MAX) {
+        return 0;
     }
+    p->pos = start + n;
+    parser_read_char(p);
     return res;
 }
 
@@ -633,6 +1096,12 @@ static uint8_t peek_byte(parser* p) {
     return p->input[p->pos];
 }
 
+/* moves p to the end of the input, so whatever check comes next fails */
+static void parser_fail(parser* p) {
+    p->pos = p->input_len;
+    p->ch = 0;
+}
+
 static int parser_object_cmp(void* a, void* b) { return object_cmp(a, b); }
 
 static void parser_free_object(void* ptr) { object_free(ptr); }
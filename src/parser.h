@@ -3,10 +3,54 @@
 #define __PARSER_H__
 
 #include "cmd.h"
+#include "vstr.h"
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
+
+#define FRAME_MAX_LEN (512 * 1024 * 1024)
+
+typedef enum {
+    FrameType,
+    FrameLen,
+    FrameLine,
+    FrameLineEnd,
+    FrameBulk,
+    FrameBulkCr,
+    FrameBulkLf,
+} frame_state;
+
+/* progress through a frame that has only partially been received. It is
+ * kept between reads so that each read only scans the bytes that are new */
+typedef struct {
+    frame_state state;
+    uint8_t type;            /* the type byte of the value being scanned */
+    int has_digits;          /* whether the length being scanned has digits */
+    size_t pos;              /* bytes of the frame scanned so far */
+    uint64_t pending;        /* values still needed to complete the frame */
+    uint64_t len;            /* the length being scanned */
+    uint64_t bulk_remaining; /* bytes of the bulk string left to skip */
+} frame_parser;
 
 cmd parse(const uint8_t* input, size_t input_len);
+cmd parse_with_bulk(const uint8_t* input, size_t input_len, vstr* bulk,
+                    size_t bulk_at);
+cmd parse_bin(const uint8_t* input, size_t input_len);
+cmd parse_bin_with_bulk(const uint8_t* input, size_t input_len, vstr* bulk,
+                        size_t bulk_at);
+frame_parser frame_parser_new(void);
+ssize_t frame_parser_feed(frame_parser* fp, const uint8_t* input,
+                          size_t input_len);
+ssize_t bin_frame_parser_feed(frame_parser* fp, const uint8_t* input,
+                              size_t input_len);
+size_t frame_parser_detach_bulk(frame_parser* fp);
+void frame_parser_skip_bulk(frame_parser* fp, size_t len);
+ssize_t parse_frame_len(const uint8_t* input, size_t input_len);
 object parse_from_server(const uint8_t* input, size_t input_len);
+/**
+ * @brief the CMD_ flags of a command, as set in cmds/
+ * @param type the command
+ */
+uint32_t cmd_flags(cmdt type);
 
 #endif /* __PARSER_H__ */
@@ -0,0 +1,51 @@
+#ifndef __PROTO_H__
+
+#define __PROTO_H__
+
+#include <stdint.h>
+
+/* the protocols a connection can speak, switched between with HELLO */
+#define PROTO_RESP 1 /* the text protocol every connection starts with */
+#define PROTO_BIN 2  /* the binary protocol */
+
+/* the binary protocol. Every value is a type byte followed by a fixed size
+ * header, and strings are followed by their contents. Lengths and counts are
+ * uint32, integers int64 and doubles IEEE 754 binary64, all little endian.
+ * Nothing is terminated, so a value is read without scanning for its end */
+typedef enum {
+    BinNull = 0,   /* no header */
+    BinString = 1, /* the length, then the contents */
+    BinSimple = 2, /* a status such as OK, laid out like a string */
+    BinErr = 3,    /* an error, laid out like a string */
+    BinInt = 4,    /* the value */
+    BinDouble = 5, /* the value */
+    BinBool = 6,   /* one byte, 0 or 1 */
+    BinArray = 7,  /* the count, then that many values */
+    BinHt = 8,     /* the count, then that many keys each followed by a value */
+} bin_type;
+
+#define BIN_LEN_MAX UINT32_MAX
+
+static inline void bin_put_u32(uint8_t* buf, uint32_t val) {
+    buf[0] = val;
+    buf[1] = val >> 8;
+    buf[2] = val >> 16;
+    buf[3] = val >> 24;
+}
+
+static inline void bin_put_u64(uint8_t* buf, uint64_t val) {
+    bin_put_u32(buf, val);
+    bin_put_u32(buf + 4, val >> 32);
+}
+
+static inline uint32_t bin_get_u32(const uint8_t* buf) {
+    return ((uint32_t)buf[0]) | ((uint32_t)buf[1] << 8) |
+           ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static inline uint64_t bin_get_u64(const uint8_t* buf) {
+    return ((uint64_t)bin_get_u32(buf)) |
+           ((uint64_t)bin_get_u32(buf + 4) << 32);
+}
+
+#endif /* __PROTO_H__ */
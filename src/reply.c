@@ -6,3 +6,5 @@ err_reply_init(bad_auth, "EBADAUTH", 8);
 err_reply_init(invalid_key, "EINVKEY", 7);
 err_reply_init(oom, "EOOM", 4);
 err_reply_init(dbrange, "EDBRANGE", 8);
+err_reply_init(maxclients, "EMAXCLIENTS", 11);
+err_reply_init(proto, "EPROTO", 6);
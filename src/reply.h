@@ -33,4 +33,10 @@ err_reply_def(oom);
 err_reply_t(dbrange);
 err_reply_def(dbrange);
 
+err_reply_t(maxclients);
+err_reply_def(maxclients);
+
+err_reply_t(proto);
+err_reply_def(proto);
+
 #endif /* __REPLY_H__ */
@@ -0,0 +1,69 @@
+#include "scan.h"
+#include <memory.h>
+
+size_t scan_cr(const uint8_t* s, size_t len) {
+    /* libc already picks a vectorized memchr for the cpu it runs on */
+    const uint8_t* cr = memchr(s, '\r', len);
+    return cr != NULL ? (size_t)(cr - s) : len;
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SCAN_SWAR 1
+#endif
+
+#ifdef SCAN_SWAR
+
+/* whether the 8 bytes of chunk are all ascii digits. Adding 6 carries a digit
+ * into the next 16, so both nibble checks pass only for '0' to '9' */
+static int scan_is_eight_digits(uint64_t chunk) {
+    return ((chunk & 0xF0F0F0F0F0F0F0F0ULL) |
+            (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >>
+             4)) == 0x3333333333333333ULL;
+}
+
+/* converts 8 ascii digits at once, pairing them up into 4 two digit numbers,
+ * then 2 four digit numbers, then one */
+static uint64_t scan_eight_digits(uint64_t chunk) {
+    chunk -= 0x3030303030303030ULL;
+    chunk = (chunk * 10) + (chunk >> 8);
+    chunk =
+        (((chunk & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+         (((chunk >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >>
+        32;
+    return chunk;
+}
+
+#endif
+
+/* takes long runs 8 digits at a time. Short ones, which is nearly every
+ * length on the wire, cost one extra comparison */
+size_t scan_digits(const uint8_t* s, size_t len, uint64_t* val) {
+    uint64_t res = 0;
+    size_t n = 0;
+
+#ifdef SCAN_SWAR
+    while (n + 8 <= len) {
+        uint64_t chunk;
+        memcpy(&chunk, s + n, sizeof chunk);
+        if (!scan_is_eight_digits(chunk)) {
+            break;
+        }
+        if (n + 8 > SCAN_DIGITS_MAX) {
+            return SCAN_DIGITS_MAX + 1;
+        }
+        res = (res * 100000000) + scan_eight_digits(chunk);
+        n += 8;
+    }
+#endif
+
+    for (; n < len && s[n] >= '0' && s[n] <= '9'; ++n) {
+        if (n == SCAN_DIGITS_MAX) {
+            return SCAN_DIGITS_MAX + 1;
+        }
+        res = (res * 10) + (s[n] - '0');
+    }
+
+    *val = res;
+    return n;
+}
+
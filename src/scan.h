@@ -0,0 +1,28 @@
+#ifndef __SCAN_H__
+
+#define __SCAN_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* the most digits scan_digits converts, as many as always fit in a uint64 */
+#define SCAN_DIGITS_MAX 19
+
+/**
+ * @brief find the first \r
+ * @param s the bytes to search
+ * @param len the number of bytes to search
+ * @returns the offset of the \r, or len if there is none
+ */
+size_t scan_cr(const uint8_t* s, size_t len);
+/**
+ * @brief count and convert the run of ascii digits at the start of s
+ * @param s the bytes to scan
+ * @param len the number of bytes to scan
+ * @param val set to the value of the digits
+ * @returns the number of digits. A run of more than SCAN_DIGITS_MAX digits
+ * returns SCAN_DIGITS_MAX + 1, and val is not set
+ */
+size_t scan_digits(const uint8_t* s, size_t len, uint64_t* val);
+
+#endif /* __SCAN_H__ */
@@ -7,32 +7,136 @@
 #include "config_parser.h"
 #include "ev.h"
 #include "ht.h"
+#include "io_threads.h"
 #include "log.h"
+#include "mpsc_queue.h"
 #include "networking.h"
 #include "object.h"
+#include "outbuf.h"
 #include "parser.h"
+#include "proto.h"
 #include "reply.h"
 #include "result.h"
 #include "set.h"
+#include "shm_ring.h"
+#include "siphash.h"
 #include "util.h"
 #include "vec.h"
 #include "vstr.h"
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <unistd.h>
 
 #define DEFAULT_ADDRESS "127.0.0.1"
 #define DEFAULT_PORT 6969
 #define DEFAULT_DATABASES 16
-#define SERVER_BACKLOG 10
+#define DEFAULT_MAX_CLIENTS 10000
+#define DEFAULT_BACKLOG 511
+#define DEFAULT_OUTPUT_LIMIT_HARD (512 * 1024 * 1024)
+#define DEFAULT_OUTPUT_LIMIT_SOFT (64 * 1024 * 1024)
+#define SERVER_INITIAL_NUM_FDS 1024
+#define SERVER_RESERVED_FDS 32
 #define CLIENT_READ_BUF_CAP 4096
+#define READ_BUF_POOL_MAX 256
+#define CLIENT_BULK_DETACH_MIN (64 * 1024)
+#define REPLY_REF_MIN (64 * 1024)
+#define KEYS_STREAM_CHUNK (64 * 1024)
+#define CLIENTS_INITIAL_CAP 64
+#define IO_THREADS_MAX 128
+#define REACTORS_MAX 128
+#define SERVER_CRON_INTERVAL_MS 100
 
 typedef client* client_ptr;
 
+typedef enum {
+    ReactorRequest, /* a command to run against the receiver's shard */
+    ReactorReply,   /* the reply to a request, sent back to its origin */
+    ReactorStop,    /* makes the receiver's event loop return */
+    ReactorUnblock, /* the client of a parked BPOP or BDEQUE went away */
+} reactor_msg_type;
+
+/* the messages reactors send each other through their inboxes. A request is
+ * turned into its reply by the receiver and sent back to the sender, so one
+ * allocation makes the whole round trip */
+typedef struct {
+    mpsc_node node; /* must be first */
+    reactor_msg_type type;
+    size_t from;         /* the reactor that sent the request */
+    int fd;              /* the client the request came from */
+    uint64_t client_id;  /* guards against the fd being reused */
+    size_t database_num; /* the database the client has selected */
+    int proto;           /* the protocol the client is replied to in */
+    int gather;          /* part of a KEYS sent to every reactor */
+    cmd cmd;
+    builder reply;
+} reactor_msg;
+
+typedef struct reactor {
+    server* s;         /* the server state this event loop runs with */
+    pthread_t thread;  /* unused for reactor 0, which is the main thread */
+    mpsc_queue inbox;  /* messages from the other reactors */
+    int wake_fds[2];   /* pipe that wakes the event loop for its inbox */
+    int wake_pending;  /* set while a wake up byte is unread */
+} reactor;
+
+/* a client parked in BPOP or BDEQUE until there is an element for it. With
+ * reactors, a client of another reactor is parked on reactor 0, which owns
+ * every vec and queue, as the request it forwarded */
+typedef struct blocked {
+    struct blocked* prev;
+    struct blocked* next;
+    server* s;          /* the server it is parked in */
+    blocked_list* list; /* the list it waits in */
+    int fd;             /* the waiting client */
+    uint64_t client_id; /* guards against the fd being reused */
+    reactor_msg* msg;   /* the forwarded request, NULL for a local client */
+    long long timer_id; /* the timeout, -1 if it waits forever */
+} blocked;
+
+/* a client that has switched from its unix socket to shared memory. The
+ * socket stays open only so we notice when the client goes away */
+typedef struct client_shm {
+    shm_ring ring;
+    server* s;
+    client* c;
+} client_shm;
+
+/* the encoded RESP reply to GET of a db_value */
+typedef struct reply_cache {
+    size_t len;
+    uint8_t data[];
+} reply_cache;
+
+/* the contents of a string of at least REPLY_REF_MIN bytes, which GET
+ * writes from where they are stored instead of copying them. The dict holds
+ * one reference and every output buffer the contents are queued in another,
+ * so they outlive an overwrite or delete until the last one is written.
+ * Replies are written by io threads, so refs is changed atomically */
+typedef struct shared_str {
+    size_t refs;
+    vstr str; /* the same buffer as the string in the dict */
+} shared_str;
+
+/* a reply to KEYS that is encoded a chunk at a time, as the client takes it.
+ * It holds exactly the keys there were when KEYS ran: keys added since have a
+ * newer gen and are skipped, and a key deleted before the scan reached it is
+ * added to the reply as it is deleted */
+typedef struct keys_stream {
+    struct keys_stream* prev;
+    struct keys_stream* next;
+    client* c;
+    lexidb* db;
+    uint64_t gen;          /* keys with a newer gen were added after KEYS */
+    ht_scan_cursor cursor; /* where the scan of the dict resumes */
+    size_t left;           /* the keys the reply still needs */
+} keys_stream;
+
 result_t(server, vstr);
 result_t(client_ptr, vstr);
 result_t(object, void*);
@@ -49,18 +153,85 @@ static lexidb* lexidb_new(size_t num_databases);
 static void server_free(server* s);
 static void lexidb_free(lexidb* db, size_t num_databases);
 
+static int server_listen_unix(server* s);
 static void server_accept(ev* ev, int fd, void* client_data, int mask);
 static void read_from_client(ev* ev, int fd, void* client_data, int mask);
+static void read_from_unix_client(ev* ev, int fd, void* client_data,
+                                  int mask);
+static void read_from_shm_client(ev* ev, int fd, void* client_data, int mask);
+static void shm_client_hangup(ev* ev, int fd, void* client_data, int mask);
 static void write_to_client(ev* ev, int fd, void* client_data, int mask);
+static void handle_pending_clients(ev* ev, void* data);
+static void io_thread_read(void* item);
+static void io_thread_write(void* item);
+static void reactor_wake(ev* ev, int fd, void* client_data, int mask);
+static int server_start_cron(server* s);
+static long long server_cron(ev* ev, long long id, void* data);
+static void server_sample_ops(server* s);
+static uint64_t server_ops_per_sec(server* s);
 
 static result(client_ptr) create_client(int fd, uint32_t addr, uint16_t port);
-
-static void execute_cmd(server* s, client* c);
+static int server_add_client(server* s, client* c);
+static void server_close_client(server* s, client* c);
+static int client_read(client* c);
+static int client_read_shm(client* c);
+static int client_upgrade_shm(server* s, client* c, const int* fds);
+static uint8_t* client_read_dst(client* c, size_t* avail);
+static void client_read_advance(client* c, size_t amt);
+static int client_parse_cmds(client* c);
+static int client_detach_bulk(client* c, size_t offset);
+static int client_read_done(server* s, client* c);
+static int client_buffer_reply(client* c);
+static int client_has_output(client* c);
+static void client_release_builders(client* c);
+static size_t client_output_len(client* c);
+static const output_limit* client_output_limit(server* s, client* c);
+static int client_check_output(server* s, client* c);
+static int client_resume_reads(server* s, client* c);
+static int client_cmds_runnable(client* c);
+static int client_write(client* c);
+static int client_write_shm(client* c);
+
+static int reply_to_client(server* s, client* c);
+static void client_wait_writable(server* s, client* c);
+static void execute_client_cmds(server* s, client* c);
+static int server_start_reactors(server* s);
+static void server_stop_reactors(server* s, size_t num_started);
+static int create_reactor_socket(server* s);
+static void* reactor_main(void* arg);
+static void reactor_send(server* s, size_t to, reactor_msg* msg);
+static reactor_msg* reactor_msg_new(client* c, cmd cmd);
+static void reactor_msg_free(reactor_msg* msg);
+static int reactor_forward_cmd(server* s, client* c, cmd cmd);
+static size_t reactor_for_key(server* s, const object* key);
+static void reactor_execute(server* s, reactor_msg* msg);
+static void reactor_reply(server* s, reactor_msg* msg);
+static void reactor_unblock(server* s, reactor_msg* msg);
+static void client_gather(client* c, builder* reply);
+static void execute_cmd(server* s, client* c, cmd cmd);
+static int execute_block_command(server* s, client* c, cmd* cmd,
+                                 reactor_msg* msg);
+static int client_block(server* s, client* c, blocked_list* list,
+                        int64_t timeout, reactor_msg* msg);
+static void blocked_unlink(server* s, blocked* b);
+static void blocked_wake(server* s, blocked* b, object* value);
+static long long blocked_timeout(ev* ev, long long id, void* data);
+static long long server_run_unblocked(ev* ev, long long id, void* data);
+static void server_resume_unblocked(server* s);
+static void server_free_blocked(server* s);
 static int execute_auth_command(server* s, client* client, auth_cmd* auth);
 static ht_result execute_set_command(server* s, set_cmd* set,
                                      size_t database_num);
-static object* execute_get_command(server* s, get_cmd* get,
-                                   size_t database_num);
+static db_value* execute_get_command(server* s, get_cmd* get,
+                                     size_t database_num);
+static int server_add_db_value(server* s, builder* b, db_value* val);
+static int client_add_shared_str(client* c, db_value* val);
+static void shared_str_release(void* ptr);
+static int keys_stream_start(client* c, lexidb* db);
+static void keys_stream_next(client* c);
+static void keys_stream_add(ht_entry* e, void* arg);
+static void keys_stream_end(keys_stream* ks);
+static void keys_stream_deleted(lexidb* db, object* key);
 static ht_result execute_del_command(server* s, del_cmd* del,
                                      size_t database_num);
 static int execute_push_command(server* s, push_cmd* push, size_t database_num);
@@ -76,18 +247,21 @@ static set_result execute_zdel_command(server* s, zdel_cmd* zdel,
                                        size_t database_num);
 
 static result(log_level) determine_loglevel(vstr* loglevel_s);
+static size_t adjust_open_files_limit(size_t max_clients);
 
+static int client_take_read_buf(server* s, client* c);
+static void client_return_read_buf(server* s, client* c);
 static int realloc_client_read_buf(client* c);
 
 static int server_compare_objects(void* a, void* b);
-static int client_compare(void* fdp, void* clientp);
 static int user_compare(void* a, void* b);
 static int user_compare_by_username(void* a, void* b);
+static int client_ptr_compare(void* a, void* b);
 
 static void cmd_free(cmd* cmd);
 static void client_free(client* client);
 static void server_free_object(void* ptr);
-static void client_in_vec_free(void* ptr);
+static void server_free_db_value(void* ptr);
 static void user_in_vec_free(void* ptr);
 
 const log_level_lookup log_level_lookups[] = {
@@ -181,12 +355,68 @@ int server_run(int argc, char* argv[]) {
 
     s = rs.data.ok;
 
+    /* registered here rather than in server_new so that server_accept gets a
+     * pointer to the server that outlives server_new's stack frame */
+    if (ev_add_event(s.ev, s.sfd, EV_READ, server_accept, &s) == -1) {
+        error("failed to add server accept as event_fn to ev (errno: %d) %s\n",
+              errno, strerror(errno));
+        server_free(&s);
+        return 1;
+    }
+
+    if (vstr_len(&s.unixsocket) != 0 && server_listen_unix(&s) == -1) {
+        error("failed to listen on unix socket %s (errno: %d) %s\n",
+              vstr_data(&s.unixsocket), errno, strerror(errno));
+        server_free(&s);
+        return 1;
+    }
+
+    if (s.num_io_threads > 1) {
+        s.io_threads = io_threads_new(s.num_io_threads);
+        s.pending_reads = vec_new(sizeof(client*));
+        s.pending_writes = vec_new(sizeof(client*));
+        if (s.io_threads == NULL || s.pending_reads == NULL ||
+            s.pending_writes == NULL) {
+            error("failed to start io threads\n");
+            server_free(&s);
+            return 1;
+        }
+        s.num_io_threads = io_threads_len(s.io_threads);
+        ev_set_before_poll(s.ev, handle_pending_clients, &s);
+    }
+
+    if (server_start_cron(&s) == -1) {
+        error("failed to start server cron\n");
+        server_free(&s);
+        return 1;
+    }
+
+    if (s.num_reactors > 1 && server_start_reactors(&s) == -1) {
+        error("failed to start reactors (errno: %d) %s\n", errno,
+              strerror(errno));
+        server_free(&s);
+        return 1;
+    }
+
     if (s.log_level >= Info) {
         info("listening on %s:%u\n", vstr_data(&s.addr), s.port);
+        if (s.unix_sfd != -1) {
+            info("listening on %s\n", vstr_data(&s.unixsocket));
+        }
+        if (s.num_io_threads > 1) {
+            info("using %lu io threads\n", s.num_io_threads);
+        }
+        if (s.num_reactors > 1) {
+            info("using %lu reactors\n", s.num_reactors);
+        }
     }
 
     ev_await(s.ev);
 
+    if (s.reactors != NULL) {
+        server_stop_reactors(&s, s.num_reactors);
+    }
+
     if (s.log_level >= Info) {
         info("server shutting down\n");
     }
@@ -208,6 +438,7 @@ static result(server) server_new(vstr* conf_file_path) {
     int add_users_res;
     uint16_t port;
     const char* addr;
+    size_t i;
 
     sfd = create_tcp_socket(1);
     if (sfd < 0) {
@@ -274,6 +505,16 @@ static result(server) server_new(vstr* conf_file_path) {
         s.log_level = res_ll.data.ok;
     }
 
+    /* every reactor binds its own socket to the same address */
+    if (config.reactors > 1 && set_reuse_port(sfd) == -1) {
+        result.type = Err;
+        result.data.err =
+            vstr_format("failed to set reuse port on socket (errno %d) %s",
+                        errno, strerror(errno));
+        close(sfd);
+        return result;
+    }
+
     if (tcp_bind(sfd, addr, port) < 0) {
         result.type = Err;
         result.data.err = vstr_format("failed to bind socket (errno: %d) %s",
@@ -282,7 +523,35 @@ static result(server) server_new(vstr* conf_file_path) {
         return result;
     }
 
-    if (tcp_listen(sfd, SERVER_BACKLOG) < 0) {
+    s.max_clients =
+        config.max_clients == 0 ? DEFAULT_MAX_CLIENTS : config.max_clients;
+    s.backlog = config.backlog == 0 ? DEFAULT_BACKLOG : config.backlog;
+    for (i = 0; i < CLIENT_CLASSES; ++i) {
+        if (config.output_limits_set[i]) {
+            s.output_limits[i] = config.output_limits[i];
+        } else {
+            s.output_limits[i].hard = DEFAULT_OUTPUT_LIMIT_HARD;
+            s.output_limits[i].soft = DEFAULT_OUTPUT_LIMIT_SOFT;
+        }
+    }
+    s.num_io_threads = config.io_threads == 0 ? 1 : config.io_threads;
+    if (s.num_io_threads > IO_THREADS_MAX) {
+        warn("io-threads (%lu) is more than the max, using %d\n",
+             s.num_io_threads, IO_THREADS_MAX);
+        s.num_io_threads = IO_THREADS_MAX;
+    }
+    s.num_reactors = config.reactors == 0 ? 1 : config.reactors;
+    if (s.num_reactors > REACTORS_MAX) {
+        warn("reactors (%lu) is more than the max, using %d\n",
+             s.num_reactors, REACTORS_MAX);
+        s.num_reactors = REACTORS_MAX;
+    }
+    if (s.num_reactors > 1 && s.num_io_threads > 1) {
+        warn("io-threads can not be combined with reactors, ignoring it\n");
+        s.num_io_threads = 1;
+    }
+
+    if (tcp_listen(sfd, s.backlog) < 0) {
         result.type = Err;
         result.data.err =
             vstr_format("failed to listen on socket (errno: %d) %s", errno,
@@ -317,8 +586,18 @@ static result(server) server_new(vstr* conf_file_path) {
         s.num_databases = config.databases;
     }
 
+    /* bound in server_run, once the server has its final address */
+    s.unix_sfd = -1;
+    s.unixsocket = config.unixsocket;
+    config.unixsocket = vstr_new();
+
+    s.reply_cache = config.reply_cache;
+    s.io_uring = config.io_uring;
+
     config_free_light(&config);
 
+    s.max_clients = adjust_open_files_limit(s.max_clients);
+
     s.executable_path = get_execuable_path();
     if (s.executable_path == NULL) {
         result.type = Err;
@@ -337,10 +616,10 @@ static result(server) server_new(vstr* conf_file_path) {
     s.addr = addr_str;
     s.port = port;
 
-    s.clients = vec_new(sizeof(client*));
+    s.clients = calloc(CLIENTS_INITIAL_CAP, sizeof(client*));
     if (s.clients == NULL) {
         result.type = Err;
-        result.data.err = vstr_from("failed to allocate for client vec");
+        result.data.err = vstr_from("failed to allocate for client table");
         vstr_free(&s.conf_file_path);
         free(s.executable_path);
         vec_free(s.users, user_in_vec_free);
@@ -348,11 +627,11 @@ static result(server) server_new(vstr* conf_file_path) {
         return result;
     }
 
-    ev = ev_new(SERVER_BACKLOG);
+    ev = ev_new(SERVER_INITIAL_NUM_FDS, s.io_uring ? EV_OPT_URING : 0);
     if (ev == NULL) {
         result.type = Err;
         result.data.err = vstr_from("failed to allocate memory for ev");
-        vec_free(s.clients, client_in_vec_free);
+        free(s.clients);
         free(s.executable_path);
         vstr_free(&s.conf_file_path);
         vec_free(s.users, user_in_vec_free);
@@ -360,28 +639,18 @@ static result(server) server_new(vstr* conf_file_path) {
         return result;
     }
 
-    if (ev_add_event(ev, sfd, EV_READ, server_accept, &s) == -1) {
-        result.type = Err;
-        result.data.err = vstr_format(
-            "failed to add server accept as event_fn to ev (errno: %d) %s",
-            errno, strerror(errno));
-        vstr_free(&s.conf_file_path);
-        vec_free(s.clients, client_in_vec_free);
-        ev_free(ev);
-        vec_free(s.users, user_in_vec_free);
-        free(s.executable_path);
-        close(sfd);
-        return result;
-    }
+    s.clients_cap = CLIENTS_INITIAL_CAP;
 
     s.help_cmds = init_all_cmd_helps();
     s.help_cmds_len = get_all_cmd_helps_len();
 
+    get_random_bytes(s.shard_seed, HT_SEED_SIZE);
     s.start_time = get_time();
     s.pid = getpid();
     s.sfd = sfd;
     s.db = lexidb_new(s.num_databases);
     s.ev = ev;
+    s.unblock_id = -1;
     result.type = Ok;
     result.data.ok = s;
     return result;
@@ -392,7 +661,7 @@ static lexidb* lexidb_new(size_t num_databases) {
     size_t i;
     assert(res != NULL);
     for (i = 0; i < num_databases; ++i) {
-        res[i].dict = ht_new(sizeof(object), server_compare_objects);
+        res[i].dict = ht_new(sizeof(db_value), server_compare_objects);
         res[i].vec = vec_new(sizeof(object));
         assert(res[i].vec != NULL);
         res[i].queue = queue_new(sizeof(object));
@@ -426,22 +695,52 @@ static int add_users(vec** users_vec, vec* users_from_config) {
 }
 
 static void server_free(server* s) {
-    free(s->executable_path);
+    size_t i;
     ev_free(s->ev);
+    server_free_blocked(s);
     lexidb_free(s->db, s->num_databases);
-    vec_free(s->clients, client_in_vec_free);
+    for (i = 0; i < s->clients_cap; ++i) {
+        if (s->clients[i] != NULL) {
+            client_free(s->clients[i]);
+        }
+    }
+    free(s->clients);
+    while (s->read_bufs != NULL) {
+        uint8_t* buf = s->read_bufs;
+        memcpy(&(s->read_bufs), buf, sizeof(uint8_t*));
+        free(buf);
+    }
+    close(s->sfd);
+    /* everything else is shared with reactor 0 */
+    if (s->reactor_id != 0) {
+        return;
+    }
+    free(s->executable_path);
+    if (s->io_threads != NULL) {
+        io_threads_free(s->io_threads);
+    }
+    if (s->pending_reads != NULL) {
+        vec_free(s->pending_reads, NULL);
+    }
+    if (s->pending_writes != NULL) {
+        vec_free(s->pending_writes, NULL);
+    }
+    if (s->unix_sfd != -1) {
+        close(s->unix_sfd);
+        unlink(vstr_data(&s->unixsocket));
+    }
+    vstr_free(&s->unixsocket);
     vstr_free(&s->addr);
     vstr_free(&s->conf_file_path);
     vstr_free(&s->os_name);
     vec_free(s->users, user_in_vec_free);
     free(s->help_cmds);
-    close(s->sfd);
 }
 
 static void lexidb_free(lexidb* db, size_t num_databases) {
     size_t i;
     for (i = 0; i < num_databases; ++i) {
-        ht_free(&(db[i].dict), server_free_object, server_free_object);
+        ht_free(&(db[i].dict), server_free_object, server_free_db_value);
         vec_free(db[i].vec, server_free_object);
         queue_free(&(db[i].queue), server_free_object);
         set_free(&(db[i].set), server_free_object);
@@ -449,6 +748,30 @@ static void lexidb_free(lexidb* db, size_t num_databases) {
     free(db);
 }
 
+/* the unix socket belongs to reactor 0, so clients connecting through it are
+ * all served there and reach the other shards like any other client */
+static int server_listen_unix(server* s) {
+    const char* path = vstr_data(&s->unixsocket);
+    int sfd = create_unix_socket(1);
+    if (sfd < 0) {
+        return -1;
+    }
+    /* a socket file left behind by a previous run would fail the bind */
+    unlink(path);
+    if (unix_bind(sfd, path) < 0 || tcp_listen(sfd, s->backlog) < 0) {
+        close(sfd);
+        return -1;
+    }
+    if (ev_add_event(s->ev, sfd, EV_READ, server_accept, s) == -1) {
+        close(sfd);
+        unlink(path);
+        return -1;
+    }
+    s->unix_sfd = sfd;
+    return 0;
+}
+
+/* accepts clients from both the tcp and the unix socket */
 static void server_accept(ev* ev, int fd, void* client_data, int mask) {
     server* s = client_data;
     int cfd;
@@ -471,6 +794,21 @@ static void server_accept(ev* ev, int fd, void* client_data, int mask) {
 
     if (make_socket_nonblocking(cfd) == -1) {
         error("failed to make %d nonblocking\n", cfd);
+        close(cfd);
+        return;
+    }
+
+    if (s->num_clients >= s->max_clients) {
+        vstr err = vstr_format("-%s\r\n", err_maxclients.str);
+        if (write(cfd, vstr_data(&err), vstr_len(&err)) == -1) {
+            warn("failed to send maxclients error to %d\n", cfd);
+        }
+        vstr_free(&err);
+        close(cfd);
+        if (s->log_level >= Info) {
+            info("rejected %d, maxclients (%lu) reached\n", cfd,
+                 s->max_clients);
+        }
         return;
     }
 
@@ -482,18 +820,24 @@ static void server_accept(ev* ev, int fd, void* client_data, int mask) {
     }
 
     client = r_client.data.ok;
+    client->id = s->next_client_id++;
 
-    add = vec_push(&(s->clients), &client);
+    add = ev_add_event(s->ev, cfd, EV_READ,
+                       fd == s->unix_sfd ? read_from_unix_client
+                                         : read_from_client,
+                       s);
     if (add == -1) {
-        error("failed to add client to client vector (errno: %d) %s\n", errno,
+        error("failed to add read event for client (errno: %d) %s\n", errno,
               strerror(errno));
+        client_free(client);
         return;
     }
 
-    add = ev_add_event(s->ev, cfd, EV_READ, read_from_client, s);
+    add = server_add_client(s, client);
     if (add == -1) {
-        error("failed to add read event for client (errno: %d) %s\n", errno,
+        error("failed to add client to client table (errno: %d) %s\n", errno,
               strerror(errno));
+        ev_delete_event(s->ev, cfd, EV_READ);
         client_free(client);
         return;
     }
@@ -504,112 +848,411 @@ static void server_accept(ev* ev, int fd, void* client_data, int mask) {
 }
 
 static void read_from_client(ev* ev, int fd, void* client_data, int mask) {
-    ssize_t read_amt;
     server* s = client_data;
     client* c;
-    ssize_t found;
-    int add;
 
-    found = vec_find(s->clients, &fd, &c, client_compare);
-    if (found == -1) {
-        error("failed to find client (fd %d) in client vec\n", fd);
+    if (((size_t)fd) >= s->clients_cap || s->clients[fd] == NULL) {
+        error("failed to find client (fd %d) in client table\n", fd);
         ev_delete_event(ev, fd, EV_READ);
         close(fd);
         return;
     }
 
-    for (;;) {
-        /* it should never be greater than, but just in case */
-        if (c->read_pos >= c->read_cap) {
-            if (realloc_client_read_buf(c) == -1) {
-                error("failed to realloce client buffer, closing connection\n");
-                vec_remove_at(s->clients, found, NULL);
-                ev_delete_event(ev, fd, mask);
-                client_free(c);
-                return;
-            }
+    c = s->clients[fd];
+
+    if (client_take_read_buf(s, c) == -1) {
+        error("failed to allocate read buffer for %d\n", fd);
+        server_close_client(s, c);
+        return;
+    }
+
+    /* the io threads read it in handle_pending_clients */
+    if (s->io_threads != NULL) {
+        if (c->flags & CLIENT_PENDING_READ) {
+            return;
+        }
+        if (vec_push(&(s->pending_reads), &c) == -1) {
+            error("failed to queue read for %d\n", fd);
+            return;
+        }
+        c->flags |= CLIENT_PENDING_READ;
+        return;
+    }
+
+    c->io_res = client_read(c);
+    if (c->io_res == 1) {
+        if (s->log_level >= Debug) {
+            debug("received: %.*s\n", (int)c->read_pos, c->read_buf);
+        }
+        if (client_parse_cmds(c) == -1) {
+            c->io_res = -1;
+            c->io_errno = ENOMEM;
         }
+    }
+    client_return_read_buf(s, c);
 
-        read_amt =
-            read(fd, c->read_buf + c->read_pos, c->read_cap - c->read_pos);
+    if (client_read_done(s, c) == -1) {
+        return;
+    }
 
-        if (read_amt == 0) {
-            if (s->log_level >= Info) {
-                info("closing %d\n", fd);
-            }
-            vec_remove_at(s->clients, found, NULL);
-            ev_delete_event(ev, fd, mask);
-            client_free(c);
+    reply_to_client(s, c);
+}
+
+/* the first read from a unix socket client. A client that wants shared
+ * memory sends the fds of its region here, and everything after that goes
+ * through the rings. Anyone else is an ordinary client from now on */
+static void read_from_unix_client(ev* ev, int fd, void* client_data,
+                                  int mask) {
+    server* s = client_data;
+    client* c;
+    int fds[SHM_RING_NUM_FDS];
+    size_t num_fds = SHM_RING_NUM_FDS;
+    ssize_t amt_read;
+
+    if (((size_t)fd) >= s->clients_cap || s->clients[fd] == NULL) {
+        error("failed to find client (fd %d) in client table\n", fd);
+        ev_delete_event(ev, fd, EV_READ);
+        close(fd);
+        return;
+    }
+
+    c = s->clients[fd];
+
+    if (client_take_read_buf(s, c) == -1) {
+        error("failed to allocate read buffer for %d\n", fd);
+        server_close_client(s, c);
+        return;
+    }
+
+    amt_read = unix_recv_fds(fd, c->read_buf + c->read_pos,
+                             c->read_cap - c->read_pos, fds, &num_fds);
+    if (amt_read == -1 && ((errno == EWOULDBLOCK) || (errno == EAGAIN))) {
+        client_return_read_buf(s, c);
+        return;
+    }
+    if (amt_read == 0) {
+        if (s->log_level >= Info) {
+            info("closing %d\n", fd);
+        }
+        server_close_client(s, c);
+        return;
+    }
+    if (amt_read == -1) {
+        error("failed to read from client (errno: %d) %s\n", errno,
+              strerror(errno));
+        server_close_client(s, c);
+        return;
+    }
+
+    if (num_fds == 0) {
+        c->read_pos += amt_read;
+        if (ev_add_event(ev, fd, EV_READ, read_from_client, s) == -1) {
+            error("failed to add read event for client %d\n", fd);
+            server_close_client(s, c);
             return;
         }
+        read_from_client(ev, fd, s, mask);
+        return;
+    }
 
-        if (read_amt == -1) {
-            if ((errno == EWOULDBLOCK) || (errno == EAGAIN)) {
-                break;
-            } else {
-                // todo
-                error("failed to read from client (errno: %d) %s\n", errno,
-                      strerror(errno));
-                return;
-            }
+    if (num_fds != SHM_RING_NUM_FDS) {
+        size_t i;
+        for (i = 0; i < num_fds; ++i) {
+            close(fds[i]);
+        }
+        error("expected %d fds from client %d, got %lu\n", SHM_RING_NUM_FDS,
+              fd, num_fds);
+        server_close_client(s, c);
+        return;
+    }
+
+    client_return_read_buf(s, c);
+
+    if (client_upgrade_shm(s, c, fds) == -1) {
+        error("failed to set up shared memory for %d (errno: %d) %s\n", fd,
+              errno, strerror(errno));
+        server_close_client(s, c);
+        return;
+    }
+
+    if (s->log_level >= Info) {
+        info("%d is using shared memory\n", fd);
+    }
+}
+
+static int client_upgrade_shm(server* s, client* c, const int* fds) {
+    client_shm* shm = calloc(1, sizeof *shm);
+    if (shm == NULL) {
+        size_t i;
+        for (i = 0; i < SHM_RING_NUM_FDS; ++i) {
+            close(fds[i]);
         }
-        c->read_pos += read_amt;
+        errno = ENOMEM;
+        return -1;
     }
 
-    if (s->log_level >= Debug) {
-        debug("received: %s\n", c->read_buf);
+    if (shm_ring_attach(&(shm->ring), fds) == -1) {
+        free(shm);
+        return -1;
     }
 
-    execute_cmd(s, c);
+    shm->s = s;
+    shm->c = c;
+    c->shm = shm;
 
-    c->write_buf = (uint8_t*)builder_out(&(c->builder));
-    c->write_size = builder_len(&(c->builder));
+    if (ev_add_event(s->ev, c->fd, EV_READ, shm_client_hangup, s) == -1 ||
+        ev_add_event(s->ev, shm->ring.wait_fd, EV_READ, read_from_shm_client,
+                     shm) == -1) {
+        return -1;
+    }
 
-    add = ev_add_event(ev, fd, EV_WRITE, write_to_client, s);
-    if (add == -1) {
-        error("failed to add write event for %d\n", fd);
+    return 0;
+}
+
+/* the client has put requests in its ring, or has made room in ours */
+static void read_from_shm_client(ev* ev, int fd, void* client_data,
+                                 int mask) {
+    client_shm* shm = client_data;
+    server* s = shm->s;
+    client* c = shm->c;
+
+    /* before looking at the rings, so a signal sent after we look is kept */
+    shm_ring_clear_wakeup(&(shm->ring));
+
+    if (c->flags & CLIENT_WRITE_BLOCKED) {
+        int write_res = client_write(c);
+        if (write_res == -1) {
+            error("failed to write to client %d\n", c->fd);
+            server_close_client(s, c);
+            return;
+        }
+        if (write_res == 0) {
+            c->flags &= ~CLIENT_WRITE_BLOCKED;
+        }
+    }
+
+    /* the requests stay in the ring, which holds the client back, until
+     * enough of the output is written or its KEYS reply is done */
+    if ((c->flags & CLIENT_READ_PAUSED) || c->keys != NULL) {
+        if (reply_to_client(s, c) == -1 || (c->flags & CLIENT_READ_PAUSED) ||
+            c->keys != NULL) {
+            return;
+        }
+    }
+
+    if (client_take_read_buf(s, c) == -1) {
+        error("failed to allocate read buffer for %d\n", c->fd);
+        server_close_client(s, c);
         return;
     }
 
-    memset(c->read_buf, 0, c->read_pos);
-    c->read_pos = 0;
+    c->io_res = client_read(c);
+    if (c->io_res == 1 && client_parse_cmds(c) == -1) {
+        c->io_res = -1;
+        c->io_errno = ENOMEM;
+    }
+    client_return_read_buf(s, c);
+
+    if (client_read_done(s, c) == -1) {
+        return;
+    }
+
+    reply_to_client(s, c);
+}
+
+/* nothing is sent on the socket once the client is using shared memory, so
+ * it only becomes readable when the client goes away */
+static void shm_client_hangup(ev* ev, int fd, void* client_data, int mask) {
+    server* s = client_data;
+    uint8_t buf[64];
+
+    if (((size_t)fd) >= s->clients_cap || s->clients[fd] == NULL) {
+        ev_delete_event(ev, fd, EV_READ);
+        close(fd);
+        return;
+    }
 
-    return;
+    if (read(fd, buf, sizeof buf) == -1 &&
+        ((errno == EWOULDBLOCK) || (errno == EAGAIN))) {
+        return;
+    }
+
+    if (s->log_level >= Info) {
+        info("closing %d\n", fd);
+    }
+    server_close_client(s, s->clients[fd]);
 }
 
 static void write_to_client(ev* ev, int fd, void* client_data, int mask) {
     server* s = client_data;
-    size_t bytes_sent = 0;
-    size_t to_send;
     client* c;
-    ssize_t found = vec_find(s->clients, &fd, &c, client_compare);
+    int write_res;
 
-    if (found == -1) {
+    if (((size_t)fd) >= s->clients_cap || s->clients[fd] == NULL) {
         error("failed to find client %d\n", fd);
         ev_delete_event(ev, fd, mask);
         close(fd);
         return;
     }
 
-    to_send = c->write_size;
+    c = s->clients[fd];
 
-    while (bytes_sent < to_send) {
-        ssize_t amt_sent = write(fd, c->write_buf, c->write_size);
-        if (amt_sent == -1) {
-            if ((errno == EWOULDBLOCK) || (errno == EAGAIN)) {
-                error("write blocked\n");
-                return;
-            } else {
-                error("failed to write to client (errno: %d) %s\n", errno,
-                      strerror(errno));
-                return;
-            }
+    write_res = client_write(c);
+    if (write_res == -1) {
+        error("failed to write to client (errno: %d) %s\n", c->io_errno,
+              strerror(c->io_errno));
+        server_close_client(s, c);
+        return;
+    }
+
+    /* on 1, wait for the socket to become writable again */
+    if (write_res == 0) {
+        ev_delete_event(ev, fd, EV_WRITE);
+        c->flags &= ~CLIENT_WRITE_BLOCKED;
+        client_release_builders(c);
+    }
+
+    /* resumes a client paused by its soft limit once enough was written,
+     * or sends the next part of its KEYS reply */
+    if ((c->flags & CLIENT_READ_PAUSED) || c->keys != NULL) {
+        reply_to_client(s, c);
+    }
+}
+
+/* runs before every poll when io threads are enabled. The clients that became
+ * readable during the last round of events are read and parsed on the io
+ * threads, their commands are executed here on the main thread, and then the
+ * replies are written out on the io threads again */
+static void handle_pending_clients(ev* ev, void* data) {
+    server* s = data;
+    size_t i, len;
+
+    len = s->pending_reads->len;
+    io_threads_run(s->io_threads, io_thread_read,
+                   (void**)s->pending_reads->data, len);
+
+    for (i = 0; i < len; ++i) {
+        client* c = *((client**)vec_get_at(s->pending_reads, i));
+        c->flags &= ~CLIENT_PENDING_READ;
+        client_return_read_buf(s, c);
+        if (client_read_done(s, c) == -1) {
+            continue;
+        }
+        /* the socket is full, so only buffer the replies and check them
+         * against the limits */
+        if (c->flags & CLIENT_WRITE_BLOCKED) {
+            reply_to_client(s, c);
+            continue;
         }
-        bytes_sent += amt_sent;
+        if (!client_has_output(c) || (c->flags & CLIENT_PENDING_WRITE)) {
+            continue;
+        }
+        if (vec_push(&(s->pending_writes), &c) == -1) {
+            error("failed to queue write for %d\n", c->fd);
+            continue;
+        }
+        c->flags |= CLIENT_PENDING_WRITE;
     }
+    s->pending_reads->len = 0;
 
-    ev_delete_event(ev, fd, EV_WRITE);
-    builder_reset(&(c->builder));
+    len = s->pending_writes->len;
+    io_threads_run(s->io_threads, io_thread_write,
+                   (void**)s->pending_writes->data, len);
+
+    for (i = 0; i < len; ++i) {
+        client* c = *((client**)vec_get_at(s->pending_writes, i));
+        c->flags &= ~CLIENT_PENDING_WRITE;
+        if (c->io_res == -1) {
+            error("failed to write to client (errno: %d) %s\n", c->io_errno,
+                  strerror(c->io_errno));
+            server_close_client(s, c);
+            continue;
+        }
+        if (c->io_res == 1) {
+            client_wait_writable(s, c);
+        }
+        /* enforces the limits, and runs commands held back by them */
+        reply_to_client(s, c);
+    }
+    s->pending_writes->len = 0;
+}
+
+/* runs on an io thread. Nothing shared with the main thread may be touched
+ * here, only the client itself */
+static void io_thread_read(void* item) {
+    client* c = item;
+    c->io_res = client_read(c);
+    if (c->io_res != 1) {
+        return;
+    }
+    if (client_parse_cmds(c) == -1) {
+        c->io_res = -1;
+        c->io_errno = ENOMEM;
+    }
+}
+
+/* runs on an io thread */
+static void io_thread_write(void* item) {
+    client* c = item;
+    c->io_res = client_write(c);
+}
+
+static int server_start_cron(server* s) {
+    memset(s->ops_samples, 0, sizeof s->ops_samples);
+    s->ops_sample_idx = 0;
+    s->ops_sample_cmds = s->cmd_executed;
+    clock_gettime(CLOCK_MONOTONIC, &(s->ops_sample_time));
+    s->cron_id = ev_add_timer(s->ev, SERVER_CRON_INTERVAL_MS, server_cron, s);
+    return s->cron_id == -1 ? -1 : 0;
+}
+
+/* background work that has to happen whether or not there is traffic. Every
+ * reactor runs its own */
+static long long server_cron(ev* ev, long long id, void* data) {
+    server* s = data;
+    ev_unused(id);
+
+    server_sample_ops(s);
+
+    /* in case the timer for them could not be added */
+    if (s->unblocked != NULL && s->unblock_id == -1) {
+        server_resume_unblocked(s);
+    }
+
+    /* a SIGINT that arrives while we are not blocked in poll does not
+     * interrupt it, so it would otherwise go unnoticed until the next event */
+    if (s->reactor_id == 0 && sig_int_received) {
+        ev_stop(ev);
+    }
+
+    return SERVER_CRON_INTERVAL_MS;
+}
+
+static void server_sample_ops(server* s) {
+    struct timespec now;
+    uint64_t ms, ops;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ms = (now.tv_sec - s->ops_sample_time.tv_sec) * 1000 +
+         (now.tv_nsec - s->ops_sample_time.tv_nsec) / 1000000;
+    if (ms == 0) {
+        return;
+    }
+
+    ops = s->cmd_executed - s->ops_sample_cmds;
+    s->ops_samples[s->ops_sample_idx] = ops * 1000 / ms;
+    s->ops_sample_idx = (s->ops_sample_idx + 1) % SERVER_OPS_SAMPLES;
+    s->ops_sample_cmds = s->cmd_executed;
+    s->ops_sample_time = now;
+}
+
+static uint64_t server_ops_per_sec(server* s) {
+    uint64_t sum = 0;
+    size_t i;
+    for (i = 0; i < SERVER_OPS_SAMPLES; ++i) {
+        sum += s->ops_samples[i];
+    }
+    return sum / SERVER_OPS_SAMPLES;
 }
 
 static result(client_ptr) create_client(int fd, uint32_t addr, uint16_t port) {
@@ -625,31 +1268,1102 @@ static result(client_ptr) create_client(int fd, uint32_t addr, uint16_t port) {
     c->time_connected = get_time();
     c->addr = addr;
     c->port = port;
-    c->read_buf = calloc(CLIENT_READ_BUF_CAP, sizeof(uint8_t));
-    if (c->read_buf == NULL) {
+    c->cmds = vec_new(sizeof(cmd));
+    if (c->cmds == NULL) {
         free(c);
         res.type = Err;
-        res.data.err =
-            vstr_from("failed to allocate memory for client read buf");
+        res.data.err = vstr_from("failed to allocate memory for client cmds");
         return res;
     }
-    c->read_cap = CLIENT_READ_BUF_CAP;
+    /* taken from the pool once there is something to read */
+    c->read_buf = NULL;
+    c->read_cap = 0;
     c->read_pos = 0;
+    c->parser = frame_parser_new();
+    c->proto = PROTO_RESP;
     c->builder = builder_new();
+    c->gather = builder_new();
+    c->out = outbuf_new();
     res.type = Ok;
     res.data.ok = c;
     return res;
 }
 
-static void execute_cmd(server* s, client* c) {
-    cmd cmd = parse(c->read_buf, c->read_pos);
-    if (cmd.type == Illegal) {
-        builder_add_err(&(c->builder), err_invalid_command.str,
-                        err_invalid_command.str_len);
-        return;
+static int server_add_client(server* s, client* c) {
+    size_t fd = c->fd;
+    if (fd >= s->clients_cap) {
+        size_t i, new_cap = s->clients_cap;
+        void* tmp;
+        while (new_cap <= fd) {
+            new_cap <<= 1;
+        }
+        tmp = realloc(s->clients, new_cap * sizeof(client*));
+        if (tmp == NULL) {
+            return -1;
+        }
+        s->clients = tmp;
+        for (i = s->clients_cap; i < new_cap; ++i) {
+            s->clients[i] = NULL;
+        }
+        s->clients_cap = new_cap;
     }
-    if (!(c->flags & AUTHENTICATED) && cmd.type != Auth) {
-        cmd_free(&cmd);
+    s->clients[fd] = c;
+    s->num_clients++;
+    return 0;
+}
+
+static void server_close_client(server* s, client* c) {
+    if (c->flags & CLIENT_PENDING_READ) {
+        ssize_t idx = vec_find(s->pending_reads, &c, NULL, client_ptr_compare);
+        if (idx != -1) {
+            vec_remove_at(s->pending_reads, idx, NULL);
+        }
+    }
+    if (c->flags & CLIENT_PENDING_WRITE) {
+        ssize_t idx =
+            vec_find(s->pending_writes, &c, NULL, client_ptr_compare);
+        if (idx != -1) {
+            vec_remove_at(s->pending_writes, idx, NULL);
+        }
+    }
+    ev_delete_event(s->ev, c->fd, EV_READ | EV_WRITE);
+    if (c->shm != NULL && c->shm->ring.wait_fd != -1) {
+        ev_delete_event(s->ev, c->shm->ring.wait_fd, EV_READ);
+    }
+    if (c->blocked != NULL) {
+        blocked_unlink(s, c->blocked);
+        free(c->blocked);
+        c->blocked = NULL;
+    } else if (c->flags & CLIENT_BLOCKED) {
+        /* parked on reactor 0, which would otherwise hand it an element
+         * nobody is going to read */
+        reactor_msg* msg = calloc(1, sizeof *msg);
+        if (msg != NULL) {
+            msg->type = ReactorUnblock;
+            msg->from = s->reactor_id;
+            msg->fd = c->fd;
+            msg->client_id = c->id;
+            reactor_send(s, 0, msg);
+        }
+    }
+    if (c->keys != NULL) {
+        keys_stream_end(c->keys);
+    }
+    s->clients[c->fd] = NULL;
+    s->num_clients--;
+    /* whatever partial frame is in it goes with the client */
+    c->read_pos = 0;
+    client_return_read_buf(s, c);
+    client_free(c);
+}
+
+/* reads everything available on the socket into the client's read buffer.
+ * returns 1 once the socket would block, 0 if the peer closed the connection,
+ * and -1 on error, with the error in c->io_errno. Safe to call from an io
+ * thread */
+static int client_read(client* c) {
+    ssize_t read_amt;
+
+    if (c->shm != NULL) {
+        return client_read_shm(c);
+    }
+
+    for (;;) {
+        size_t avail;
+        uint8_t* dst = client_read_dst(c, &avail);
+        if (dst == NULL) {
+            c->io_errno = ENOMEM;
+            return -1;
+        }
+
+        read_amt = read(c->fd, dst, avail);
+
+        if (read_amt == 0) {
+            return 0;
+        }
+
+        if (read_amt == -1) {
+            if ((errno == EWOULDBLOCK) || (errno == EAGAIN)) {
+                return 1;
+            }
+            c->io_errno = errno;
+            return -1;
+        }
+
+        client_read_advance(c, read_amt);
+    }
+}
+
+/* the same as client_read, for a client using shared memory. The ring being
+ * empty stands in for the socket blocking */
+static int client_read_shm(client* c) {
+    for (;;) {
+        ssize_t read_amt;
+        size_t avail;
+        uint8_t* dst = client_read_dst(c, &avail);
+        if (dst == NULL) {
+            c->io_errno = ENOMEM;
+            return -1;
+        }
+
+        read_amt = shm_ring_read(&(c->shm->ring), dst, avail);
+        if (read_amt == 0) {
+            return 1;
+        }
+        if (read_amt == -1) {
+            c->io_errno = EPROTO;
+            return -1;
+        }
+
+        client_read_advance(c, read_amt);
+    }
+}
+
+/* where the next read from the client should go: the rest of a detached bulk
+ * string if there is one, otherwise the end of the read buffer. A full read
+ * buffer is parsed to make room before it is grown. returns NULL if there is
+ * no memory */
+static uint8_t* client_read_dst(client* c, size_t* avail) {
+    if (c->bulk_left == 0 && c->read_pos >= c->read_cap &&
+        client_parse_cmds(c) == -1) {
+        return NULL;
+    }
+
+    if (c->bulk_left != 0) {
+        uint8_t* dst = (uint8_t*)vstr_spare(&(c->bulk), avail);
+        *avail = c->bulk_left;
+        return dst;
+    }
+
+    /* it should never be greater than, but just in case */
+    if (c->read_pos >= c->read_cap && realloc_client_read_buf(c) == -1) {
+        return NULL;
+    }
+    *avail = c->read_cap - c->read_pos;
+    return c->read_buf + c->read_pos;
+}
+
+/* accounts for amt bytes read to where client_read_dst said */
+static void client_read_advance(client* c, size_t amt) {
+    if (c->bulk_left != 0) {
+        vstr_commit(&(c->bulk), amt);
+        frame_parser_skip_bulk(&(c->parser), amt);
+        c->bulk_left -= amt;
+        return;
+    }
+    c->read_pos += amt;
+}
+
+/* parses the complete frames in the client's read buffer onto c->cmds, with
+ * c->parser remembering how much of a trailing partial frame has already
+ * been scanned. A malformed frame becomes an Illegal cmd and the rest of the
+ * buffer is discarded. Safe to call from an io thread */
+static int client_parse_cmds(client* c) {
+    size_t offset = 0;
+    size_t remaining;
+
+    while (offset < c->read_pos) {
+        const uint8_t* frame = c->read_buf + offset;
+        size_t frame_avail = c->read_pos - offset;
+        ssize_t frame_len =
+            c->proto == PROTO_BIN
+                ? bin_frame_parser_feed(&(c->parser), frame, frame_avail)
+                : frame_parser_feed(&(c->parser), frame, frame_avail);
+        cmd cmd = {0};
+        if (frame_len == 0) {
+            if (client_detach_bulk(c, offset) == -1) {
+                return -1;
+            }
+            break;
+        }
+        if (frame_len == -1) {
+            cmd.type = Illegal;
+            c->parser = frame_parser_new();
+            offset = c->read_pos;
+        } else if (c->proto == PROTO_BIN) {
+            cmd = c->has_bulk ? parse_bin_with_bulk(frame, frame_len,
+                                                    &(c->bulk), c->bulk_at)
+                              : parse_bin(frame, frame_len);
+            offset += frame_len;
+        } else if (c->has_bulk) {
+            cmd = parse_with_bulk(frame, frame_len, &(c->bulk), c->bulk_at);
+            offset += frame_len;
+        } else {
+            cmd = parse(frame, frame_len);
+            offset += frame_len;
+        }
+        /* the frames after a HELLO are in the protocol it asked for. The
+         * reply switches over when it runs, see execute_cmd */
+        if (cmd.type == Hello) {
+            int64_t version = cmd.data.hello.value.data.num;
+            if (version == PROTO_RESP || version == PROTO_BIN) {
+                c->proto = version;
+            }
+        }
+        if (c->has_bulk) {
+            vstr_free(&(c->bulk));
+            c->has_bulk = 0;
+            c->bulk_left = 0;
+        }
+        if (vec_push(&(c->cmds), &cmd) == -1) {
+            cmd_free(&cmd);
+            return -1;
+        }
+    }
+
+    remaining = c->read_pos - offset;
+    if (remaining > 0) {
+        memmove(c->read_buf, c->read_buf + offset, remaining);
+    }
+    c->read_pos = remaining;
+    return 0;
+}
+
+/* once the header of a large bulk string has been read, the rest of it is
+ * read straight into a vstr of its final size, rather than growing the read
+ * buffer to hold it and then copying it out. offset is where the partial
+ * frame starts in the read buffer. returns -1 if there is no memory for the
+ * size the client asked for */
+static int client_detach_bulk(client* c, size_t offset) {
+    size_t start, avail;
+
+    if (c->has_bulk || c->parser.state != FrameBulk ||
+        c->parser.len < CLIENT_BULK_DETACH_MIN) {
+        return 0;
+    }
+
+    c->bulk = vstr_new_len(c->parser.len);
+    vstr_spare(&(c->bulk), &avail);
+    if (avail < c->parser.len) {
+        vstr_free(&(c->bulk));
+        return -1;
+    }
+
+    start = frame_parser_detach_bulk(&(c->parser));
+    vstr_push_string_len(&(c->bulk), (const char*)c->read_buf + offset + start,
+                         c->read_pos - offset - start);
+    c->read_pos = offset + start;
+    c->bulk_at = start;
+    c->bulk_left = c->parser.bulk_remaining;
+    c->has_bulk = 1;
+    return 0;
+}
+
+/* acts on the result of reading from a client: closes it on EOF or error,
+ * otherwise executes whatever was parsed. returns -1 if the client was closed
+ */
+static int client_read_done(server* s, client* c) {
+    if (c->io_res == 0) {
+        if (s->log_level >= Info) {
+            info("closing %d\n", c->fd);
+        }
+        server_close_client(s, c);
+        return -1;
+    }
+
+    if (c->io_res == -1) {
+        error("failed to read from client (errno: %d) %s\n", c->io_errno,
+              strerror(c->io_errno));
+        server_close_client(s, c);
+        return -1;
+    }
+
+    execute_client_cmds(s, c);
+    return 0;
+}
+
+/* moves the replies in the client's builder onto the end of its output
+ * buffer. returns -1 if there is no memory for them */
+static int client_buffer_reply(client* c) {
+    size_t len = builder_len(&(c->builder));
+    if (len == 0) {
+        return 0;
+    }
+    if (outbuf_push(&(c->out), builder_out(&(c->builder)), len) == -1) {
+        c->io_errno = ENOMEM;
+        return -1;
+    }
+    builder_reset(&(c->builder));
+    return 0;
+}
+
+static int client_has_output(client* c) {
+    return builder_len(&(c->builder)) != 0 || outbuf_len(&(c->out)) != 0;
+}
+
+/* frees the builders' buffers once everything has been sent, so an idle
+ * client holds none, the same as its read buffer. Between replies of a
+ * busy client builder_reset keeps them */
+static void client_release_builders(client* c) {
+    if (client_has_output(c)) {
+        return;
+    }
+    builder_release(&(c->builder));
+    if (!(c->flags & CLIENT_GATHERING)) {
+        builder_release(&(c->gather));
+    }
+}
+
+/* writes the client's pending replies. When nothing is buffered ahead of the
+ * builder it is written directly, and only what the socket did not take is
+ * copied into the output buffer. returns 0 once everything is written, 1 if
+ * the socket would block, and -1 on error, with the error in c->io_errno.
+ * Safe to call from an io thread */
+static int client_write(client* c) {
+    size_t len = builder_len(&(c->builder));
+
+    if (c->shm != NULL) {
+        return client_write_shm(c);
+    }
+
+    if (len != 0 && outbuf_len(&(c->out)) == 0) {
+        const uint8_t* out = builder_out(&(c->builder));
+        size_t pos = 0;
+        while (pos < len) {
+            ssize_t amt_sent = write(c->fd, out + pos, len - pos);
+            if (amt_sent == -1) {
+                if ((errno == EWOULDBLOCK) || (errno == EAGAIN)) {
+                    break;
+                }
+                c->io_errno = errno;
+                return -1;
+            }
+            pos += amt_sent;
+        }
+        if (pos < len) {
+            if (outbuf_push(&(c->out), out + pos, len - pos) == -1) {
+                c->io_errno = ENOMEM;
+                return -1;
+            }
+            builder_reset(&(c->builder));
+            return 1;
+        }
+        builder_reset(&(c->builder));
+        return 0;
+    }
+
+    if (client_buffer_reply(c) == -1) {
+        return -1;
+    }
+
+    while (outbuf_len(&(c->out)) != 0) {
+        if (outbuf_write(&(c->out), c->fd) == -1) {
+            if ((errno == EWOULDBLOCK) || (errno == EAGAIN)) {
+                return 1;
+            }
+            c->io_errno = errno;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* the same as client_write, for a client using shared memory. Returning 1
+ * means the reply ring is full and the client has been asked to signal us
+ * once it makes room */
+static int client_write_shm(client* c) {
+    shm_ring* ring = &(c->shm->ring);
+    size_t len = builder_len(&(c->builder));
+
+    if (len != 0 && outbuf_len(&(c->out)) == 0) {
+        ssize_t written = shm_ring_write(ring, builder_out(&(c->builder)), len);
+        if (written == -1) {
+            c->io_errno = EPROTO;
+            return -1;
+        }
+        if ((size_t)written < len &&
+            outbuf_push(&(c->out), builder_out(&(c->builder)) + written,
+                        len - written) == -1) {
+            c->io_errno = ENOMEM;
+            return -1;
+        }
+        builder_reset(&(c->builder));
+    } else if (client_buffer_reply(c) == -1) {
+        return -1;
+    }
+
+    while (outbuf_len(&(c->out)) != 0) {
+        const void* data;
+        size_t amt = outbuf_peek(&(c->out), &data);
+        ssize_t written = shm_ring_write(ring, data, amt);
+        if (written == -1) {
+            c->io_errno = EPROTO;
+            return -1;
+        }
+        if (written == 0) {
+            if (shm_ring_wait_space(ring)) {
+                return 1;
+            }
+            continue;
+        }
+        outbuf_consume(&(c->out), written);
+    }
+
+    return 0;
+}
+
+/* writes the client's pending output straight away. EV_WRITE is only
+ * registered when the socket can not take all of it, after which
+ * write_to_client finishes the job. Commands held back by the output limits
+ * are run as the output drains. A KEYS reply is sent a chunk per call, and
+ * for the next chunk we go back to the event loop until the socket is
+ * writable. returns -1 if the client was closed */
+static int reply_to_client(server* s, client* c) {
+    int streamed = 0;
+    for (;;) {
+        int write_res = 0;
+
+        /* when the socket is full, just keep the builder from growing while
+         * write_to_client waits */
+        if (c->flags & CLIENT_WRITE_BLOCKED) {
+            write_res = client_buffer_reply(c);
+        } else if (client_has_output(c)) {
+            write_res = client_write(c);
+            if (write_res == 1) {
+                client_wait_writable(s, c);
+            }
+        }
+
+        if (write_res == -1) {
+            error("failed to write to client (errno: %d) %s\n", c->io_errno,
+                  strerror(c->io_errno));
+            server_close_client(s, c);
+            return -1;
+        }
+
+        if (client_check_output(s, c) == -1) {
+            return -1;
+        }
+
+        if (c->keys != NULL) {
+            if (c->flags & CLIENT_WRITE_BLOCKED) {
+                return 0;
+            }
+            /* a shm client is held back by its ring filling up instead */
+            if (streamed && c->shm == NULL) {
+                client_wait_writable(s, c);
+                return 0;
+            }
+            keys_stream_next(c);
+            if (c->keys == NULL && client_resume_reads(s, c) == -1) {
+                return -1;
+            }
+            streamed = 1;
+            continue;
+        }
+
+        if (!client_cmds_runnable(c)) {
+            client_release_builders(c);
+            return 0;
+        }
+        execute_client_cmds(s, c);
+    }
+}
+
+/* the number of bytes of replies the client has not been sent yet */
+static size_t client_output_len(client* c) {
+    return builder_len(&(c->builder)) + outbuf_len(&(c->out));
+}
+
+static const output_limit* client_output_limit(server* s, client* c) {
+    return &(s->output_limits[c->shm != NULL ? ClientShm : ClientNormal]);
+}
+
+/* drops the client if its unsent output is over the hard limit, and stops
+ * reading from it while the output is over the soft limit. returns -1 if the
+ * client was closed */
+static int client_check_output(server* s, client* c) {
+    const output_limit* limit = client_output_limit(s, c);
+    size_t len = client_output_len(c);
+
+    if (limit->hard != 0 && len > limit->hard) {
+        if (s->log_level >= Info) {
+            info("closing %d, output buffer (%lu) over the hard limit (%lu)\n",
+                 c->fd, len, limit->hard);
+        }
+        s->output_hard_drops++;
+        server_close_client(s, c);
+        return -1;
+    }
+
+    if (limit->soft != 0 && len > limit->soft) {
+        if (c->flags & CLIENT_READ_PAUSED) {
+            return 0;
+        }
+        /* a shm client is simply not read from, see read_from_shm_client */
+        if (c->shm == NULL) {
+            ev_delete_event(s->ev, c->fd, EV_READ);
+        }
+        c->flags |= CLIENT_READ_PAUSED;
+        s->output_soft_pauses++;
+        return 0;
+    }
+
+    if (!(c->flags & CLIENT_READ_PAUSED)) {
+        return 0;
+    }
+
+    c->flags &= ~CLIENT_READ_PAUSED;
+    return client_resume_reads(s, c);
+}
+
+/* reads also stop while a KEYS reply is streamed, so commands pipelined
+ * behind it wait in the socket rather than in the read buffer. returns -1 if
+ * the client was closed */
+static int client_resume_reads(server* s, client* c) {
+    if (c->shm != NULL || c->keys != NULL || (c->flags & CLIENT_READ_PAUSED)) {
+        return 0;
+    }
+    if (ev_add_event(s->ev, c->fd, EV_READ, read_from_client, s) == -1) {
+        error("failed to add read event for %d\n", c->fd);
+        server_close_client(s, c);
+        return -1;
+    }
+    return 0;
+}
+
+/* whether the client has parsed commands that are not waiting on anything */
+static int client_cmds_runnable(client* c) {
+    return c->cmds_pos < c->cmds->len && c->waiting == 0 &&
+           c->keys == NULL && !(c->flags & CLIENT_READ_PAUSED);
+}
+
+static void client_wait_writable(server* s, client* c) {
+    /* client_write_shm has already asked the client to wake us */
+    if (c->shm != NULL) {
+        c->flags |= CLIENT_WRITE_BLOCKED;
+        return;
+    }
+    if (ev_add_event(s->ev, c->fd, EV_WRITE, write_to_client, s) == -1) {
+        error("failed to add write event for %d\n", c->fd);
+        return;
+    }
+    c->flags |= CLIENT_WRITE_BLOCKED;
+}
+
+/* executes a client's pipeline: every command parsed out of the complete
+ * frames of its read buffer, in order, appending each reply to the client's
+ * builder so they all go out in one write. A trailing partial frame stays in
+ * the read buffer and its command runs after the next read. With reactors, a
+ * command for another reactor's shard is forwarded to it and the rest wait,
+ * so replies stay in order. Stops early once the output is over the
+ * client's limit */
+static void execute_client_cmds(server* s, client* c) {
+    size_t len = c->cmds->len;
+    const output_limit* limit = client_output_limit(s, c);
+    size_t stop_at = limit->soft != 0 ? limit->soft : limit->hard;
+    while (c->cmds_pos < len && c->waiting == 0 && c->keys == NULL) {
+        cmd* next;
+        /* the rest run once reply_to_client has written some of the output
+         */
+        if (stop_at != 0 && client_output_len(c) > stop_at) {
+            break;
+        }
+        next = vec_get_at(c->cmds, c->cmds_pos);
+        c->cmds_pos++;
+        if (s->reactors != NULL && (c->flags & AUTHENTICATED) &&
+            reactor_forward_cmd(s, c, *next) == 0) {
+            continue;
+        }
+        execute_cmd(s, c, *next);
+    }
+    if (c->cmds_pos == len) {
+        c->cmds->len = 0;
+        c->cmds_pos = 0;
+    }
+}
+
+/* turns s into reactor 0 and starts the other num_reactors - 1 event loops,
+ * each on its own thread with its own listening socket, clients, and shard of
+ * every database. The users, help, and config are shared read only */
+static int server_start_reactors(server* s) {
+    reactor* reactors;
+    sigset_t block, old;
+    size_t i, num_started;
+
+    reactors = calloc(s->num_reactors, sizeof *reactors);
+    if (reactors == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < s->num_reactors; ++i) {
+        mpsc_queue_init(&(reactors[i].inbox));
+        reactors[i].wake_fds[0] = -1;
+        reactors[i].wake_fds[1] = -1;
+    }
+
+    s->reactors = reactors;
+    s->reactor_id = 0;
+    reactors[0].s = s;
+
+    for (i = 1; i < s->num_reactors; ++i) {
+        server* rs = malloc(sizeof *rs);
+        if (rs == NULL) {
+            goto err;
+        }
+        *rs = *s;
+        rs->reactor_id = i;
+        rs->num_clients = 0;
+        rs->next_client_id = 0;
+        rs->cmd_executed = 0;
+        rs->output_soft_pauses = 0;
+        rs->output_hard_drops = 0;
+        rs->read_bufs = NULL;
+        rs->num_read_bufs = 0;
+        rs->unblocked = NULL;
+        rs->unblock_id = -1;
+        rs->io_threads = NULL;
+        rs->unix_sfd = -1;
+        rs->pending_reads = NULL;
+        rs->pending_writes = NULL;
+        rs->sfd = create_reactor_socket(s);
+        if (rs->sfd == -1) {
+            free(rs);
+            goto err;
+        }
+        rs->clients = calloc(CLIENTS_INITIAL_CAP, sizeof(client*));
+        rs->clients_cap = CLIENTS_INITIAL_CAP;
+        rs->ev =
+            ev_new(SERVER_INITIAL_NUM_FDS, s->io_uring ? EV_OPT_URING : 0);
+        if (rs->clients == NULL || rs->ev == NULL) {
+            free(rs->clients);
+            if (rs->ev != NULL) {
+                ev_free(rs->ev);
+            }
+            close(rs->sfd);
+            free(rs);
+            goto err;
+        }
+        rs->db = lexidb_new(rs->num_databases);
+        reactors[i].s = rs;
+        if (ev_add_event(rs->ev, rs->sfd, EV_READ, server_accept, rs) == -1 ||
+            server_start_cron(rs) == -1) {
+            goto err;
+        }
+    }
+
+    for (i = 0; i < s->num_reactors; ++i) {
+        reactor* r = &(reactors[i]);
+        if (pipe(r->wake_fds) == -1) {
+            goto err;
+        }
+        if (make_socket_nonblocking(r->wake_fds[0]) == -1 ||
+            make_socket_nonblocking(r->wake_fds[1]) == -1) {
+            goto err;
+        }
+        if (ev_add_event(r->s->ev, r->wake_fds[0], EV_READ, reactor_wake,
+                         r->s) == -1) {
+            goto err;
+        }
+    }
+
+    /* SIGINT is left to the main thread, which then stops the others */
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    for (num_started = 1; num_started < s->num_reactors; ++num_started) {
+        reactor* r = &(reactors[num_started]);
+        if (pthread_create(&(r->thread), NULL, reactor_main, r->s) != 0) {
+            break;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (num_started != s->num_reactors) {
+        server_stop_reactors(s, num_started);
+        return -1;
+    }
+
+    return 0;
+
+err:
+    server_stop_reactors(s, 1);
+    return -1;
+}
+
+/* stops reactors 1 through num_started - 1, waits for their threads, and
+ * frees everything they own, including messages still in flight */
+static void server_stop_reactors(server* s, size_t num_started) {
+    reactor* reactors = s->reactors;
+    size_t i;
+
+    for (i = 1; i < num_started; ++i) {
+        reactor_msg* msg = calloc(1, sizeof *msg);
+        if (msg == NULL) {
+            /* we would never be able to join it */
+            error("failed to stop reactor %lu\n", i);
+            abort();
+        }
+        msg->type = ReactorStop;
+        reactor_send(s, i, msg);
+    }
+
+    for (i = 1; i < num_started; ++i) {
+        pthread_join(reactors[i].thread, NULL);
+    }
+
+    for (i = 0; i < s->num_reactors; ++i) {
+        reactor* r = &(reactors[i]);
+        mpsc_node* node;
+        while ((node = mpsc_queue_pop(&(r->inbox))) != NULL) {
+            reactor_msg_free((reactor_msg*)node);
+        }
+        if (r->wake_fds[0] != -1) {
+            close(r->wake_fds[0]);
+            close(r->wake_fds[1]);
+        }
+        if (i != 0 && r->s != NULL) {
+            server_free(r->s);
+            free(r->s);
+        }
+    }
+
+    free(reactors);
+    s->reactors = NULL;
+}
+
+static int create_reactor_socket(server* s) {
+    int sfd = create_tcp_socket(1);
+    if (sfd < 0) {
+        return -1;
+    }
+    if (set_reuse_addr(sfd) == -1 || set_reuse_port(sfd) == -1 ||
+        tcp_bind(sfd, vstr_data(&s->addr), s->port) < 0 ||
+        tcp_listen(sfd, s->backlog) < 0) {
+        close(sfd);
+        return -1;
+    }
+    return sfd;
+}
+
+static void* reactor_main(void* arg) {
+    server* s = arg;
+    ev_await(s->ev);
+    return NULL;
+}
+
+/* pushes msg onto reactor to's inbox. The pipe is only written when the
+ * receiver is not already due to wake up, so a burst of messages costs one
+ * write and one wake up */
+static void reactor_send(server* s, size_t to, reactor_msg* msg) {
+    reactor* r = &(s->reactors[to]);
+    mpsc_queue_push(&(r->inbox), &(msg->node));
+    if (__atomic_exchange_n(&(r->wake_pending), 1, __ATOMIC_SEQ_CST) == 0) {
+        uint8_t b = 1;
+        if (write(r->wake_fds[1], &b, 1) == -1 && errno != EAGAIN) {
+            error("failed to wake reactor %lu (errno: %d) %s\n", to, errno,
+                  strerror(errno));
+        }
+    }
+}
+
+static void reactor_wake(ev* ev, int fd, void* client_data, int mask) {
+    server* s = client_data;
+    reactor* r = &(s->reactors[s->reactor_id]);
+    uint8_t buf[64];
+    mpsc_node* node;
+
+    /* the pipe is emptied before the flag is cleared, and the flag before the
+     * inbox is drained, so a message pushed after this point always writes a
+     * fresh wake up byte */
+    while (read(fd, buf, sizeof buf) > 0) {
+    }
+    __atomic_store_n(&(r->wake_pending), 0, __ATOMIC_SEQ_CST);
+
+    while ((node = mpsc_queue_pop(&(r->inbox))) != NULL) {
+        reactor_msg* msg = (reactor_msg*)node;
+        switch (msg->type) {
+        case ReactorRequest:
+            reactor_execute(s, msg);
+            break;
+        case ReactorReply:
+            reactor_reply(s, msg);
+            break;
+        case ReactorStop:
+            reactor_msg_free(msg);
+            ev_stop(ev);
+            break;
+        case ReactorUnblock:
+            reactor_unblock(s, msg);
+            break;
+        }
+    }
+}
+
+static reactor_msg* reactor_msg_new(client* c, cmd cmd) {
+    reactor_msg* msg = calloc(1, sizeof *msg);
+    if (msg == NULL) {
+        return NULL;
+    }
+    msg->type = ReactorRequest;
+    msg->fd = c->fd;
+    msg->client_id = c->id;
+    msg->database_num = c->database_num;
+    msg->proto = c->builder.proto;
+    msg->cmd = cmd;
+    return msg;
+}
+
+static void reactor_msg_free(reactor_msg* msg) {
+    if (msg->type == ReactorRequest) {
+        cmd_free(&(msg->cmd));
+    } else if (msg->type == ReactorReply) {
+        builder_free(&(msg->reply));
+    }
+    free(msg);
+}
+
+/* sends cmd to the reactor whose shard it touches. returns -1 if the command
+ * belongs to this reactor and should be executed here, 0 if it was taken
+ * care of. Keys in the dict are sharded by hash, the stack, queue, and set
+ * all live on reactor 0, and KEYS asks every reactor */
+static int reactor_forward_cmd(server* s, client* c, cmd cmd) {
+    reactor_msg* msg;
+    size_t to;
+
+    switch (cmd.type) {
+    case Set:
+        to = reactor_for_key(s, &(cmd.data.set.key));
+        break;
+    case Get:
+        to = reactor_for_key(s, &(cmd.data.get.key));
+        break;
+    case Del:
+        to = reactor_for_key(s, &(cmd.data.del.key));
+        break;
+    case Push:
+    case Pop:
+    case Enque:
+    case Deque:
+    case ZSet:
+    case ZHas:
+    case ZDel:
+        to = 0;
+        break;
+    case Bpop:
+    case Bdeque:
+        to = 0;
+        /* lets server_close_client cancel the wait, reactor_reply clears it
+         */
+        if (s->reactor_id != 0) {
+            c->flags |= CLIENT_BLOCKED;
+        }
+        break;
+    case Keys: {
+        reactor_msg* msgs[REACTORS_MAX] = {0};
+        client local = {0};
+        size_t i;
+
+        for (i = 0; i < s->num_reactors; ++i) {
+            if (i == s->reactor_id) {
+                continue;
+            }
+            msgs[i] = reactor_msg_new(c, cmd);
+            if (msgs[i] == NULL) {
+                size_t j;
+                for (j = 0; j < i; ++j) {
+                    free(msgs[j]);
+                }
+                builder_add_err(&(c->builder), err_oom.str, err_oom.str_len);
+                return 0;
+            }
+            msgs[i]->from = s->reactor_id;
+            msgs[i]->gather = 1;
+        }
+
+        c->flags |= CLIENT_GATHERING;
+        for (i = 0; i < s->num_reactors; ++i) {
+            if (msgs[i] != NULL) {
+                c->waiting++;
+                reactor_send(s, i, msgs[i]);
+            }
+        }
+
+        local.flags = AUTHENTICATED | CLIENT_PROXY;
+        local.database_num = c->database_num;
+        local.builder = builder_new();
+        builder_set_proto(&(local.builder), c->builder.proto);
+        execute_cmd(s, &local, cmd);
+        client_gather(c, &(local.builder));
+        builder_free(&(local.builder));
+        return 0;
+    }
+    default:
+        return -1;
+    }
+
+    if (to == s->reactor_id) {
+        return -1;
+    }
+
+    msg = reactor_msg_new(c, cmd);
+    if (msg == NULL) {
+        cmd_free(&cmd);
+        builder_add_err(&(c->builder), err_oom.str, err_oom.str_len);
+        return 0;
+    }
+    msg->from = s->reactor_id;
+    c->waiting++;
+    reactor_send(s, to, msg);
+    return 0;
+}
+
+/* the same key must map to the same reactor from every reactor, so this uses
+ * the shared shard_seed rather than any ht's seed */
+static size_t reactor_for_key(server* s, const object* key) {
+    uint64_t hash;
+    switch (key->type) {
+    case String:
+        hash = siphash((const uint8_t*)vstr_data(&(key->data.string)),
+                       vstr_len(&(key->data.string)), s->shard_seed);
+        break;
+    case Int:
+        hash = siphash((const uint8_t*)&(key->data.num),
+                       sizeof key->data.num, s->shard_seed);
+        break;
+    default:
+        hash = key->type;
+        break;
+    }
+    return hash % s->num_reactors;
+}
+
+/* runs a request from another reactor against this reactor's shard and sends
+ * the reply back */
+static void reactor_execute(server* s, reactor_msg* msg) {
+    client proxy = {0};
+    proxy.flags = AUTHENTICATED | CLIENT_PROXY;
+    proxy.database_num = msg->database_num;
+    proxy.builder = builder_new();
+    builder_set_proto(&(proxy.builder), msg->proto);
+    if (cmd_flags(msg->cmd.type) & CMD_BLOCKING) {
+        /* a parked request is sent back once it is served */
+        if (execute_block_command(s, &proxy, &(msg->cmd), msg) == 1) {
+            builder_free(&(proxy.builder));
+            return;
+        }
+    } else {
+        execute_cmd(s, &proxy, msg->cmd);
+    }
+    msg->type = ReactorReply;
+    msg->reply = proxy.builder;
+    reactor_send(s, msg->from, msg);
+}
+
+/* hands a reply from another reactor to the client that sent the request.
+ * Once nothing else is outstanding the client's remaining commands run */
+static void reactor_reply(server* s, reactor_msg* msg) {
+    client* c = NULL;
+
+    if (((size_t)msg->fd) < s->clients_cap) {
+        c = s->clients[msg->fd];
+    }
+    if (c == NULL || c->id != msg->client_id) {
+        /* the client went away while waiting */
+        reactor_msg_free(msg);
+        return;
+    }
+
+    if (msg->gather) {
+        client_gather(c, &(msg->reply));
+    } else {
+        builder_add_raw(&(c->builder), builder_out(&(msg->reply)),
+                        builder_len(&(msg->reply)));
+    }
+    reactor_msg_free(msg);
+
+    c->flags &= ~CLIENT_BLOCKED;
+    c->waiting--;
+    if (c->waiting > 0) {
+        return;
+    }
+
+    if (c->flags & CLIENT_GATHERING) {
+        if (c->gather_len == 0) {
+            builder_add_none(&(c->builder));
+        } else {
+            builder_add_array(&(c->builder), c->gather_len);
+            builder_add_raw(&(c->builder), builder_out(&(c->gather)),
+                            builder_len(&(c->gather)));
+        }
+        builder_reset(&(c->gather));
+        c->gather_len = 0;
+        c->flags &= ~CLIENT_GATHERING;
+    }
+
+    execute_client_cmds(s, c);
+    reply_to_client(s, c);
+}
+
+/* drops the parked request of a client that closed on another reactor */
+static void reactor_unblock(server* s, reactor_msg* msg) {
+    size_t i;
+
+    for (i = 0; i < s->num_databases; ++i) {
+        blocked_list* lists[2];
+        size_t j;
+        lists[0] = &(s->db[i].pop_waiters);
+        lists[1] = &(s->db[i].deque_waiters);
+        for (j = 0; j < 2; ++j) {
+            blocked* b;
+            for (b = lists[j]->head; b != NULL; b = b->next) {
+                if (b->msg == NULL || b->msg->from != msg->from ||
+                    b->fd != msg->fd || b->client_id != msg->client_id) {
+                    continue;
+                }
+                blocked_unlink(s, b);
+                reactor_msg_free(b->msg);
+                free(b);
+                reactor_msg_free(msg);
+                return;
+            }
+        }
+    }
+
+    /* it was served before the message got here */
+    reactor_msg_free(msg);
+}
+
+/* adds the elements of a KEYS reply to c->gather, dropping the array header
+ */
+static void client_gather(client* c, builder* reply) {
+    const uint8_t* out = builder_out(reply);
+    size_t len = builder_len(reply);
+    size_t i = 1, count = 0;
+
+    if (reply->proto == PROTO_BIN) {
+        /* a shard with no keys replies with null */
+        if (len < 5 || out[0] != BinArray) {
+            return;
+        }
+        count = bin_get_u32(out + 1);
+        i = 5;
+    } else {
+        if (len == 0 || out[0] != '*') {
+            return;
+        }
+        while (i < len && out[i] != '\r') {
+            count = (count * 10) + (out[i] - '0');
+            i++;
+        }
+        i += 2;
+    }
+
+    if (i < len) {
+        builder_add_raw(&(c->gather), out + i, len - i);
+    }
+    c->gather_len += count;
+}
+
+static void execute_cmd(server* s, client* c, cmd cmd) {
+    if (cmd.type == Illegal) {
+        builder_add_err(&(c->builder), err_invalid_command.str,
+                        err_invalid_command.str_len);
+        return;
+    }
+    if (!(c->flags & AUTHENTICATED) && !(cmd_flags(cmd.type) & CMD_NO_AUTH)) {
+        cmd_free(&cmd);
         builder_add_err(&c->builder, err_unauthed.str, err_unauthed.str_len);
         return;
     }
@@ -673,7 +2387,8 @@ static void execute_cmd(server* s, client* c) {
         vstr time_secs;
         struct timespec cur_time;
         uint64_t uptime_secs;
-        builder_add_ht(&c->builder, 11);
+        const char* api_name;
+        builder_add_ht(&c->builder, 16);
 
         builder_add_string(&c->builder, "process id", 10);
         builder_add_int(&c->builder, s->pid);
@@ -691,7 +2406,8 @@ static void execute_cmd(server* s, client* c) {
                            vstr_len(&s->os_name));
 
         builder_add_string(&c->builder, "multiplexing api", 16);
-        builder_add_string(&c->builder, ev_api_name(), strlen(ev_api_name()));
+        api_name = ev_api_name(s->ev);
+        builder_add_string(&c->builder, api_name, strlen(api_name));
 
         builder_add_string(&c->builder, "host", 4);
         builder_add_string(&c->builder, vstr_data(&s->addr),
@@ -703,12 +2419,27 @@ static void execute_cmd(server* s, client* c) {
         builder_add_string(&c->builder, "commands processes", 18);
         builder_add_int(&c->builder, s->cmd_executed);
 
+        builder_add_string(&c->builder, "ops per sec", 11);
+        builder_add_int(&c->builder, server_ops_per_sec(s));
+
         builder_add_string(&c->builder, "num connections", 15);
-        builder_add_int(&c->builder, s->clients->len);
+        builder_add_int(&c->builder, s->num_clients);
+
+        builder_add_string(&c->builder, "output limit pauses", 19);
+        builder_add_int(&c->builder, s->output_soft_pauses);
+
+        builder_add_string(&c->builder, "output limit disconnects", 24);
+        builder_add_int(&c->builder, s->output_hard_drops);
 
         builder_add_string(&c->builder, "num databases", 13);
         builder_add_int(&c->builder, s->num_databases);
 
+        builder_add_string(&c->builder, "io threads", 10);
+        builder_add_int(&c->builder, s->num_io_threads);
+
+        builder_add_string(&c->builder, "reactors", 8);
+        builder_add_int(&c->builder, s->num_reactors);
+
         cur_time = get_time();
         uptime_secs = cur_time.tv_sec - s->start_time.tv_sec;
         time_secs = vstr_format("%lu secs", uptime_secs);
@@ -729,8 +2460,20 @@ static void execute_cmd(server* s, client* c) {
         }
         break;
     } break;
+    case Hello: {
+        int64_t version = cmd.data.hello.value.data.num;
+        if (version != PROTO_RESP && version != PROTO_BIN) {
+            builder_add_err(&c->builder, err_proto.str, err_proto.str_len);
+            break;
+        }
+        /* acknowledged in the protocol the client asked from */
+        builder_add_ok(&c->builder);
+        builder_set_proto(&c->builder, version);
+        s->cmd_executed++;
+    } break;
     case Keys: {
-        size_t len = s->db[c->database_num].dict.num_entries;
+        lexidb* db = &(s->db[c->database_num]);
+        size_t len = db->dict.num_entries;
         ht_iter iter;
 
         if (len == 0) {
@@ -738,7 +2481,16 @@ static void execute_cmd(server* s, client* c) {
             s->cmd_executed++;
             break;
         }
-        iter = ht_iter_new(&s->db->dict);
+        /* a proxy's reply is gathered whole on the origin reactor */
+        if (!(c->flags & CLIENT_PROXY) && keys_stream_start(c, db) == 0) {
+            /* until the stream ends, see client_resume_reads */
+            if (c->shm == NULL) {
+                ev_delete_event(s->ev, c->fd, EV_READ);
+            }
+            s->cmd_executed++;
+            break;
+        }
+        iter = ht_iter_new(&(db->dict));
         builder_add_array(&c->builder, len);
         while (iter.cur) {
             ht_entry* cur = iter.cur;
@@ -759,12 +2511,19 @@ static void execute_cmd(server* s, client* c) {
         s->cmd_executed++;
     } break;
     case Get: {
-        object* obj = execute_get_command(s, &(cmd.data.get), c->database_num);
-        if (obj == NULL) {
+        db_value* val =
+            execute_get_command(s, &(cmd.data.get), c->database_num);
+        if (val == NULL) {
             builder_add_none(&(c->builder));
             break;
         }
-        builder_add_object(&(c->builder), obj);
+        if (val->obj.type == String &&
+            vstr_len(&(val->obj.data.string)) >= REPLY_REF_MIN &&
+            !(c->flags & CLIENT_PROXY)) {
+            client_add_shared_str(c, val);
+        } else {
+            server_add_db_value(s, &(c->builder), val);
+        }
         s->cmd_executed++;
     } break;
     case Del: {
@@ -852,6 +2611,10 @@ static void execute_cmd(server* s, client* c) {
         builder_add_ok(&c->builder);
         s->cmd_executed++;
     } break;
+    case Bpop:
+    case Bdeque:
+        execute_block_command(s, c, &cmd, NULL);
+        break;
     default:
         builder_add_err(&(c->builder), err_invalid_command.str,
                         err_invalid_command.str_len);
@@ -907,34 +2670,231 @@ static int execute_auth_command(server* s, client* client, auth_cmd* auth) {
 
 static ht_result execute_set_command(server* s, set_cmd* set,
                                      size_t database_num) {
+    lexidb* db = &(s->db[database_num]);
     object key = set->key;
-    object value = set->value;
-    ht_result res = ht_insert(&(s->db[database_num].dict), &key, sizeof(object),
-                              &value, server_free_object, server_free_object);
+    db_value value = {0};
+    ht_result res;
+    value.obj = set->value;
+    value.gen = db->gen;
+    /* overwriting a key KEYS is sending does not make it a new one */
+    if (db->keys_streams != NULL) {
+        db_value* old = ht_get(&(db->dict), &key, sizeof(object));
+        if (old != NULL) {
+            value.gen = old->gen;
+        }
+    }
+    res = ht_insert(&(db->dict), &key, sizeof(object), &value,
+                    server_free_object, server_free_db_value);
     return res;
 }
 
-static object* execute_get_command(server* s, get_cmd* get,
-                                   size_t database_num) {
+static db_value* execute_get_command(server* s, get_cmd* get,
+                                     size_t database_num) {
     object key = get->key;
-    object* res = ht_get(&(s->db[database_num].dict), &key, sizeof(object));
+    db_value* res = ht_get(&(s->db[database_num].dict), &key, sizeof(object));
     object_free(&key);
     return res;
 }
 
+/* adds val as the reply to GET. With reply-cache on, arrays and maps are
+ * only walked by the first RESP GET, which keeps the bytes it wrote, and
+ * later GETs copy those. The binary protocol is always encoded */
+static int server_add_db_value(server* s, builder* b, db_value* val) {
+    reply_cache* cache;
+    size_t start, len;
+
+    if (!s->reply_cache || b->proto != PROTO_RESP ||
+        (val->obj.type != Array && val->obj.type != Ht)) {
+        return builder_add_object(b, &(val->obj));
+    }
+    if (val->reply.resp != NULL) {
+        return builder_add_raw(b, val->reply.resp->data,
+                               val->reply.resp->len);
+    }
+
+    start = builder_len(b);
+    if (builder_add_object(b, &(val->obj)) == -1) {
+        return -1;
+    }
+    len = builder_len(b) - start;
+    /* the reply is already written, it just won't be cached */
+    cache = malloc(sizeof *cache + len);
+    if (cache == NULL) {
+        return 0;
+    }
+    cache->len = len;
+    memcpy(cache->data, builder_out(b) + start, len);
+    val->reply.resp = cache;
+    return 0;
+}
+
+/* adds a large string as the reply to GET. Only the header goes through the
+ * builder, the contents are queued in the output buffer by reference and
+ * written from the dict. Should that fail for want of memory, they are
+ * copied into the builder instead */
+static int client_add_shared_str(client* c, db_value* val) {
+    const vstr* str = &(val->obj.data.string);
+    shared_str* shared = val->reply.shared;
+    size_t len = vstr_len(str);
+
+    if (builder_add_string_header(&(c->builder), len) == -1) {
+        return -1;
+    }
+
+    if (shared == NULL) {
+        shared = malloc(sizeof *shared);
+        if (shared != NULL) {
+            shared->refs = 1;
+            shared->str = *str;
+            val->reply.shared = shared;
+        }
+    }
+
+    /* everything before the contents has to be in the output buffer ahead
+     * of them */
+    if (shared != NULL && client_buffer_reply(c) == 0) {
+        __atomic_add_fetch(&(shared->refs), 1, __ATOMIC_RELAXED);
+        if (outbuf_push_ref(&(c->out), vstr_data(&(shared->str)), len,
+                            shared_str_release, shared) == 0) {
+            return builder_add_string_end(&(c->builder));
+        }
+        shared_str_release(shared);
+    }
+
+    if (builder_add_raw(&(c->builder), (const uint8_t*)vstr_data(str),
+                        len) == -1) {
+        return -1;
+    }
+    return builder_add_string_end(&(c->builder));
+}
+
+static void shared_str_release(void* ptr) {
+    shared_str* shared = ptr;
+    if (__atomic_sub_fetch(&(shared->refs), 1, __ATOMIC_ACQ_REL) == 0) {
+        vstr_free(&(shared->str));
+        free(shared);
+    }
+}
+
 static ht_result execute_del_command(server* s, del_cmd* del,
                                      size_t database_num) {
+    lexidb* db = &(s->db[database_num]);
     object key = del->key;
-    ht_result res = ht_delete(&(s->db[database_num].dict), &key, sizeof(object),
-                              server_free_object, server_free_object);
+    ht_result res;
+    if (db->keys_streams != NULL) {
+        keys_stream_deleted(db, &key);
+    }
+    res = ht_delete(&(db->dict), &key, sizeof(object), server_free_object,
+                    server_free_db_value);
     object_free(&key);
     return res;
 }
 
+/* starts sending the keys of db to the client in chunks, from
+ * reply_to_client. returns -1 if there is no memory for it */
+static int keys_stream_start(client* c, lexidb* db) {
+    keys_stream* ks = malloc(sizeof *ks);
+    if (ks == NULL) {
+        return -1;
+    }
+    if (builder_add_array(&(c->builder), db->dict.num_entries) == -1) {
+        free(ks);
+        return -1;
+    }
+    ks->prev = NULL;
+    ks->next = db->keys_streams;
+    ks->c = c;
+    ks->db = db;
+    ks->gen = db->gen++;
+    ks->cursor = ht_scan_new(&(db->dict));
+    ks->left = db->dict.num_entries;
+    if (db->keys_streams != NULL) {
+        db->keys_streams->prev = ks;
+    }
+    db->keys_streams = ks;
+    c->keys = ks;
+    return 0;
+}
+
+/* encodes the next KEYS_STREAM_CHUNK bytes or so of the client's KEYS reply
+ * into its builder, and ends the stream once the reply is complete */
+static void keys_stream_next(client* c) {
+    keys_stream* ks = c->keys;
+    size_t stop_at = builder_len(&(c->builder)) + KEYS_STREAM_CHUNK;
+    int more = 1;
+
+    while (more && ks->left != 0 && builder_len(&(c->builder)) < stop_at) {
+        more = ht_scan(&(ks->db->dict), &(ks->cursor), keys_stream_add, ks);
+    }
+
+    /* the scan can only miss a key if the stream was not told of its
+     * delete. The array has to be as long as its header said all the same,
+     * or the client would wait for keys that never come */
+    if (ks->left != 0 && !more) {
+        error("KEYS reply for %d is %lu keys short\n", c->fd, ks->left);
+        while (ks->left != 0) {
+            builder_add_none(&(c->builder));
+            ks->left--;
+        }
+    }
+
+    if (ks->left == 0) {
+        keys_stream_end(ks);
+    }
+}
+
+static void keys_stream_add(ht_entry* e, void* arg) {
+    keys_stream* ks = arg;
+    const db_value* val = ht_entry_get_value(e);
+    if (val->gen > ks->gen || ks->left == 0) {
+        return;
+    }
+    builder_add_object(&(ks->c->builder), ht_entry_get_key(e));
+    ks->left--;
+}
+
+static void keys_stream_end(keys_stream* ks) {
+    if (ks->prev == NULL) {
+        ks->db->keys_streams = ks->next;
+    } else {
+        ks->prev->next = ks->next;
+    }
+    if (ks->next != NULL) {
+        ks->next->prev = ks->prev;
+    }
+    ks->c->keys = NULL;
+    free(ks);
+}
+
+/* the scan will not find key once it is deleted, so every stream that still
+ * needs it gets it now */
+static void keys_stream_deleted(lexidb* db, object* key) {
+    db_value* val = ht_get(&(db->dict), key, sizeof(object));
+    keys_stream* ks;
+    if (val == NULL) {
+        return;
+    }
+    for (ks = db->keys_streams; ks != NULL; ks = ks->next) {
+        if (val->gen > ks->gen || ks->left == 0 ||
+            ht_scan_visited(&(db->dict), &(ks->cursor), key, sizeof(object))) {
+            continue;
+        }
+        builder_add_object(&(ks->c->builder), key);
+        ks->left--;
+    }
+}
+
 static int execute_push_command(server* s, push_cmd* push,
                                 size_t database_num) {
+    lexidb* db = &(s->db[database_num]);
     object value = push->value;
-    int res = vec_push(&(s->db[database_num].vec), &value);
+    int res;
+    /* a client in BPOP takes it straight away, the vec is empty anyway */
+    if (db->pop_waiters.head != NULL) {
+        blocked_wake(s, db->pop_waiters.head, &value);
+        return 0;
+    }
+    res = vec_push(&(db->vec), &value);
     return res;
 }
 
@@ -953,8 +2913,14 @@ static result(object) execute_pop_command(server* s, size_t database_num) {
 
 static int execute_enque_command(server* s, enque_cmd* enque,
                                  size_t database_num) {
+    lexidb* db = &(s->db[database_num]);
     object to_enque = enque->value;
-    return queue_enque(&s->db[database_num].queue, &to_enque);
+    /* a client in BDEQUE takes it straight away, the queue is empty anyway */
+    if (db->deque_waiters.head != NULL) {
+        blocked_wake(s, db->deque_waiters.head, &to_enque);
+        return 0;
+    }
+    return queue_enque(&db->queue, &to_enque);
 }
 
 static result(object) execute_deque_command(server* s, size_t database_num) {
@@ -970,6 +2936,221 @@ static result(object) execute_deque_command(server* s, size_t database_num) {
     return ro;
 }
 
+/* pops or deques for BPOP or BDEQUE, and parks the client when there is
+ * nothing to take. msg is the request when the client is on another reactor.
+ * returns 1 if the client was parked, 0 if the reply is in c's builder */
+static int execute_block_command(server* s, client* c, cmd* cmd,
+                                 reactor_msg* msg) {
+    lexidb* db = &(s->db[c->database_num]);
+    result(object) ro;
+    blocked_list* list;
+    int64_t timeout;
+    object obj;
+
+    if (cmd->type == Bpop) {
+        ro = execute_pop_command(s, c->database_num);
+        list = &(db->pop_waiters);
+        timeout = cmd->data.bpop.timeout;
+    } else {
+        ro = execute_deque_command(s, c->database_num);
+        list = &(db->deque_waiters);
+        timeout = cmd->data.bdeque.timeout;
+    }
+
+    if (ro.type == Ok) {
+        obj = ro.data.ok;
+        builder_add_object(&(c->builder), &obj);
+        object_free(&obj);
+        s->cmd_executed++;
+        return 0;
+    }
+
+    if (client_block(s, c, list, timeout, msg) == -1) {
+        builder_add_err(&(c->builder), err_oom.str, err_oom.str_len);
+        return 0;
+    }
+    return 1;
+}
+
+/* parks c at the back of list. A local client holds its remaining commands
+ * back, the same way it does for a request sent to another reactor */
+static int client_block(server* s, client* c, blocked_list* list,
+                        int64_t timeout, reactor_msg* msg) {
+    blocked* b = calloc(1, sizeof *b);
+    if (b == NULL) {
+        return -1;
+    }
+    b->s = s;
+    b->list = list;
+    b->msg = msg;
+    b->timer_id = -1;
+    if (msg != NULL) {
+        b->fd = msg->fd;
+        b->client_id = msg->client_id;
+    } else {
+        b->fd = c->fd;
+        b->client_id = c->id;
+    }
+
+    if (timeout != 0) {
+        b->timer_id = ev_add_timer(s->ev, timeout, blocked_timeout, b);
+        if (b->timer_id == -1) {
+            free(b);
+            return -1;
+        }
+    }
+
+    b->prev = list->tail;
+    if (list->tail == NULL) {
+        list->head = b;
+    } else {
+        list->tail->next = b;
+    }
+    list->tail = b;
+
+    if (msg == NULL) {
+        c->blocked = b;
+        c->flags |= CLIENT_BLOCKED;
+        c->waiting++;
+    }
+    return 0;
+}
+
+/* takes b out of its list and cancels its timeout */
+static void blocked_unlink(server* s, blocked* b) {
+    blocked_list* list = b->list;
+    if (b->prev == NULL) {
+        list->head = b->next;
+    } else {
+        b->prev->next = b->next;
+    }
+    if (b->next == NULL) {
+        list->tail = b->prev;
+    } else {
+        b->next->prev = b->prev;
+    }
+    b->prev = b->next = NULL;
+    if (b->timer_id != -1) {
+        ev_del_timer(s->ev, b->timer_id);
+        b->timer_id = -1;
+    }
+}
+
+/* replies to a parked client with value, or with null when value is NULL
+ * because it timed out. value is freed. A local client's held back commands
+ * run from server_run_unblocked rather than in the middle of the command that
+ * woke it */
+static void blocked_wake(server* s, blocked* b, object* value) {
+    builder* reply;
+    client* c = NULL;
+
+    blocked_unlink(s, b);
+
+    if (b->msg != NULL) {
+        reply = &(b->msg->reply);
+        *reply = builder_new();
+        builder_set_proto(reply, b->msg->proto);
+    } else {
+        c = s->clients[b->fd];
+        reply = &(c->builder);
+    }
+
+    if (value != NULL) {
+        builder_add_object(reply, value);
+        object_free(value);
+        s->cmd_executed++;
+    } else {
+        builder_add_none(reply);
+    }
+
+    if (b->msg != NULL) {
+        b->msg->type = ReactorReply;
+        reactor_send(s, b->msg->from, b->msg);
+        free(b);
+        return;
+    }
+
+    c->blocked = NULL;
+    c->flags &= ~CLIENT_BLOCKED;
+    c->waiting--;
+
+    b->next = s->unblocked;
+    s->unblocked = b;
+    if (s->unblock_id == -1) {
+        /* server_cron picks them up if this fails */
+        s->unblock_id = ev_add_timer(s->ev, 0, server_run_unblocked, s);
+    }
+}
+
+static long long blocked_timeout(ev* ev, long long id, void* data) {
+    blocked* b = data;
+    ev_unused(ev);
+    ev_unused(id);
+    /* ev drops the timer once this returns */
+    b->timer_id = -1;
+    blocked_wake(b->s, b, NULL);
+    return EV_TIMER_NOMORE;
+}
+
+static long long server_run_unblocked(ev* ev, long long id, void* data) {
+    server* s = data;
+    ev_unused(ev);
+    ev_unused(id);
+    s->unblock_id = -1;
+    server_resume_unblocked(s);
+    return EV_TIMER_NOMORE;
+}
+
+/* runs the commands that served waiters held back, and sends their replies.
+ * Commands run here can serve more waiters, which are picked up as well */
+static void server_resume_unblocked(server* s) {
+    while (s->unblocked != NULL) {
+        blocked* b = s->unblocked;
+        client* c = NULL;
+        s->unblocked = b->next;
+        if (((size_t)b->fd) < s->clients_cap) {
+            c = s->clients[b->fd];
+        }
+        if (c != NULL && c->id != b->client_id) {
+            c = NULL;
+        }
+        free(b);
+        if (c == NULL) {
+            continue;
+        }
+        execute_client_cmds(s, c);
+        reply_to_client(s, c);
+    }
+}
+
+/* frees everything still parked, along with the requests of clients on other
+ * reactors */
+static void server_free_blocked(server* s) {
+    size_t i;
+    while (s->unblocked != NULL) {
+        blocked* b = s->unblocked;
+        s->unblocked = b->next;
+        free(b);
+    }
+    for (i = 0; i < s->num_databases; ++i) {
+        blocked_list* lists[2];
+        size_t j;
+        lists[0] = &(s->db[i].pop_waiters);
+        lists[1] = &(s->db[i].deque_waiters);
+        for (j = 0; j < 2; ++j) {
+            while (lists[j]->head != NULL) {
+                blocked* b = lists[j]->head;
+                lists[j]->head = b->next;
+                if (b->msg != NULL) {
+                    reactor_msg_free(b->msg);
+                }
+                free(b);
+            }
+            lists[j]->tail = NULL;
+        }
+    }
+}
+
 static set_result execute_zset_command(server* s, zset_cmd* zset,
                                        size_t database_num) {
     return set_insert(&s->db[database_num].set, &zset->value,
@@ -1013,6 +3194,95 @@ static result(log_level) determine_loglevel(vstr* loglevel_s) {
     return res;
 }
 
+/* raises the open file limit to fit max_clients plus the descriptors the
+ * server uses itself. returns the number of clients the limit allows */
+static size_t adjust_open_files_limit(size_t max_clients) {
+    struct rlimit limit;
+    rlim_t needed = max_clients + SERVER_RESERVED_FDS;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == -1) {
+        warn("unable to get the open files limit (errno: %d) %s\n", errno,
+             strerror(errno));
+        return max_clients;
+    }
+
+    if (limit.rlim_cur >= needed) {
+        return max_clients;
+    }
+
+    limit.rlim_cur = needed;
+    if (limit.rlim_max != RLIM_INFINITY && limit.rlim_max < needed) {
+        limit.rlim_cur = limit.rlim_max;
+    }
+
+    if (setrlimit(RLIMIT_NOFILE, &limit) == -1 ||
+        getrlimit(RLIMIT_NOFILE, &limit) == -1) {
+        warn("unable to raise the open files limit (errno: %d) %s\n", errno,
+             strerror(errno));
+    }
+
+    if (limit.rlim_cur >= needed) {
+        return max_clients;
+    }
+
+    if (limit.rlim_cur <= SERVER_RESERVED_FDS) {
+        warn("open files limit (%lu) is too low for any clients\n",
+             (size_t)limit.rlim_cur);
+        return 1;
+    }
+
+    warn("open files limit only allows %lu clients, lowering maxclients\n",
+         (size_t)(limit.rlim_cur - SERVER_RESERVED_FDS));
+    return limit.rlim_cur - SERVER_RESERVED_FDS;
+}
+
+/* gives the client a buffer to read into, from the pool if there is one to
+ * spare. returns -1 if there is no memory for one */
+static int client_take_read_buf(server* s, client* c) {
+    uint8_t* buf = s->read_bufs;
+
+    if (c->read_buf != NULL) {
+        return 0;
+    }
+
+    if (buf != NULL) {
+        memcpy(&(s->read_bufs), buf, sizeof(uint8_t*));
+        s->num_read_bufs--;
+    } else {
+        buf = malloc(CLIENT_READ_BUF_CAP);
+        if (buf == NULL) {
+            return -1;
+        }
+    }
+
+    c->read_buf = buf;
+    c->read_cap = CLIENT_READ_BUF_CAP;
+    return 0;
+}
+
+/* takes the read buffer back once everything in it has been parsed, so that
+ * an idle client holds none. A buffer that grew to fit a large frame is freed
+ * rather than pooled, so the spike does not stay around */
+static void client_return_read_buf(server* s, client* c) {
+    uint8_t* buf = c->read_buf;
+
+    if (buf == NULL || c->read_pos != 0) {
+        return;
+    }
+
+    if (c->read_cap == CLIENT_READ_BUF_CAP &&
+        s->num_read_bufs < READ_BUF_POOL_MAX) {
+        memcpy(buf, &(s->read_bufs), sizeof(uint8_t*));
+        s->read_bufs = buf;
+        s->num_read_bufs++;
+    } else {
+        free(buf);
+    }
+
+    c->read_buf = NULL;
+    c->read_cap = 0;
+}
+
 static int realloc_client_read_buf(client* c) {
     void* tmp;
     size_t new_cap = c->read_cap << 1;
@@ -1021,7 +3291,6 @@ static int realloc_client_read_buf(client* c) {
         return -1;
     }
     c->read_buf = tmp;
-    memset(c->read_buf + c->read_pos, 0, new_cap - c->read_pos);
     c->read_cap = new_cap;
     return 0;
 }
@@ -1064,6 +3333,10 @@ static void cmd_free(cmd* cmd) {
         break;
     case Deque:
         break;
+    case Bpop:
+        break;
+    case Bdeque:
+        break;
     case ZSet:
         object_free(&cmd->data.zset.value);
         break;
@@ -1076,6 +3349,8 @@ static void cmd_free(cmd* cmd) {
     case Select:
         object_free(&cmd->data.select.value);
         break;
+    case Hello:
+        break;
     }
 }
 
@@ -1085,12 +3360,6 @@ static int server_compare_objects(void* a, void* b) {
     return object_cmp(ao, bo);
 }
 
-static int client_compare(void* fdp, void* clientp) {
-    int fd = *((int*)fdp);
-    client* c = *((client**)clientp);
-    return fd - c->fd;
-}
-
 static int user_compare(void* a, void* b) {
     user* ua = a;
     user* ub = b;
@@ -1103,23 +3372,53 @@ static int user_compare_by_username(void* a, void* b) {
     return vstr_cmp(username, &user->name);
 }
 
+static int client_ptr_compare(void* a, void* b) {
+    client** ca = a;
+    client** cb = b;
+    return *ca != *cb;
+}
+
 static void server_free_object(void* ptr) {
     object* o = ptr;
     object_free(o);
 }
 
+static void server_free_db_value(void* ptr) {
+    db_value* val = ptr;
+    if (val->obj.type == String && val->reply.shared != NULL) {
+        /* the contents are freed with the last reference to them */
+        shared_str_release(val->reply.shared);
+        return;
+    }
+    if (val->obj.type == Array || val->obj.type == Ht) {
+        free(val->reply.resp);
+    }
+    object_free(&(val->obj));
+}
+
 static void client_free(client* client) {
+    size_t i;
     close(client->fd);
     builder_free(&(client->builder));
+    builder_free(&(client->gather));
+    outbuf_free(&(client->out));
+    if (client->has_bulk) {
+        vstr_free(&(client->bulk));
+    }
+    if (client->shm != NULL) {
+        shm_ring_free(&(client->shm->ring));
+        free(client->shm);
+    }
+    /* on shutdown the database it was linked into is already gone */
+    free(client->keys);
     free(client->read_buf);
+    for (i = client->cmds_pos; i < client->cmds->len; ++i) {
+        cmd_free(vec_get_at(client->cmds, i));
+    }
+    vec_free(client->cmds, NULL);
     free(client);
 }
 
-static void client_in_vec_free(void* ptr) {
-    client* c = *((client**)ptr);
-    client_free(c);
-}
-
 static void user_in_vec_free(void* ptr) {
     user* u = ptr;
     vstr_free(&u->name);
@@ -5,8 +5,11 @@
 #define _XOPEN_SOURCE 600
 #include "builder.h"
 #include "cmd.h"
+#include "config_parser.h"
 #include "ev.h"
 #include "ht.h"
+#include "outbuf.h"
+#include "parser.h"
 #include "queue.h"
 #include "reply.h"
 #include "set.h"
@@ -16,12 +19,53 @@
 #include <time.h>
 
 #define AUTHENTICATED (1 << 0)
+#define CLIENT_PENDING_READ (1 << 1) /* queued for the io threads to read */
+#define CLIENT_PENDING_WRITE (1 << 2) /* queued for the io threads to write */
+#define CLIENT_GATHERING (1 << 3) /* collecting KEYS from every reactor */
+#define CLIENT_WRITE_BLOCKED (1 << 4) /* waiting on EV_WRITE to write more */
+#define CLIENT_READ_PAUSED (1 << 5) /* over its soft output buffer limit */
+#define CLIENT_BLOCKED (1 << 6) /* waiting in a BPOP or BDEQUE */
+#define CLIENT_PROXY (1 << 7) /* stands in for a client to run a command */
+
+#define SERVER_OPS_SAMPLES 16
+
+struct blocked;
+
+/* clients waiting for an element, in the order they started waiting */
+typedef struct {
+    struct blocked* head; /* the longest waiting, served first */
+    struct blocked* tail;
+} blocked_list;
+
+struct reply_cache;
+struct shared_str;
+struct keys_stream;
+
+/* a value in a database's dict, along with what GET keeps for replying with
+ * it. Both are freed along with the value when it is overwritten or
+ * deleted */
+typedef struct {
+    object obj;
+    union {
+        /* arrays and maps: the RESP reply, with reply-cache on */
+        struct reply_cache* resp;
+        /* large strings: the contents, shared with the output buffers that
+         * are sending them */
+        struct shared_str* shared;
+    } reply;      /* NULL until the first GET */
+    uint64_t gen; /* the database's gen when the key was added */
+} db_value;
 
 typedef struct {
-    ht dict;
+    ht dict; /* object keys to db_values */
     set set;
     queue queue;
     vec* vec;
+    blocked_list pop_waiters;   /* clients in BPOP on an empty vec */
+    blocked_list deque_waiters; /* clients in BDEQUE on an empty queue */
+    struct keys_stream* keys_streams; /* KEYS replies still being sent */
+    uint64_t gen; /* bumped by every KEYS stream, to tell which keys are
+                     newer than it */
 } lexidb;
 
 typedef enum {
@@ -34,6 +78,8 @@ typedef enum {
 typedef struct {
     pid_t pid;                  /* the pid of the process */
     int sfd;                    /* the socket file descriptor */
+    int unix_sfd;               /* the unix socket, -1 if there is none */
+    vstr unixsocket;            /* the path of the unix socket */
     log_level log_level;        /* the amount to log */
     uint16_t flags;             /* no use as of now */
     uint16_t port;              /* the port the server is listening on*/
@@ -42,13 +88,43 @@ typedef struct {
     vstr addr;                  /* the host address as a vstr */
     vstr conf_file_path;        /* the path of the configuration file */
     size_t num_databases;       /* the number of databases */
+    size_t max_clients;         /* the most clients allowed to connect */
+    size_t backlog;             /* the backlog passed to listen() */
+    output_limit output_limits[CLIENT_CLASSES]; /* output buffer limits */
+    bool reply_cache;           /* cache RESP replies to GET of arrays and
+                                   maps */
+    bool io_uring;              /* run the event loops on io_uring */
+    size_t num_io_threads;      /* threads doing client io, including main */
+    struct io_threads* io_threads; /* the io thread pool, NULL if unthreaded */
+    vec* pending_reads;  /* clients for the io threads to read from */
+    vec* pending_writes; /* clients for the io threads to write to */
+    size_t reactor_id;          /* this event loop's index in reactors */
+    size_t num_reactors;        /* the number of event loops */
+    struct reactor* reactors;   /* every event loop, NULL if there is one */
+    uint8_t shard_seed[HT_SEED_SIZE]; /* seed for picking a key's reactor */
+    uint64_t next_client_id;    /* id given to the next accepted client */
     lexidb* db;                 /* the database */
     ev* ev;                     /* multiplexing api */
-    vec* clients;               /* vector of clients connected to the server */
+    struct client** clients;    /* connected clients, indexed by fd */
+    size_t clients_cap;         /* the number of slots in clients */
+    size_t num_clients;         /* the number of connected clients */
+    uint8_t* read_bufs;         /* spare client read buffers, linked through
+                                   their first bytes */
+    size_t num_read_bufs;       /* the number of buffers in read_bufs */
     vec* users;                 /* vector of users */
     struct cmd_help* help_cmds; /* array to all help comand structs */
     size_t help_cmds_len;       /* number of help cmds structs */
     uint64_t cmd_executed; /* the number of commands the server has processed */
+    uint64_t output_soft_pauses; /* times a client's reads were paused */
+    uint64_t output_hard_drops;  /* clients dropped for too much output */
+    long long cron_id;          /* the timer running server_cron */
+    struct blocked* unblocked;  /* served waiters, to run the commands they
+                                   held up */
+    long long unblock_id;       /* the timer running them, -1 if none */
+    uint64_t ops_samples[SERVER_OPS_SAMPLES]; /* recent commands per second */
+    size_t ops_sample_idx;      /* the slot the next sample goes in */
+    uint64_t ops_sample_cmds;   /* cmd_executed at the last sample */
+    struct timespec ops_sample_time; /* when the last sample was taken */
     struct timespec start_time; /* the time the server started */
 } server;
 
@@ -58,18 +134,35 @@ typedef struct {
     uint32_t flags; /* flags for the user */
 } user;
 
-typedef struct {
+typedef struct client {
     int fd;              /* file descriptor */
+    uint64_t id;         /* unique for the lifetime of its reactor */
     uint32_t addr;       /* address */
     uint16_t port;       /* port */
     uint16_t flags;      /* flags */
-    uint8_t* read_buf;   /* the buffer used in read() */
+    uint8_t* read_buf;   /* the buffer used in read(), NULL when idle */
     size_t read_pos;     /* the position in the buffer to read to */
     size_t read_cap;     /* the allocation size of read_buf */
-    uint8_t* write_buf;  /* pointer to buffer to write to client */
-    size_t write_size;   /* the amount to write */
+    frame_parser parser; /* progress through a partially received frame */
+    int proto;           /* the protocol requests are read in */
+    int has_bulk;        /* whether a large bulk string is being read */
+    vstr bulk;           /* the large bulk string, read straight into place */
+    size_t bulk_left;    /* the bytes of bulk still to be read */
+    size_t bulk_at;      /* where bulk belongs in the partial frame */
+    vec* cmds;           /* parsed commands waiting to be executed */
+    size_t cmds_pos;     /* the next command in cmds to execute */
+    size_t waiting;      /* replies still expected from other reactors */
+    builder gather;      /* KEYS replies collected from the reactors */
+    size_t gather_len;   /* the number of keys in gather */
+    int io_res;          /* result of the last read or write by an io thread */
+    int io_errno;        /* errno of the last failed read or write */
     size_t database_num; /* the database this connection uses */
     builder builder;     /* builder struct for constructing replies */
+    outbuf out;          /* replies that the socket has not taken yet */
+    struct client_shm* shm; /* the shared memory transport, NULL if none */
+    struct blocked* blocked; /* where it waits in BPOP or BDEQUE, NULL if it
+                                does not, or waits on another reactor */
+    struct keys_stream* keys; /* the KEYS reply being sent, NULL if none */
     user user;           /* the user associated with this connection */
     struct timespec time_connected; /* time this user connected */
 } client;
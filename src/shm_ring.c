@@ -0,0 +1,339 @@
+#define _GNU_SOURCE
+#include "shm_ring.h"
+#include "config.h"
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#if HAVE_EVENTFD
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define SHM_RING_MAGIC 0x6c657869 /* "lexi" */
+#define SHM_RING_VERSION 1
+#define SHM_RING_CACHE_LINE 64
+
+#define SHM_RING_MEM_FD 0
+#define SHM_RING_REQ_FD 1
+#define SHM_RING_REP_FD 2
+
+/* the size of the region can not change once it is mapped, or touching the
+ * part that went away would kill the server with SIGBUS */
+#define SHM_RING_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+typedef struct shm_ring_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t cap;
+    uint8_t pad[SHM_RING_CACHE_LINE - 16];
+} shm_ring_header;
+
+/* the producer and the consumer each own a cache line, so they do not
+ * bounce a line between them on every access */
+typedef struct shm_ring_buf {
+    uint64_t head; /* read position, only written by the consumer */
+    uint8_t pad0[SHM_RING_CACHE_LINE - 8];
+    uint64_t tail; /* write position, only written by the producer */
+    uint8_t pad1[SHM_RING_CACHE_LINE - 8];
+    uint32_t want_space; /* set by a producer waiting on a full ring */
+    uint8_t pad2[SHM_RING_CACHE_LINE - 4];
+    uint8_t data[];
+} shm_ring_buf;
+
+static size_t shm_ring_size(size_t cap) {
+    return sizeof(shm_ring_header) + 2 * (sizeof(shm_ring_buf) + cap);
+}
+
+static void shm_ring_layout(shm_ring* r, int is_server) {
+    uint8_t* base = (uint8_t*)r->header;
+    shm_ring_buf* req = (shm_ring_buf*)(base + sizeof(shm_ring_header));
+    shm_ring_buf* rep = (shm_ring_buf*)(base + sizeof(shm_ring_header) +
+                                        sizeof(shm_ring_buf) + r->cap);
+    r->in = is_server ? req : rep;
+    r->out = is_server ? rep : req;
+    r->wait_fd = r->fds[is_server ? SHM_RING_REQ_FD : SHM_RING_REP_FD];
+    r->wake_fd = r->fds[is_server ? SHM_RING_REP_FD : SHM_RING_REQ_FD];
+}
+
+static void shm_ring_init(shm_ring* r) {
+    size_t i;
+    memset(r, 0, sizeof *r);
+    for (i = 0; i < SHM_RING_NUM_FDS; ++i) {
+        r->fds[i] = -1;
+    }
+    r->wait_fd = r->wake_fd = -1;
+}
+
+static void shm_ring_signal(int fd) {
+    uint64_t one = 1;
+    /* the only failure is the counter overflowing, and then it is already
+     * signalled */
+    if (write(fd, &one, sizeof one) == -1) {
+        return;
+    }
+}
+
+#if HAVE_EVENTFD
+
+/* the server reads and writes the eventfds from its event loop, so they have
+ * to be eventfds, which never block for long, and must not block at all */
+static int shm_ring_check_eventfd(int fd) {
+    char path[64], target[32];
+    ssize_t len;
+    int flags;
+
+    snprintf(path, sizeof path, "/proc/self/fd/%d", fd);
+    len = readlink(path, target, sizeof target);
+    if (len != sizeof "anon_inode:[eventfd]" - 1 ||
+        memcmp(target, "anon_inode:[eventfd]", len) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    flags = fcntl(fd, F_GETFL);
+    if (flags == -1) {
+        return -1;
+    }
+    if (!(flags & O_NONBLOCK) && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+int shm_ring_create(shm_ring* r, size_t cap) {
+    void* mem;
+
+    shm_ring_init(r);
+
+    if (cap == 0 || (cap & (cap - 1)) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    r->cap = cap;
+    r->size = shm_ring_size(cap);
+
+    r->fds[SHM_RING_MEM_FD] =
+        memfd_create("lexidb", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (r->fds[SHM_RING_MEM_FD] == -1 ||
+        ftruncate(r->fds[SHM_RING_MEM_FD], r->size) == -1 ||
+        fcntl(r->fds[SHM_RING_MEM_FD], F_ADD_SEALS, SHM_RING_SEALS) == -1) {
+        shm_ring_free(r);
+        return -1;
+    }
+
+    r->fds[SHM_RING_REQ_FD] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    r->fds[SHM_RING_REP_FD] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (r->fds[SHM_RING_REQ_FD] == -1 || r->fds[SHM_RING_REP_FD] == -1) {
+        shm_ring_free(r);
+        return -1;
+    }
+
+    mem = mmap(NULL, r->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+               r->fds[SHM_RING_MEM_FD], 0);
+    if (mem == MAP_FAILED) {
+        shm_ring_free(r);
+        return -1;
+    }
+
+    /* ftruncate zero fills, so both rings start out empty */
+    r->header = mem;
+    r->header->magic = SHM_RING_MAGIC;
+    r->header->version = SHM_RING_VERSION;
+    r->header->cap = cap;
+    shm_ring_layout(r, 0);
+    return 0;
+}
+
+int shm_ring_attach(shm_ring* r, const int fds[SHM_RING_NUM_FDS]) {
+    struct stat st;
+    shm_ring_header header;
+    void* mem;
+    size_t i;
+    int seals;
+
+    shm_ring_init(r);
+    for (i = 0; i < SHM_RING_NUM_FDS; ++i) {
+        r->fds[i] = fds[i];
+    }
+
+    if (shm_ring_check_eventfd(r->fds[SHM_RING_REQ_FD]) == -1 ||
+        shm_ring_check_eventfd(r->fds[SHM_RING_REP_FD]) == -1) {
+        shm_ring_free(r);
+        return -1;
+    }
+
+    /* the size is only checked once, so it has to be sealed first */
+    seals = fcntl(r->fds[SHM_RING_MEM_FD], F_GET_SEALS);
+    if (seals == -1 || (seals & SHM_RING_SEALS) != SHM_RING_SEALS) {
+        shm_ring_free(r);
+        errno = EPERM;
+        return -1;
+    }
+
+    if (fstat(r->fds[SHM_RING_MEM_FD], &st) == -1) {
+        shm_ring_free(r);
+        return -1;
+    }
+
+    if ((size_t)st.st_size < sizeof header ||
+        pread(r->fds[SHM_RING_MEM_FD], &header, sizeof header, 0) !=
+            (ssize_t)sizeof header) {
+        shm_ring_free(r);
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* the client picked the geometry, so check it before trusting it */
+    if (header.magic != SHM_RING_MAGIC || header.version != SHM_RING_VERSION ||
+        header.cap == 0 || (header.cap & (header.cap - 1)) != 0 ||
+        header.cap > (uint64_t)st.st_size ||
+        shm_ring_size(header.cap) != (size_t)st.st_size) {
+        shm_ring_free(r);
+        errno = EINVAL;
+        return -1;
+    }
+
+    r->cap = header.cap;
+    r->size = st.st_size;
+
+    mem = mmap(NULL, r->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+               r->fds[SHM_RING_MEM_FD], 0);
+    if (mem == MAP_FAILED) {
+        shm_ring_free(r);
+        return -1;
+    }
+
+    r->header = mem;
+    shm_ring_layout(r, 1);
+    return 0;
+}
+
+#else
+
+int shm_ring_create(shm_ring* r, size_t cap) {
+    (void)cap;
+    shm_ring_init(r);
+    errno = ENOSYS;
+    return -1;
+}
+
+int shm_ring_attach(shm_ring* r, const int fds[SHM_RING_NUM_FDS]) {
+    size_t i;
+    shm_ring_init(r);
+    for (i = 0; i < SHM_RING_NUM_FDS; ++i) {
+        close(fds[i]);
+    }
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif
+
+/* the stores to head and tail and the loads of the other side's position
+ * are sequentially consistent. Whichever side moves second is then
+ * guaranteed to see the first, so either the reader notices new data before
+ * going to sleep or the writer notices that it has to wake the reader */
+
+ssize_t shm_ring_write(shm_ring* r, const void* data, size_t len) {
+    shm_ring_buf* ring = r->out;
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+    uint64_t tail = ring->tail;
+    size_t used = tail - head;
+    size_t amt, idx, first;
+
+    if (used > r->cap) {
+        return -1;
+    }
+
+    amt = r->cap - used;
+    if (amt > len) {
+        amt = len;
+    }
+    if (amt == 0) {
+        return 0;
+    }
+
+    idx = tail & (r->cap - 1);
+    first = r->cap - idx;
+    if (first > amt) {
+        first = amt;
+    }
+    memcpy(ring->data + idx, data, first);
+    memcpy(ring->data, (const uint8_t*)data + first, amt - first);
+
+    __atomic_store_n(&ring->tail, tail + amt, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == tail) {
+        shm_ring_signal(r->wake_fd);
+    }
+
+    return amt;
+}
+
+ssize_t shm_ring_read(shm_ring* r, void* out, size_t len) {
+    shm_ring_buf* ring = r->in;
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+    uint64_t head = ring->head;
+    size_t used = tail - head;
+    size_t amt, idx, first;
+
+    if (used > r->cap) {
+        return -1;
+    }
+
+    amt = used < len ? used : len;
+    if (amt == 0) {
+        return 0;
+    }
+
+    idx = head & (r->cap - 1);
+    first = r->cap - idx;
+    if (first > amt) {
+        first = amt;
+    }
+    memcpy(out, ring->data + idx, first);
+    memcpy((uint8_t*)out + first, ring->data, amt - first);
+
+    __atomic_store_n(&ring->head, head + amt, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->want_space, __ATOMIC_SEQ_CST) &&
+        __atomic_exchange_n(&ring->want_space, 0, __ATOMIC_SEQ_CST)) {
+        shm_ring_signal(r->wake_fd);
+    }
+
+    return amt;
+}
+
+int shm_ring_wait_space(shm_ring* r) {
+    shm_ring_buf* ring = r->out;
+    __atomic_store_n(&ring->want_space, 1, __ATOMIC_SEQ_CST);
+    return ring->tail - __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) >=
+           r->cap;
+}
+
+void shm_ring_clear_wakeup(shm_ring* r) {
+    uint64_t count;
+    if (read(r->wait_fd, &count, sizeof count) == -1) {
+        return;
+    }
+}
+
+void shm_ring_free(shm_ring* r) {
+    size_t i;
+#if HAVE_EVENTFD
+    if (r->header != NULL) {
+        munmap(r->header, r->size);
+    }
+#endif
+    r->header = NULL;
+    for (i = 0; i < SHM_RING_NUM_FDS; ++i) {
+        if (r->fds[i] != -1) {
+            close(r->fds[i]);
+            r->fds[i] = -1;
+        }
+    }
+}
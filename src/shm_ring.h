@@ -0,0 +1,83 @@
+#ifndef __SHM_RING_H__
+
+#define __SHM_RING_H__
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define SHM_RING_DEFAULT_CAP (1 << 20)
+#define SHM_RING_NUM_FDS 3
+
+struct shm_ring_header;
+struct shm_ring_buf;
+
+/**
+ * @brief a shared memory transport between one client and the server
+ *
+ * The region holds two single-producer single-consumer byte rings, one for
+ * requests and one for replies. Reading and writing them is plain memory
+ * access. An eventfd is only written when a ring goes from empty to
+ * non-empty, or when a writer waiting for space is given some, so a busy
+ * connection makes almost no system calls.
+ *
+ * The client creates the region and passes its fds to the server over a
+ * unix socket, and the server attaches to it.
+ */
+typedef struct shm_ring {
+    struct shm_ring_header* header;
+    size_t size;                /* the size of the mapping */
+    size_t cap;                 /* the data capacity of each ring */
+    struct shm_ring_buf* in;    /* the ring this side reads */
+    struct shm_ring_buf* out;   /* the ring this side writes */
+    int fds[SHM_RING_NUM_FDS];  /* memory, request eventfd, reply eventfd */
+    int wait_fd;                /* signalled when there is something to do */
+    int wake_fd;                /* signalled to get the other side going */
+} shm_ring;
+
+/**
+ * @brief create a region as the client
+ * @param r the ring to set up
+ * @param cap the capacity of each ring. Must be a power of 2
+ * @returns 0 on success, -1 with errno set on failure
+ */
+int shm_ring_create(shm_ring* r, size_t cap);
+/**
+ * @brief attach to a region created by a client, as the server. The region
+ * must be sealed against resizing and the other two fds must be eventfds,
+ * which are made non-blocking. The ring takes ownership of the fds, even on
+ * failure
+ * @param r the ring to set up
+ * @param fds the fds from shm_ring_create, in the same order
+ * @returns 0 on success, -1 with errno set on failure
+ */
+int shm_ring_attach(shm_ring* r, const int fds[SHM_RING_NUM_FDS]);
+/**
+ * @brief copy as much of data into the outgoing ring as fits
+ * @returns the number of bytes copied, or -1 if the other side has corrupted
+ * the ring
+ */
+ssize_t shm_ring_write(shm_ring* r, const void* data, size_t len);
+/**
+ * @brief copy up to len bytes out of the incoming ring
+ * @returns the number of bytes copied, 0 if the ring is empty, or -1 if the
+ * other side has corrupted the ring
+ */
+ssize_t shm_ring_read(shm_ring* r, void* out, size_t len);
+/**
+ * @brief ask the other side to signal wait_fd once it frees space in the
+ * outgoing ring
+ * @returns 1 if the ring is still full and the caller should wait, or 0 if
+ * space showed up in the meantime and the write should be retried
+ */
+int shm_ring_wait_space(shm_ring* r);
+/**
+ * @brief reset wait_fd. Must be called before checking the rings, so that a
+ * signal sent after the check is not lost
+ */
+void shm_ring_clear_wakeup(shm_ring* r);
+/**
+ * @brief unmap the region and close every fd
+ */
+void shm_ring_free(shm_ring* r);
+
+#endif /* __SHM_RING_H__ */
@@ -6,6 +6,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <memory.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -19,11 +20,14 @@
 volatile sig_atomic_t sig_int_received = 0;
 
 void get_random_bytes(uint8_t* p, size_t len) {
-    /* global */
+    /* global, ht_new is called from the io threads while parsing */
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
     static int seed_initialized = 0;
     static uint8_t seed[64];
     static uint64_t counter = 0;
 
+    pthread_mutex_lock(&lock);
+
     if (!seed_initialized) {
         FILE* fp = fopen("/dev/urandom", "r");
         if (fp == NULL || fread(seed, sizeof(seed), 1, fp) != 1) {
@@ -73,6 +77,8 @@ void get_random_bytes(uint8_t* p, size_t len) {
         len -= copylen;
         p += copylen;
     }
+
+    pthread_mutex_unlock(&lock);
 }
 
 struct timespec get_time(void) {
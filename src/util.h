@@ -14,6 +14,9 @@ typedef int cmp_fn(void* a, void* b);
 
 typedef void free_fn(void* ptr);
 
+/* set by the SIGINT handler */
+extern volatile sig_atomic_t sig_int_received;
+
 void get_random_bytes(uint8_t* p, size_t len);
 
 struct timespec get_time(void);
@@ -26,13 +26,16 @@ vstr vstr_new(void) {
 
 vstr vstr_new_len(size_t len) {
     vstr s = {0};
+    s.small_avail = VSTR_MAX_SMALL_SIZE;
     if (len > VSTR_MAX_SMALL_SIZE) {
-        assert(len <= VSTR_MAX_LARGE_SIZE);
         s.str_data.lg = vstr_lg_new_len(len);
+        if (s.str_data.lg.cap == 0) {
+            return s;
+        }
+        s.small_avail = 0;
         s.is_large = 1;
         return s;
     }
-    s.small_avail = VSTR_MAX_SMALL_SIZE;
     return s;
 }
 
@@ -82,6 +85,10 @@ vstr vstr_format(const char* fmt, ...) {
     size = ((size_t)n + 1);
 
     s = vstr_new_len(size);
+    /* out of memory, so it stays empty */
+    if (!s.is_large && size > VSTR_MAX_SMALL_SIZE) {
+        return s;
+    }
 
     if (s.is_large) {
         va_start(ap, fmt);
@@ -190,13 +197,67 @@ int vstr_push_string_len(vstr* s, const char* str, size_t str_len) {
     return vstr_lg_push_string(&(s->str_data.lg), str, str_len);
 }
 
+char* vstr_spare(vstr* s, size_t* avail) {
+    if (s->is_large) {
+        vstr_lg* lg = &(s->str_data.lg);
+        /* one byte is kept for the null terminator */
+        *avail = lg->cap == 0 ? 0 : lg->cap - 1 - lg->len;
+        return lg->data + lg->len;
+    }
+    *avail = s->small_avail;
+    return s->str_data.sm.data + (VSTR_MAX_SMALL_SIZE - s->small_avail);
+}
+
+void vstr_commit(vstr* s, size_t len) {
+    if (s->is_large) {
+        s->str_data.lg.len += len;
+        return;
+    }
+    s->small_avail -= len;
+}
+
+char* vstr_reserve(vstr* s, size_t len) {
+    size_t avail;
+    char* spare = vstr_spare(s, &avail);
+    vstr_lg* lg;
+    if (avail >= len) {
+        return spare;
+    }
+    if (!s->is_large) {
+        vstr_lg new_lg = vstr_make_lg_len(s->str_data.sm.data, vstr_len(s));
+        if (new_lg.cap == 0) {
+            return NULL;
+        }
+        s->str_data.lg = new_lg;
+        s->is_large = 1;
+    }
+    lg = &(s->str_data.lg);
+    if ((lg->len + len) > VSTR_MAX_LARGE_SIZE) {
+        return NULL;
+    }
+    if (vstr_realloc_lg_len(lg, lg->len, lg->cap, len) == -1) {
+        return NULL;
+    }
+    return lg->data + lg->len;
+}
+
+void vstr_clear(vstr* s) {
+    if (s->is_large) {
+        /* the bytes after the string must stay zeroed for the terminator */
+        memset(s->str_data.lg.data, 0, s->str_data.lg.len);
+        s->str_data.lg.len = 0;
+        return;
+    }
+    vstr_reset(s);
+}
+
 void vstr_reset(vstr* s) {
     if (s->is_large) {
         free(s->str_data.lg.data);
         s->is_large = 0;
-    } else {
-        memset(s->str_data.sm.data, 0, VSTR_MAX_SMALL_SIZE);
     }
+    /* the large string's fields shared these bytes */
+    memset(s->str_data.sm.data, 0, VSTR_MAX_SMALL_SIZE);
     s->small_avail = VSTR_MAX_SMALL_SIZE;
     return;
 }
@@ -225,10 +286,14 @@ static vstr_lg vstr_make_lg(const char* data) {
 
 static vstr_lg vstr_lg_new_len(size_t len) {
     vstr_lg lg = {0};
-    lg.len = 0;
-    lg.cap = len + 1;
+    if (len >= VSTR_MAX_LARGE_SIZE) {
+        return lg;
+    }
     lg.data = calloc(len + 1, sizeof(char));
-    assert(lg.data != NULL);
+    if (lg.data == NULL) {
+        return lg;
+    }
+    lg.cap = len + 1;
     return lg;
 }
 
@@ -321,10 +386,16 @@ static int vstr_realloc_lg(vstr_lg* lg, size_t len, size_t cap) {
     return 0;
 }
 
+/* grows by at least double, so a string built up by many small pushes is
+ * copied a logarithmic number of times */
 static int vstr_realloc_lg_len(vstr_lg* lg, size_t len, size_t cap,
                                size_t new_len) {
     void* tmp;
-    cap += new_len;
+    size_t min_cap = len + new_len + 1;
+    cap <<= 1;
+    if (cap < min_cap) {
+        cap = min_cap;
+    }
     tmp = realloc(lg->data, cap);
     if (tmp == NULL) {
         return -1;
@@ -72,7 +72,8 @@ vstr vstr_new(void);
 /**
  * @brief create a new vstr with capacity len + 1
  * @param len the length to reserve
- * @returns a vstr
+ * @returns a vstr, which is an empty small string if the memory could not be
+ * allocated. vstr_spare tells the two apart
  */
 vstr vstr_new_len(size_t len);
 /**
@@ -137,6 +138,35 @@ int vstr_push_string(vstr* s, const char* str);
  * @returns 0 on success, -1 on failure
  */
 int vstr_push_string_len(vstr* s, const char* str, size_t str_len);
+/**
+ * @brief get the unused space at the end of a vstr, so it can be written to
+ * directly, for example by read(). Create the vstr with vstr_new_len to have
+ * room for everything that will be written
+ * @param s the vstr
+ * @param avail set to the number of bytes that can be written
+ * @returns a pointer to the end of the string
+ */
+char* vstr_spare(vstr* s, size_t* avail);
+/**
+ * @brief add bytes written through vstr_spare to the length of a vstr
+ * @param s the vstr
+ * @param len the number of bytes written. Must not be more than the space
+ * vstr_spare reported
+ */
+void vstr_commit(vstr* s, size_t len);
+/**
+ * @brief make room for at least len more bytes at the end of a vstr, so they
+ * can be written directly and then added with vstr_commit
+ * @param s the vstr
+ * @param len the number of bytes that will be written
+ * @returns a pointer to the end of the string, or NULL if it could not grow
+ */
+char* vstr_reserve(vstr* s, size_t len);
+/**
+ * @brief empty a vstr, keeping its allocation for reuse
+ * @param s the vstr to clear
+ */
+void vstr_clear(vstr* s);
 /**
  * @brief reset the vstr
  * @param s the vstr to reset
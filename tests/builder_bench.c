@@ -0,0 +1,104 @@
+#define _POSIX_C_SOURCE 199309L
+#include "../src/builder.h"
+#include "../src/ht.h"
+#include "../src/object.h"
+#include "../src/proto.h"
+#include "../src/vstr.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* not run by ctest. Times building the reply to KEYS the way the server
+ * does, over a dict of string keys:
+ *   ./tests/builder_bench [keys] */
+
+#define DEFAULT_KEYS 1000000
+#define ROUNDS 5
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static int bench_object_cmp(void* a, void* b) { return object_cmp(a, b); }
+
+static void bench_free_object(void* ptr) { object_free(ptr); }
+
+/* the fastest of ROUNDS replies, in milliseconds. The builder is reused, as
+ * a client's is */
+static double run_keys(ht* dict, int proto, size_t* reply_len) {
+    builder b = builder_new();
+    double best = 0;
+    size_t round;
+
+    builder_set_proto(&b, proto);
+    for (round = 0; round < ROUNDS; ++round) {
+        double start = now(), elapsed;
+        ht_iter iter = ht_iter_new(dict);
+        builder_add_array(&b, dict->num_entries);
+        while (iter.cur) {
+            builder_add_object(&b, ht_entry_get_key(iter.cur));
+            ht_iter_next(&iter);
+        }
+        elapsed = now() - start;
+        *reply_len = builder_len(&b);
+        builder_reset(&b);
+        if (round == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    builder_free(&b);
+    return best * 1e3;
+}
+
+static double run_ints(int proto, size_t n) {
+    builder b = builder_new();
+    double start, elapsed;
+    size_t i;
+
+    builder_set_proto(&b, proto);
+    start = now();
+    for (i = 0; i < n; ++i) {
+        builder_add_int(&b, (int64_t)(i * 2654435761u));
+        builder_add_int(&b, i & 511);
+        builder_reset(&b);
+    }
+    elapsed = now() - start;
+    builder_free(&b);
+    return (elapsed / n) * 1e9;
+}
+
+int main(int argc, char* argv[]) {
+    ht dict = ht_new(sizeof(object), bench_object_cmp);
+    size_t i, num_keys = DEFAULT_KEYS, reply_len = 0;
+    double ms;
+
+    if (argc > 1) {
+        num_keys = strtoul(argv[1], NULL, 10);
+        if (num_keys == 0) {
+            fprintf(stderr, "usage: %s [keys]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    for (i = 0; i < num_keys; ++i) {
+        vstr key_str = vstr_format("key:%lu", i);
+        object key = object_new(String, &key_str);
+        int64_t num = i;
+        object value = object_new(Int, &num);
+        ht_insert(&dict, &key, sizeof(object), &value, bench_free_object,
+                  bench_free_object);
+    }
+
+    ms = run_keys(&dict, PROTO_RESP, &reply_len);
+    printf("keys resp      %8.1f ms %6.1f MB\n", ms, reply_len / 1e6);
+    ms = run_keys(&dict, PROTO_BIN, &reply_len);
+    printf("keys bin       %8.1f ms %6.1f MB\n", ms, reply_len / 1e6);
+    printf("int replies    %8.1f ns/op\n", run_ints(PROTO_RESP, num_keys));
+
+    ht_free(&dict, bench_free_object, bench_free_object);
+    return 0;
+}
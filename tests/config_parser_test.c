@@ -103,6 +103,190 @@ port 1234\n\
 }
 END_TEST
 
+START_TEST(test_maxclients) {
+    const char* input = "\
+# maxclients\n\
+maxclients 50000\n\
+\n\
+";
+    result(config) config_res = parse_config(input, strlen(input));
+    config config;
+    check_error(&config_res);
+    config = config_res.data.ok;
+    ck_assert_uint_eq(config.max_clients, 50000);
+    config_free(&config);
+}
+END_TEST
+
+START_TEST(test_backlog) {
+    const char* input = "\
+# backlog\n\
+backlog 1024\n\
+\n\
+";
+    result(config) config_res = parse_config(input, strlen(input));
+    config config;
+    check_error(&config_res);
+    config = config_res.data.ok;
+    ck_assert_uint_eq(config.backlog, 1024);
+    config_free(&config);
+}
+END_TEST
+
+START_TEST(test_io_threads) {
+    const char* input = "\
+# io-threads\n\
+io-threads 4\n\
+";
+    result(config) config_res = parse_config(input, strlen(input));
+    config config;
+    check_error(&config_res);
+    config = config_res.data.ok;
+    ck_assert_uint_eq(config.io_threads, 4);
+    config_free(&config);
+}
+END_TEST
+
+START_TEST(test_reactors) {
+    const char* input = "\
+# reactors\n\
+reactors 8\n\
+";
+    result(config) config_res = parse_config(input, strlen(input));
+    config config;
+    check_error(&config_res);
+    config = config_res.data.ok;
+    ck_assert_uint_eq(config.reactors, 8);
+    config_free(&config);
+}
+END_TEST
+
+START_TEST(test_unixsocket) {
+    const char* input = "\
+# unixsocket\n\
+unixsocket /tmp/lexidb.sock\n\
+";
+    result(config) config_res = parse_config(input, strlen(input));
+    config config;
+    check_error(&config_res);
+    config = config_res.data.ok;
+    ck_assert_str_eq(vstr_data(&config.unixsocket), "/tmp/lexidb.sock");
+    config_free(&config);
+}
+END_TEST
+
+START_TEST(test_client_output_buffer_limit) {
+    const char* input = "\
+# client-output-buffer-limit\n\
+client-output-buffer-limit normal 256mb 32mb\n\
+client-output-buffer-limit shm 0 1024\n\
+";
+    result(config) config_res = parse_config(input, strlen(input));
+    config config;
+    check_error(&config_res);
+    config = config_res.data.ok;
+    ck_assert(config.output_limits_set[ClientNormal]);
+    ck_assert_uint_eq(config.output_limits[ClientNormal].hard, 256 << 20);
+    ck_assert_uint_eq(config.output_limits[ClientNormal].soft, 32 << 20);
+    ck_assert(config.output_limits_set[ClientShm]);
+    ck_assert_uint_eq(config.output_limits[ClientShm].hard, 0);
+    ck_assert_uint_eq(config.output_limits[ClientShm].soft, 1024);
+    config_free(&config);
+}
+END_TEST
+
+START_TEST(test_invalid_client_output_buffer_limit) {
+    const char* inputs[] = {
+        "client-output-buffer-limit pubsub 1mb 1mb\n",
+        "client-output-buffer-limit normal 1mb\n",
+        "client-output-buffer-limit normal 1tb 1mb\n",
+        "client-output-buffer-limit normal 18446744073709551617 0\n",
+        "client-output-buffer-limit normal 36893488147419103232kb 0\n",
+        "client-output-buffer-limit normal 1mb 2mb\n",
+        "client-output-buffer-limit normal 2mb 1mb\n\
+client-output-buffer-limit normal 4mb 1mb\n",
+    };
+    size_t i;
+    for (i = 0; i < sizeof inputs / sizeof inputs[0]; ++i) {
+        result(config) config_res = parse_config(inputs[i], strlen(inputs[i]));
+        ck_assert(config_res.type == Err);
+        vstr_free(&config_res.data.err);
+    }
+}
+END_TEST
+
+START_TEST(test_reply_cache) {
+    const char* input = "\
+# reply-cache\n\
+reply-cache yes\n\
+";
+    const char* invalid[] = {
+        "reply-cache on\n",
+        "reply-cache yes no\n",
+        "reply-cache no\nreply-cache yes\n",
+    };
+    result(config) config_res = parse_config(input, strlen(input));
+    config config;
+    size_t i;
+    check_error(&config_res);
+    config = config_res.data.ok;
+    ck_assert(config.reply_cache_set);
+    ck_assert(config.reply_cache);
+    config_free(&config);
+
+    for (i = 0; i < sizeof invalid / sizeof invalid[0]; ++i) {
+        config_res = parse_config(invalid[i], strlen(invalid[i]));
+        ck_assert(config_res.type == Err);
+        vstr_free(&config_res.data.err);
+    }
+}
+END_TEST
+
+START_TEST(test_io_uring) {
+    const char* input = "\
+# io-uring\n\
+io-uring yes\n\
+";
+    const char* invalid[] = {
+        "io-uring 1\n",
+        "io-uring no\nio-uring yes\n",
+    };
+    result(config) config_res = parse_config(input, strlen(input));
+    config config;
+    size_t i;
+    check_error(&config_res);
+    config = config_res.data.ok;
+    ck_assert(config.io_uring_set);
+    ck_assert(config.io_uring);
+    config_free(&config);
+
+    for (i = 0; i < sizeof invalid / sizeof invalid[0]; ++i) {
+        config_res = parse_config(invalid[i], strlen(invalid[i]));
+        ck_assert(config_res.type == Err);
+        vstr_free(&config_res.data.err);
+    }
+}
+END_TEST
+
+START_TEST(test_invalid_maxclients) {
+    const char* inputs[] = {
+        "maxclients lots\n",
+        "maxclients 0\n",
+        "backlog 0\n",
+        "io-threads 0\n",
+        "reactors 0\n",
+        "maxclients 18446744073709551616\n",
+        "backlog 99999999999999999999999\n",
+    };
+    size_t i;
+    for (i = 0; i < sizeof inputs / sizeof inputs[0]; ++i) {
+        result(config) config_res = parse_config(inputs[i], strlen(inputs[i]));
+        ck_assert(config_res.type == Err);
+        vstr_free(&config_res.data.err);
+    }
+}
+END_TEST
+
 START_TEST(test_all) {
     const char* input = "\
 # users\n\
@@ -119,6 +303,17 @@ address 127.0.0.1\n\
 # port\n\
 port 1234\n\
 \n\
+# maxclients\n\
+maxclients 50000\n\
+\n\
+# backlog\n\
+backlog 1024\n\
+\n\
+# io-threads\n\
+io-threads 4\n\
+\n\
+# reactors\n\
+reactors 8\n\
 ";
     result(config) config_res = parse_config(input, strlen(input));
     config config;
@@ -142,6 +337,14 @@ port 1234\n\
 
     ck_assert_uint_eq(config.port, 1234);
 
+    ck_assert_uint_eq(config.max_clients, 50000);
+
+    ck_assert_uint_eq(config.backlog, 1024);
+
+    ck_assert_uint_eq(config.io_threads, 4);
+
+    ck_assert_uint_eq(config.reactors, 8);
+
     config_free(&config);
 }
 END_TEST
@@ -156,6 +359,16 @@ Suite* suite(void) {
     tcase_add_test(tc_core, test_address);
     tcase_add_test(tc_core, test_loglevel);
     tcase_add_test(tc_core, test_port);
+    tcase_add_test(tc_core, test_maxclients);
+    tcase_add_test(tc_core, test_backlog);
+    tcase_add_test(tc_core, test_io_threads);
+    tcase_add_test(tc_core, test_reactors);
+    tcase_add_test(tc_core, test_unixsocket);
+    tcase_add_test(tc_core, test_client_output_buffer_limit);
+    tcase_add_test(tc_core, test_invalid_client_output_buffer_limit);
+    tcase_add_test(tc_core, test_reply_cache);
+    tcase_add_test(tc_core, test_io_uring);
+    tcase_add_test(tc_core, test_invalid_maxclients);
     tcase_add_test(tc_core, test_all);
     suite_add_tcase(s, tc_core);
     return s;
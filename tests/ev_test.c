@@ -0,0 +1,243 @@
+#include "../src/ev.h"
+#include <check.h>
+#include <stdlib.h>
+
+#define MAX_FIRED 64
+
+/* what the timers did, in the order they did it */
+typedef struct {
+    long long ids[MAX_FIRED];
+    int tags[MAX_FIRED];
+    size_t num_fired;
+} fired_log;
+
+typedef struct {
+    fired_log* log;
+    int tag;
+    int runs_left;     /* reschedules until this reaches 0 */
+    long long every;   /* the interval it reschedules itself with */
+    long long del_id;  /* a timer deleted from the callback, or -1 */
+    long long* own_id; /* deleted from the callback when not NULL */
+} timer_arg;
+
+static long long record(ev* ev, long long id, void* data) {
+    timer_arg* arg = data;
+    fired_log* log = arg->log;
+    ck_assert_uint_lt(log->num_fired, MAX_FIRED);
+    log->ids[log->num_fired] = id;
+    log->tags[log->num_fired] = arg->tag;
+    log->num_fired++;
+
+    if (arg->del_id != -1) {
+        ck_assert_int_eq(ev_del_timer(ev, arg->del_id), 0);
+        arg->del_id = -1;
+    }
+    if (arg->own_id != NULL) {
+        ck_assert_int_eq(ev_del_timer(ev, *arg->own_id), 0);
+        /* deleted, so what it returns is ignored */
+        return 1;
+    }
+    if (arg->runs_left > 0) {
+        arg->runs_left--;
+        return arg->every;
+    }
+    return EV_TIMER_NOMORE;
+}
+
+static timer_arg new_arg(fired_log* log, int tag) {
+    timer_arg arg = {0};
+    arg.log = log;
+    arg.tag = tag;
+    arg.del_id = -1;
+    return arg;
+}
+
+START_TEST(test_timer_order) {
+    ev* ev = ev_new(8, 0);
+    fired_log log = {0};
+    /* due out of the order they are added in, and two at the same time */
+    long long ms[] = {30, 10, 50, 20, 0, 40, 20};
+    int order[] = {4, 1, 3, 6, 0, 5, 2};
+    timer_arg args[sizeof ms / sizeof ms[0]];
+    size_t i;
+
+    for (i = 0; i < sizeof ms / sizeof ms[0]; ++i) {
+        args[i] = new_arg(&log, i);
+        ck_assert_int_ne(ev_add_timer(ev, ms[i], record, &args[i]), -1);
+    }
+
+    /* returns once there are no timers left */
+    ev_await(ev);
+
+    ck_assert_uint_eq(log.num_fired, sizeof ms / sizeof ms[0]);
+    for (i = 0; i < log.num_fired; ++i) {
+        if (ms[order[i]] != 20) {
+            ck_assert_int_eq(log.tags[i], order[i]);
+        }
+    }
+    /* the two due at 20ms in either order */
+    ck_assert_int_eq(log.tags[2] + log.tags[3], 3 + 6);
+    ck_assert_int_eq(ev_next_timeout(ev), -1);
+    ev_free(ev);
+}
+END_TEST
+
+START_TEST(test_timer_delete) {
+    ev* ev = ev_new(8, 0);
+    fired_log log = {0};
+    timer_arg self = new_arg(&log, 0), killer = new_arg(&log, 1);
+    timer_arg victim = new_arg(&log, 2), deleted = new_arg(&log, 3);
+    long long self_id, victim_id, deleted_id;
+
+    /* deleting itself from the callback stops it being rescheduled */
+    self_id = ev_add_timer(ev, 0, record, &self);
+    self.own_id = &self_id;
+
+    /* one callback deleting another timer */
+    victim_id = ev_add_timer(ev, 20, record, &victim);
+    killer.del_id = victim_id;
+    ck_assert_int_ne(ev_add_timer(ev, 5, record, &killer), -1);
+
+    /* and one deleted before it is due */
+    deleted_id = ev_add_timer(ev, 10, record, &deleted);
+    ck_assert_int_eq(ev_del_timer(ev, deleted_id), 0);
+    ck_assert_int_eq(ev_del_timer(ev, deleted_id), -1);
+
+    ev_await(ev);
+
+    ck_assert_uint_eq(log.num_fired, 2);
+    ck_assert_int_eq(log.tags[0], 0);
+    ck_assert_int_eq(log.ids[0], self_id);
+    ck_assert_int_eq(log.tags[1], 1);
+
+    /* the slots are reused, but not the ids */
+    ck_assert_int_eq(ev_del_timer(ev, self_id), -1);
+    ck_assert_int_eq(ev_del_timer(ev, victim_id), -1);
+    ck_assert_int_ne(ev_add_timer(ev, 0, record, &deleted), self_id);
+    ev_free(ev);
+}
+END_TEST
+
+START_TEST(test_timer_reschedule) {
+    ev* ev = ev_new(8, 0);
+    fired_log log = {0};
+    timer_arg every_ms = new_arg(&log, 0), slow = new_arg(&log, 1);
+    long long id;
+    size_t i, slow_at = 0;
+
+    /* returning 0 waits for the next loop rather than running again now */
+    every_ms.runs_left = 4;
+    every_ms.every = 0;
+    id = ev_add_timer(ev, 0, record, &every_ms);
+    slow.runs_left = 1;
+    slow.every = 30;
+    ck_assert_int_ne(ev_add_timer(ev, 10, record, &slow), -1);
+
+    ev_await(ev);
+
+    ck_assert_uint_eq(log.num_fired, 5 + 2);
+    for (i = 0; i < log.num_fired; ++i) {
+        if (log.tags[i] == 0) {
+            ck_assert_int_eq(log.ids[i], id);
+        } else {
+            slow_at = i;
+        }
+    }
+    /* the second run of slow comes 30ms after everything else */
+    ck_assert_uint_eq(slow_at, log.num_fired - 1);
+    ev_free(ev);
+}
+END_TEST
+
+START_TEST(test_timer_many) {
+    ev* ev = ev_new(8, 0);
+    fired_log log = {0};
+    timer_arg args[2 * MAX_FIRED];
+    long long ids[2 * MAX_FIRED];
+    size_t i;
+
+    /* deleting from the middle of the heap keeps it ordered, and every
+     * other timer is deleted */
+    srand(7);
+    for (i = 0; i < 2 * MAX_FIRED; ++i) {
+        args[i] = new_arg(&log, rand() % 50);
+        ids[i] = ev_add_timer(ev, args[i].tag, record, &args[i]);
+        ck_assert_int_ne(ids[i], -1);
+    }
+    for (i = 0; i < 2 * MAX_FIRED; i += 2) {
+        ck_assert_int_eq(ev_del_timer(ev, ids[i]), 0);
+        ck_assert_int_eq(ev_del_timer(ev, ids[i]), -1);
+    }
+
+    ev_await(ev);
+
+    ck_assert_uint_eq(log.num_fired, MAX_FIRED);
+    for (i = 0; i < log.num_fired; ++i) {
+        size_t j = 0;
+        while (ids[j] != log.ids[i]) {
+            j++;
+        }
+        ck_assert_uint_eq(j % 2, 1);
+        /* adding them may have crossed a millisecond */
+        if (i > 0) {
+            ck_assert_int_ge(log.tags[i] + 1, log.tags[i - 1]);
+        }
+    }
+    ev_free(ev);
+}
+END_TEST
+
+START_TEST(test_next_timeout) {
+    ev* ev = ev_new(8, 0);
+    fired_log log = {0};
+    timer_arg arg = new_arg(&log, 0);
+    long long far, near, ms;
+
+    ck_assert_int_eq(ev_next_timeout(ev), -1);
+
+    far = ev_add_timer(ev, 5000, record, &arg);
+    ms = ev_next_timeout(ev);
+    ck_assert(ms > 4000 && ms <= 5000);
+
+    near = ev_add_timer(ev, 300, record, &arg);
+    ms = ev_next_timeout(ev);
+    ck_assert(ms > 200 && ms <= 300);
+
+    ck_assert_int_eq(ev_del_timer(ev, near), 0);
+    ms = ev_next_timeout(ev);
+    ck_assert(ms > 4000 && ms <= 5000);
+
+    /* one that is already due */
+    ck_assert_int_ne(ev_add_timer(ev, -10, record, &arg), -1);
+    ck_assert_int_eq(ev_next_timeout(ev), 0);
+
+    ck_assert_int_eq(ev_del_timer(ev, far), 0);
+    ev_free(ev);
+}
+END_TEST
+
+Suite* suite() {
+    Suite* s;
+    TCase* tc_core;
+    s = suite_create("ev");
+    tc_core = tcase_create("Core");
+    tcase_add_test(tc_core, test_timer_order);
+    tcase_add_test(tc_core, test_timer_delete);
+    tcase_add_test(tc_core, test_timer_reschedule);
+    tcase_add_test(tc_core, test_timer_many);
+    tcase_add_test(tc_core, test_next_timeout);
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main() {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+    s = suite();
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -80,12 +80,63 @@ START_TEST(test_it_works) {
 }
 END_TEST
 
+#define SCAN_KEYS 1000
+
+static void count_seen(ht_entry* e, void* arg) {
+    int* seen = arg;
+    const int* val = ht_entry_get_value(e);
+    seen[*val]++;
+}
+
+START_TEST(test_scan) {
+    ht ht = ht_new(sizeof(int), NULL);
+    int seen[SCAN_KEYS * 2] = {0};
+    ht_scan_cursor cursor;
+    int i, more, calls = 0;
+
+    for (i = 0; i < SCAN_KEYS; ++i) {
+        ck_assert_int_eq(ht_insert(&ht, &i, sizeof i, &i, NULL, NULL), HT_OK);
+    }
+    cursor = ht_scan_new(&ht);
+
+    /* grow the table part way through, and delete some keys the scan has
+     * not reached */
+    do {
+        more = ht_scan(&ht, &cursor, count_seen, seen);
+        if (++calls == 100) {
+            for (i = SCAN_KEYS; i < SCAN_KEYS * 2; ++i) {
+                ck_assert_int_eq(ht_insert(&ht, &i, sizeof i, &i, NULL, NULL),
+                                 HT_OK);
+            }
+            for (i = 0; i < SCAN_KEYS; i += 2) {
+                if (!ht_scan_visited(&ht, &cursor, &i, sizeof i)) {
+                    ht_delete(&ht, &i, sizeof i, NULL, NULL);
+                    seen[i] = -1;
+                }
+            }
+        }
+    } while (more);
+
+    for (i = 0; i < SCAN_KEYS; ++i) {
+        if (seen[i] != -1) {
+            ck_assert_int_eq(seen[i], 1);
+        }
+    }
+    for (i = SCAN_KEYS; i < SCAN_KEYS * 2; ++i) {
+        ck_assert_int_le(seen[i], 1);
+    }
+
+    ht_free(&ht, NULL, NULL);
+}
+END_TEST
+
 Suite* suite() {
     Suite* s;
     TCase* tc_core;
     s = suite_create("ht");
     tc_core = tcase_create("Core");
     tcase_add_test(tc_core, test_it_works);
+    tcase_add_test(tc_core, test_scan);
     suite_add_tcase(s, tc_core);
     return s;
 }
@@ -0,0 +1,309 @@
+#define _GNU_SOURCE
+#include "../src/outbuf.h"
+#include <check.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* more than a pipe holds, so a single write can not take all of it */
+#define BIG_LEN (256 * 1024)
+
+static void count_release(void* arg) { (*(int*)arg)++; }
+
+static void nonblocking_pipe(int fds[2]) {
+    ck_assert_int_eq(pipe2(fds, O_NONBLOCK), 0);
+}
+
+/* read everything in the pipe into buf, returns the amount read */
+static size_t drain(int fd, uint8_t* buf, size_t cap) {
+    size_t got = 0;
+    ssize_t n;
+    while (got < cap && (n = read(fd, buf + got, cap - got)) > 0) {
+        got += n;
+    }
+    return got;
+}
+
+/* bytes that differ from one offset to the next, so a resume at the wrong
+ * offset shows */
+static void fill_pattern(uint8_t* buf, size_t len) {
+    size_t i;
+    for (i = 0; i < len; ++i) {
+        buf[i] = (uint8_t)(i * 31 + i / 251);
+    }
+}
+
+START_TEST(test_push_across_chunks) {
+    outbuf out = outbuf_new();
+    int fds[2];
+    uint8_t *in = malloc(BIG_LEN), *buf = malloc(BIG_LEN);
+    size_t pushed = 0, got = 0, piece = 1;
+
+    fill_pattern(in, BIG_LEN);
+    nonblocking_pipe(fds);
+
+    /* pieces of every size up to a chunk and more, each starting where the
+     * tail chunk left off */
+    while (pushed < BIG_LEN) {
+        size_t len = piece < BIG_LEN - pushed ? piece : BIG_LEN - pushed;
+        ck_assert_int_eq(outbuf_push(&out, in + pushed, len), 0);
+        pushed += len;
+        piece = piece * 3 + 1;
+        if (piece > OUTBUF_CHUNK_SIZE * 2) {
+            piece = 1;
+        }
+    }
+    ck_assert_uint_eq(outbuf_len(&out), BIG_LEN);
+
+    while (outbuf_len(&out) != 0) {
+        ck_assert_int_gt(outbuf_write(&out, fds[1]), 0);
+        got += drain(fds[0], buf + got, BIG_LEN - got);
+    }
+    ck_assert_uint_eq(got, BIG_LEN);
+    ck_assert_mem_eq(buf, in, BIG_LEN);
+
+    outbuf_free(&out);
+    close(fds[0]);
+    close(fds[1]);
+    free(in);
+    free(buf);
+}
+END_TEST
+
+START_TEST(test_partial_write_resumes) {
+    outbuf out = outbuf_new();
+    int fds[2];
+    uint8_t *in = malloc(BIG_LEN), *buf = malloc(BIG_LEN);
+    const void* data;
+    size_t got = 0, peeked, i;
+    ssize_t written;
+
+    fill_pattern(in, BIG_LEN);
+    nonblocking_pipe(fds);
+    /* a first chunk of its own, so the pipe fills up mid chunk */
+    ck_assert_int_eq(outbuf_push(&out, in, 20000), 0);
+    for (i = 20000; i < BIG_LEN; i += 1000) {
+        size_t len = BIG_LEN - i < 1000 ? BIG_LEN - i : 1000;
+        ck_assert_int_eq(outbuf_push(&out, in + i, len), 0);
+    }
+
+    /* the pipe takes part of it, and the rest waits */
+    written = outbuf_write(&out, fds[1]);
+    ck_assert_int_gt(written, 20000);
+    ck_assert_int_lt(written, BIG_LEN);
+    ck_assert_uint_eq(outbuf_len(&out), BIG_LEN - written);
+    ck_assert_int_eq(outbuf_write(&out, fds[1]), -1);
+
+    /* the next write starts at the first byte not written */
+    peeked = outbuf_peek(&out, &data);
+    ck_assert_uint_gt(peeked, 0);
+    ck_assert_mem_eq(data, in + written, peeked < 1000 ? peeked : 1000);
+
+    while (outbuf_len(&out) != 0) {
+        got += drain(fds[0], buf + got, BIG_LEN - got);
+        ck_assert_int_gt(outbuf_write(&out, fds[1]), 0);
+    }
+    got += drain(fds[0], buf + got, BIG_LEN - got);
+    ck_assert_uint_eq(got, BIG_LEN);
+    ck_assert_mem_eq(buf, in, BIG_LEN);
+
+    /* empty again, and usable */
+    ck_assert_int_eq(outbuf_write(&out, fds[1]), 0);
+    ck_assert_int_eq(outbuf_push(&out, "+OK\r\n", 5), 0);
+    ck_assert_int_eq(outbuf_write(&out, fds[1]), 5);
+
+    outbuf_free(&out);
+    close(fds[0]);
+    close(fds[1]);
+    free(in);
+    free(buf);
+}
+END_TEST
+
+START_TEST(test_write_iov_cap) {
+    outbuf out = outbuf_new();
+    size_t num_chunks = 70, len = num_chunks * OUTBUF_CHUNK_SIZE;
+    uint8_t *in = malloc(len), *buf = malloc(len);
+    FILE* f = tmpfile();
+    int fd = fileno(f);
+    size_t i;
+
+    /* a file takes everything a writev hands it, so only the cap on iovecs
+     * keeps a write from taking all the chunks */
+    fill_pattern(in, len);
+    for (i = 0; i < num_chunks; ++i) {
+        ck_assert_int_eq(
+            outbuf_push(&out, in + i * OUTBUF_CHUNK_SIZE, OUTBUF_CHUNK_SIZE),
+            0);
+    }
+    ck_assert_int_eq(outbuf_write(&out, fd), 64 * OUTBUF_CHUNK_SIZE);
+    ck_assert_uint_eq(outbuf_len(&out), 6 * OUTBUF_CHUNK_SIZE);
+    ck_assert_int_eq(outbuf_write(&out, fd), 6 * OUTBUF_CHUNK_SIZE);
+    ck_assert_uint_eq(outbuf_len(&out), 0);
+
+    ck_assert_int_eq(pread(fd, buf, len, 0), len);
+    ck_assert_mem_eq(buf, in, len);
+
+    outbuf_free(&out);
+    fclose(f);
+    free(in);
+    free(buf);
+}
+END_TEST
+
+START_TEST(test_peek_consume) {
+    outbuf out = outbuf_new();
+    const void* data;
+    int released = 0;
+
+    ck_assert_uint_eq(outbuf_peek(&out, &data), 0);
+    ck_assert_ptr_null(data);
+
+    ck_assert_int_eq(outbuf_push(&out, "hello ", 6), 0);
+    ck_assert_int_eq(
+        outbuf_push_ref(&out, "world", 5, count_release, &released), 0);
+    ck_assert_int_eq(outbuf_push(&out, "!", 1), 0);
+
+    /* one chunk at a time, from where the last consume stopped */
+    ck_assert_uint_eq(outbuf_peek(&out, &data), 6);
+    ck_assert_mem_eq(data, "hello ", 6);
+    outbuf_consume(&out, 2);
+    ck_assert_uint_eq(outbuf_peek(&out, &data), 4);
+    ck_assert_mem_eq(data, "llo ", 4);
+    outbuf_consume(&out, 4);
+    ck_assert_uint_eq(outbuf_peek(&out, &data), 5);
+    ck_assert_mem_eq(data, "world", 5);
+
+    /* across the end of a chunk */
+    outbuf_consume(&out, 5);
+    ck_assert_int_eq(released, 1);
+    ck_assert_uint_eq(outbuf_peek(&out, &data), 1);
+    ck_assert_mem_eq(data, "!", 1);
+    outbuf_consume(&out, 1);
+    ck_assert_uint_eq(outbuf_len(&out), 0);
+    ck_assert_uint_eq(outbuf_peek(&out, &data), 0);
+
+    outbuf_free(&out);
+}
+END_TEST
+
+START_TEST(test_release_on_full_write) {
+    outbuf out = outbuf_new();
+    int fds[2], released = 0;
+    const char* ref = "referenced";
+    uint8_t buf[64];
+
+    nonblocking_pipe(fds);
+    ck_assert_int_eq(outbuf_push(&out, "$10\r\n", 5), 0);
+    ck_assert_int_eq(
+        outbuf_push_ref(&out, ref, 10, count_release, &released), 0);
+    ck_assert_int_eq(outbuf_push(&out, "\r\n", 2), 0);
+    ck_assert_int_eq(released, 0);
+
+    ck_assert_int_eq(outbuf_write(&out, fds[1]), 17);
+    ck_assert_uint_eq(outbuf_len(&out), 0);
+    ck_assert_int_eq(released, 1);
+    ck_assert_uint_eq(drain(fds[0], buf, sizeof buf), 17);
+    ck_assert_mem_eq(buf, "$10\r\nreferenced\r\n", 17);
+
+    outbuf_free(&out);
+    ck_assert_int_eq(released, 1);
+    close(fds[0]);
+    close(fds[1]);
+}
+END_TEST
+
+START_TEST(test_release_on_partial_write) {
+    outbuf out = outbuf_new();
+    int fds[2], released = 0;
+    uint8_t *ref = malloc(BIG_LEN), *buf = malloc(BIG_LEN);
+    size_t i, got = 0;
+
+    for (i = 0; i < BIG_LEN; ++i) {
+        ref[i] = (uint8_t)i;
+    }
+    nonblocking_pipe(fds);
+    ck_assert_int_eq(
+        outbuf_push_ref(&out, ref, BIG_LEN, count_release, &released), 0);
+
+    ck_assert_int_gt(outbuf_write(&out, fds[1]), 0);
+    ck_assert_uint_gt(outbuf_len(&out), 0);
+    ck_assert_int_eq(released, 0);
+
+    while (outbuf_len(&out) != 0) {
+        got += drain(fds[0], buf + got, BIG_LEN - got);
+        ck_assert_int_gt(outbuf_write(&out, fds[1]), 0);
+        ck_assert_int_eq(released, outbuf_len(&out) == 0);
+    }
+    got += drain(fds[0], buf + got, BIG_LEN - got);
+    ck_assert_uint_eq(got, BIG_LEN);
+    ck_assert_mem_eq(buf, ref, BIG_LEN);
+
+    outbuf_free(&out);
+    ck_assert_int_eq(released, 1);
+    close(fds[0]);
+    close(fds[1]);
+    free(ref);
+    free(buf);
+}
+END_TEST
+
+START_TEST(test_release_on_free) {
+    outbuf out = outbuf_new();
+    int fds[2], released = 0, unwritten = 0;
+    uint8_t* ref = calloc(1, BIG_LEN);
+
+    nonblocking_pipe(fds);
+    ck_assert_int_eq(
+        outbuf_push_ref(&out, ref, BIG_LEN, count_release, &released), 0);
+    ck_assert_int_eq(
+        outbuf_push_ref(&out, ref, BIG_LEN, count_release, &unwritten), 0);
+
+    /* the first reference is part way through being written */
+    ck_assert_int_gt(outbuf_write(&out, fds[1]), 0);
+    ck_assert_int_eq(released, 0);
+
+    outbuf_free(&out);
+    ck_assert_int_eq(released, 1);
+    ck_assert_int_eq(unwritten, 1);
+    ck_assert_uint_eq(outbuf_len(&out), 0);
+
+    outbuf_free(&out);
+    ck_assert_int_eq(released, 1);
+    ck_assert_int_eq(unwritten, 1);
+    close(fds[0]);
+    close(fds[1]);
+    free(ref);
+}
+END_TEST
+
+Suite* suite() {
+    Suite* s;
+    TCase* tc_core;
+    s = suite_create("outbuf");
+    tc_core = tcase_create("Core");
+    tcase_add_test(tc_core, test_push_across_chunks);
+    tcase_add_test(tc_core, test_partial_write_resumes);
+    tcase_add_test(tc_core, test_write_iov_cap);
+    tcase_add_test(tc_core, test_peek_consume);
+    tcase_add_test(tc_core, test_release_on_full_write);
+    tcase_add_test(tc_core, test_release_on_partial_write);
+    tcase_add_test(tc_core, test_release_on_free);
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main() {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+    s = suite();
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
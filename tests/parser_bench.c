@@ -0,0 +1,157 @@
+#define _POSIX_C_SOURCE 199309L
+#include "../src/bin_parser.h"
+#include "../src/builder.h"
+#include "../src/cmd.h"
+#include "../src/object.h"
+#include "../src/parser.h"
+#include "../src/proto.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* not run by ctest. Build the parser_bench target in a release build and
+ * run it by hand to compare parser changes:
+ *   ./tests/parser_bench [iterations] */
+
+#define arr_size(arr) sizeof arr / sizeof arr[0]
+
+/* binary inputs hold nul bytes, so lengths come from the literal */
+#define INPUT(s) s, sizeof s - 1
+
+#define DEFAULT_ITERATIONS 2000000
+
+typedef enum {
+    BenchObject,
+    BenchCmd,
+    BenchBinObject,
+    BenchBinCmd,
+    BenchEncodeInt,
+    BenchEncodeDouble,
+} bench_kind;
+
+typedef struct {
+    const char* name;
+    bench_kind kind;
+    const char* input;
+    size_t input_len;
+    int proto; /* for the encode benches */
+} bench;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static void free_cmd(cmd* c) {
+    if (c->type == Set) {
+        object_free(&c->data.set.key);
+        object_free(&c->data.set.value);
+    } else if (c->type == Get) {
+        object_free(&c->data.get.key);
+    }
+}
+
+static double run_bench(const bench* b, size_t iterations) {
+    const uint8_t* input = (const uint8_t*)b->input;
+    size_t input_len = b->input_len;
+    builder out = builder_new();
+    double start, elapsed;
+    size_t i;
+
+    if (b->proto != 0) {
+        builder_set_proto(&out, b->proto);
+    }
+    start = now();
+    for (i = 0; i < iterations; ++i) {
+        switch (b->kind) {
+        case BenchObject: {
+            object obj = parse_from_server(input, input_len);
+            object_free(&obj);
+        } break;
+        case BenchCmd: {
+            cmd c = parse(input, input_len);
+            free_cmd(&c);
+        } break;
+        case BenchBinObject: {
+            object obj = bin_parse_from_server(input, input_len);
+            object_free(&obj);
+        } break;
+        case BenchBinCmd: {
+            cmd c = parse_bin(input, input_len);
+            free_cmd(&c);
+        } break;
+        case BenchEncodeInt:
+            builder_add_int(&out, -(int64_t)i * 7919);
+            builder_reset(&out);
+            break;
+        case BenchEncodeDouble:
+            builder_add_double(&out, i * 0.125);
+            builder_reset(&out);
+            break;
+        }
+    }
+
+    elapsed = now() - start;
+    builder_free(&out);
+    return (elapsed / iterations) * 1e9;
+}
+
+int main(int argc, char* argv[]) {
+    bench benches[] = {
+        {"small int", BenchObject, INPUT(":42\r\n")},
+        {"large int", BenchObject, INPUT(":-9223372036854775807\r\n")},
+        {"short double", BenchObject, INPUT(",1.5\r\n")},
+        {"long double", BenchObject, INPUT(",123456.789012e-3\r\n")},
+        {"strtod double", BenchObject,
+         INPUT(",1.7976931348623157e308\r\n")},
+        {"simple string", BenchObject, INPUT("+OK\r\n")},
+        {"bulk string", BenchObject, INPUT("$11\r\nhello world\r\n")},
+        {"get", BenchCmd, INPUT("*2\r\n$3\r\nGET\r\n$3\r\nfoo\r\n")},
+        {"set", BenchCmd,
+         INPUT("*3\r\n$3\r\nSET\r\n$3\r\nfoo\r\n$3\r\nbar\r\n")},
+        {"set int", BenchCmd,
+         INPUT("*3\r\n$3\r\nSET\r\n$3\r\nfoo\r\n:1234567\r\n")},
+        {"bin small int", BenchBinObject, INPUT("\x04\x2a\0\0\0\0\0\0\0")},
+        {"bin large int", BenchBinObject,
+         INPUT("\x04\x01\0\0\0\0\0\0\x80")},
+        {"bin short dbl", BenchBinObject,
+         INPUT("\x05\0\0\0\0\0\0\xf8\x3f")},
+        {"bin long dbl", BenchBinObject,
+         INPUT("\x05\x94\xed\xfa\x07\x3c\xdd\x5e\x40")},
+        {"bin string", BenchBinObject,
+         INPUT("\x01\x0b\0\0\0"
+               "hello world")},
+        {"bin get", BenchBinCmd,
+         INPUT("\x07\x02\0\0\0\x01\x03\0\0\0"
+               "GET\x01\x03\0\0\0"
+               "foo")},
+        {"bin set int", BenchBinCmd,
+         INPUT("\x07\x03\0\0\0\x01\x03\0\0\0"
+               "SET\x01\x03\0\0\0"
+               "foo\x04\x87\xd6\x12\0\0\0\0\0")},
+        {"encode int", BenchEncodeInt, INPUT(""), PROTO_RESP},
+        {"bin enc int", BenchEncodeInt, INPUT(""), PROTO_BIN},
+        {"encode double", BenchEncodeDouble, INPUT(""), PROTO_RESP},
+        {"bin enc double", BenchEncodeDouble, INPUT(""), PROTO_BIN},
+    };
+    size_t i, len = arr_size(benches);
+    size_t iterations = DEFAULT_ITERATIONS;
+
+    if (argc > 1) {
+        iterations = strtoul(argv[1], NULL, 10);
+        if (iterations == 0) {
+            fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    for (i = 0; i < len; ++i) {
+        printf("%-14s %8.1f ns/op\n", benches[i].name,
+               run_bench(&benches[i], iterations));
+    }
+
+    return 0;
+}
@@ -1,8 +1,12 @@
+#include "../src/bin_parser.h"
 #include "../src/builder.h"
 #include "../src/cmd.h"
 #include "../src/object.h"
 #include "../src/parser.h"
+#include "../src/proto.h"
+#include "../src/scan.h"
 #include <check.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -48,6 +52,25 @@ typedef struct {
     size_t input_len;
 } inv_cmd_test;
 
+typedef struct {
+    const uint8_t* input;
+    size_t input_len;
+    ssize_t exp;
+} frame_len_test;
+
+typedef struct {
+    const uint8_t* input;
+    size_t input_len;
+    cmdt exp_type;
+    int64_t exp_timeout;
+} block_cmd_test;
+
+typedef struct {
+    const char* input;
+    size_t exp_len;
+    uint64_t exp_val;
+} scan_digits_test;
+
 #define test_object_eq(exp, got)                                               \
     do {                                                                       \
         int cmp = object_cmp(&exp, &got);                                      \
@@ -194,6 +217,16 @@ START_TEST(test_simple_string_cmd) {
             strlen("+OK\r\n"),
             {Okc},
         },
+        {
+            (const uint8_t*)"*1\r\n$4\r\nPING\r\n",
+            strlen("*1\r\n$4\r\nPING\r\n"),
+            {Ping},
+        },
+        {
+            (const uint8_t*)"*1\r\n$2\r\nOK\r\n",
+            strlen("*1\r\n$2\r\nOK\r\n"),
+            {Okc},
+        },
     };
     size_t i, len = arr_size(tests);
     for (i = 0; i < len; ++i) {
@@ -225,6 +258,20 @@ START_TEST(test_parse_string_from_server) {
             (const uint8_t*)"$5\r\nfoo\r\n\r\n",
             strlen("$3\r\nfoo\r\n\r\n"),
             "foo\r\n",
+        },        {
+            (const uint8_t*)"$0\r\n\r\n",
+            strlen("$0\r\n\r\n"),
+            "",
+        },
+        {
+            (const uint8_t*)"$28\r\ntoo long to be stored inline\r\n",
+            strlen("$28\r\ntoo long to be stored inline\r\n"),
+            "too long to be stored inline",
+        },
+        {
+            (const uint8_t*)"-ERR invalid command\r\n",
+            strlen("-ERR invalid command\r\n"),
+            "ERR invalid command",
         },
     };
     size_t i, len = arr_size(tests);
@@ -241,8 +288,7 @@ END_TEST
 
 START_TEST(test_parse_int_from_server) {
     int64_t tests[] = {
-        1337,
-        -1337,
+        1337, -1337, 0, INT64_MAX, INT64_MIN,
     };
     size_t i, len = arr_size(tests);
     for (i = 0; i < len; ++i) {
@@ -265,6 +311,88 @@ START_TEST(test_parse_int_from_server) {
 }
 END_TEST
 
+START_TEST(test_builder_output) {
+    int64_t ints[] = {
+        0,     1,      9,         10,        99,        100,
+        999,   1000,   1001,      12345,     -1,        -10,
+        -999,  -1000,  INT64_MAX, INT64_MIN, 123456789, -123456789,
+    };
+    builder b = builder_new();
+    char exp[64];
+    size_t i, len = arr_size(ints);
+
+    for (i = 0; i < len; ++i) {
+        int n = snprintf(exp, sizeof exp, ":%" PRId64 "\r\n", ints[i]);
+        ck_assert_int_eq(builder_add_int(&b, ints[i]), 0);
+        ck_assert_uint_eq(builder_len(&b), n);
+        ck_assert_mem_eq(builder_out(&b), exp, n);
+        builder_reset(&b);
+    }
+
+    builder_add_array(&b, 0);
+    builder_add_ht(&b, 18446744073709551615ULL);
+    builder_add_string(&b, "hello", 5);
+    builder_add_string(&b, "", 0);
+    builder_add_err(&b, "EOOM", 4);
+    builder_add_double(&b, -1.5);
+    builder_add_ok(&b);
+    builder_add_none(&b);
+    ck_assert_str_eq((const char*)builder_out(&b),
+                     "*0\r\n%18446744073709551615\r\n$5\r\nhello\r\n$0\r\n"
+                     "\r\n-EOOM\r\n,-1.5\r\n+OK\r\n+NONE\r\n");
+    builder_reset(&b);
+    ck_assert_uint_eq(builder_len(&b), 0);
+
+    /* a reply that outgrows the small buffer, then a short one in the same
+     * buffer */
+    for (i = 0; i < 1000; ++i) {
+        builder_add_int(&b, i);
+    }
+    ck_assert_uint_eq(builder_len(&b), 10 * 4 + 90 * 5 + 900 * 6);
+    builder_reset(&b);
+    builder_add_pong(&b);
+    ck_assert_str_eq((const char*)builder_out(&b), "+PONG\r\n");
+    builder_reset(&b);
+
+    /* a string split around contents sent from elsewhere */
+    builder_add_string_header(&b, 5);
+    builder_add_raw(&b, (const uint8_t*)"hello", 5);
+    builder_add_string_end(&b);
+    ck_assert_str_eq((const char*)builder_out(&b), "$5\r\nhello\r\n");
+    builder_reset(&b);
+    builder_set_proto(&b, PROTO_BIN);
+    builder_add_string_header(&b, 5);
+    builder_add_raw(&b, (const uint8_t*)"hello", 5);
+    builder_add_string_end(&b);
+    ck_assert_uint_eq(builder_len(&b), 10);
+    ck_assert_mem_eq(builder_out(&b), "\x01\x05\0\0\0hello", 10);
+    builder_free(&b);
+}
+END_TEST
+
+START_TEST(test_builder_release) {
+    builder b = builder_new();
+    char value[1024];
+
+    memset(value, 'a', sizeof value);
+
+    /* reset keeps the buffer for the next reply */
+    builder_add_string(&b, value, sizeof value);
+    builder_reset(&b);
+    ck_assert_uint_eq(builder_len(&b), 0);
+    ck_assert_uint_eq(b.buf.is_large, 1);
+
+    /* release leaves nothing allocated, as an idle client's builder */
+    builder_release(&b);
+    ck_assert_uint_eq(builder_len(&b), 0);
+    ck_assert_uint_eq(b.buf.is_large, 0);
+
+    builder_add_ok(&b);
+    ck_assert_str_eq((const char*)builder_out(&b), "+OK\r\n");
+    builder_free(&b);
+}
+END_TEST
+
 START_TEST(test_parse_array) {
     uint8_t* input = (uint8_t*)"*2\r\n*2\r\n$3\r\nfoo\r\n$3\r\nbar\r\n*2\r\n$"
                                "3\r\nbaz\r\n$6\r\nfoobar\r\n";
@@ -325,6 +453,37 @@ START_TEST(test_parse_double) {
 }
 END_TEST
 
+START_TEST(test_parse_double_matches_strtod) {
+    /* both the fast path and the ones left to strtod */
+    const char* tests[] = {
+        "0",
+        "-0",
+        "0.1",
+        "-2.5E+3",
+        "1e-5",
+        "+42.",
+        ".5",
+        "123456789.987654321",
+        "9007199254740993",
+        "12345678901234567890.5",
+        "1.7976931348623157e308",
+        "4.9e-324",
+        "1e23",
+        "inf",
+        "-inf",
+    };
+    size_t i, len = arr_size(tests);
+    for (i = 0; i < len; ++i) {
+        char input[64];
+        object parsed;
+        snprintf(input, sizeof input, ",%s\r\n", tests[i]);
+        parsed = parse_from_server((const uint8_t*)input, strlen(input));
+        ck_assert_uint_eq(parsed.type, Double);
+        ck_assert(parsed.data.dbl == strtod(tests[i], NULL));
+    }
+}
+END_TEST
+
 START_TEST(test_parse_help_cmd) {
     help_cmd_test tests[] = {
         {(const uint8_t*)"*2\r\n$4\r\nHELP\r\n$3\r\nSET\r\n",
@@ -342,6 +501,12 @@ START_TEST(test_parse_help_cmd) {
              Help,
              {0},
          }},
+        {(const uint8_t*)"*1\r\n$4\r\nHELP\r\n",
+         strlen("*1\r\n$4\r\nHELP\r\n"),
+         {
+             Help,
+             {0},
+         }},
     };
     size_t i, len = arr_size(tests);
     for (i = 0; i < len; ++i) {
@@ -440,6 +605,9 @@ START_TEST(test_parse_array_to_short) {
         {
             (const uint8_t*)"*2\r\n$3\r\nDEL\r\n",
             strlen("*2\r\n$3\r\nDEL\r\n"),
+        },        {
+            (const uint8_t*)"*2\r\n$3\r\nGET\r\n$10\r\nfoo\r\n",
+            strlen("*2\r\n$3\r\nGET\r\n$10\r\nfoo\r\n"),
         },
     };
     size_t i, len = arr_size(tests);
@@ -451,6 +619,497 @@ START_TEST(test_parse_array_to_short) {
 }
 END_TEST
 
+START_TEST(test_parse_block_cmd) {
+    block_cmd_test tests[] = {
+        {
+            (const uint8_t*)"$4\r\nBPOP\r\n",
+            strlen("$4\r\nBPOP\r\n"),
+            Bpop,
+            0,
+        },
+        {
+            (const uint8_t*)"*1\r\n$6\r\nBDEQUE\r\n",
+            strlen("*1\r\n$6\r\nBDEQUE\r\n"),
+            Bdeque,
+            0,
+        },
+        {
+            (const uint8_t*)"*2\r\n$4\r\nBPOP\r\n:1500\r\n",
+            strlen("*2\r\n$4\r\nBPOP\r\n:1500\r\n"),
+            Bpop,
+            1500,
+        },
+        {
+            (const uint8_t*)"*2\r\n$6\r\nBDEQUE\r\n:10\r\n",
+            strlen("*2\r\n$6\r\nBDEQUE\r\n:10\r\n"),
+            Bdeque,
+            10,
+        },
+        {
+            (const uint8_t*)"*2\r\n$6\r\nBDEQUE\r\n:-1\r\n",
+            strlen("*2\r\n$6\r\nBDEQUE\r\n:-1\r\n"),
+            Illegal,
+            0,
+        },
+        {
+            (const uint8_t*)"*2\r\n$4\r\nBPOP\r\n$3\r\nfoo\r\n",
+            strlen("*2\r\n$4\r\nBPOP\r\n$3\r\nfoo\r\n"),
+            Illegal,
+            0,
+        },
+        {
+            (const uint8_t*)"*3\r\n$4\r\nBPOP\r\n:1\r\n:1\r\n",
+            strlen("*3\r\n$4\r\nBPOP\r\n:1\r\n:1\r\n"),
+            Illegal,
+            0,
+        },
+    };
+    size_t i, len = arr_size(tests);
+    for (i = 0; i < len; ++i) {
+        block_cmd_test t = tests[i];
+        cmd parsed = parse(t.input, t.input_len);
+        ck_assert_int_eq(parsed.type, t.exp_type);
+        if (parsed.type == Bpop) {
+            ck_assert_int_eq(parsed.data.bpop.timeout, t.exp_timeout);
+        } else if (parsed.type == Bdeque) {
+            ck_assert_int_eq(parsed.data.bdeque.timeout, t.exp_timeout);
+        }
+    }
+}
+END_TEST
+
+START_TEST(test_parse_cmd_arity) {
+    const char* tests[] = {
+        "*3\r\n$3\r\nGET\r\n$3\r\nfoo\r\n$3\r\nbar\r\n",
+        "*4\r\n$3\r\nSET\r\n$1\r\na\r\n$1\r\nb\r\n$1\r\nc\r\n",
+        "*2\r\n$4\r\nPING\r\n$1\r\na\r\n",
+        "*3\r\n$4\r\nBPOP\r\n:1\r\n:2\r\n",
+        "*3\r\n$4\r\nHELP\r\n$3\r\nSET\r\n$3\r\nGET\r\n",
+        "*1\r\n$3\r\nFOO\r\n",
+        "*1\r\n$4\r\nPIN",
+        "$99\r\nPING\r\n",
+        "+PINGS\r\n",
+    };
+    size_t i, len = arr_size(tests);
+    for (i = 0; i < len; ++i) {
+        cmd parsed = parse((const uint8_t*)tests[i], strlen(tests[i]));
+        ck_assert_int_eq(parsed.type, Illegal);
+    }
+
+    ck_assert_uint_eq(cmd_flags(Auth), CMD_NO_AUTH);
+    ck_assert_uint_eq(cmd_flags(Bpop), CMD_BLOCKING);
+    ck_assert_uint_eq(cmd_flags(Bdeque), CMD_BLOCKING);
+    ck_assert_uint_eq(cmd_flags(Set), 0);
+    ck_assert_uint_eq(cmd_flags(Illegal), 0);
+}
+END_TEST
+
+START_TEST(test_scan) {
+    scan_digits_test digit_tests[] = {
+        {"7\r\n", 1, 7},
+        {"\r\n", 0, 0},
+        {"1234567890123456\r\n", 16, 1234567890123456ULL},
+        {"12345678901234567\r\n", 17, 12345678901234567ULL},
+        {"18446744073709551615", 20, 0},
+        {"9999999999999999999", 19, 9999999999999999999ULL},
+        {"00000000000000000000000000000000001", 20, 0},
+        {"123456789012345678901234567890123x", 20, 0},
+        {"42abcdefghijklmnopqrstuvwxyz0123456789", 2, 42},
+    };
+    size_t i, len = arr_size(digit_tests);
+
+    for (i = 0; i < len; ++i) {
+        scan_digits_test t = digit_tests[i];
+        uint64_t val = 0;
+        size_t got =
+            scan_digits((const uint8_t*)t.input, strlen(t.input), &val);
+        ck_assert_uint_eq(got, t.exp_len);
+        if (got <= SCAN_DIGITS_MAX) {
+            ck_assert_uint_eq(val, t.exp_val);
+        }
+    }
+
+    for (i = 0; i < 100; ++i) {
+        uint8_t buf[100];
+        memset(buf, 'a', sizeof buf);
+        ck_assert_uint_eq(scan_cr(buf, i), i);
+        buf[i] = '\r';
+        ck_assert_uint_eq(scan_cr(buf, sizeof buf), i);
+        ck_assert_uint_eq(scan_cr(buf, i), i);
+    }
+}
+END_TEST
+
+START_TEST(test_parse_out_of_range) {
+    const char* tests[] = {
+        ":9223372036854775808\r\n",
+        ":-9223372036854775809\r\n",
+        ":123456789012345678901234567890\r\n",
+        ":\r\n",
+        ":-\r\n",
+        ":12a\r\n",
+        ",\r\n",
+        ",.\r\n",
+        ",1e\r\n",
+        ",1.5x\r\n",
+        ",--1\r\n",
+    };
+    size_t i, len = arr_size(tests);
+    for (i = 0; i < len; ++i) {
+        object parsed =
+            parse_from_server((const uint8_t*)tests[i], strlen(tests[i]));
+        ck_assert(parsed.type == Null);
+    }
+}
+END_TEST
+
+START_TEST(test_parse_frame_len) {
+    frame_len_test tests[] = {
+        {
+            (const uint8_t*)"*3\r\n$3\r\nSET\r\n$3\r\nfoo\r\n$3\r\nbar\r\n",
+            strlen("*3\r\n$3\r\nSET\r\n$3\r\nfoo\r\n$3\r\nbar\r\n"),
+            strlen("*3\r\n$3\r\nSET\r\n$3\r\nfoo\r\n$3\r\nbar\r\n"),
+        },
+        {
+            (const uint8_t*)"+PING\r\n+PING\r\n",
+            strlen("+PING\r\n+PING\r\n"),
+            strlen("+PING\r\n"),
+        },
+        {
+            (const uint8_t*)"*2\r\n$3\r\nGET\r\n$5\r\nfoo\r\n\r\n*2\r\n",
+            strlen("*2\r\n$3\r\nGET\r\n$5\r\nfoo\r\n\r\n*2\r\n"),
+            strlen("*2\r\n$3\r\nGET\r\n$5\r\nfoo\r\n\r\n"),
+        },
+        {
+            (const uint8_t*)"*2\r\n%1\r\n$1\r\na\r\n:1\r\n,1.5\r\n",
+            strlen("*2\r\n%1\r\n$1\r\na\r\n:1\r\n,1.5\r\n"),
+            strlen("*2\r\n%1\r\n$1\r\na\r\n:1\r\n,1.5\r\n"),
+        },
+        {
+            (const uint8_t*)"*3\r\n$3\r\nSET\r\n$3\r\nfoo\r\n$3\r\nba",
+            strlen("*3\r\n$3\r\nSET\r\n$3\r\nfoo\r\n$3\r\nba"),
+            0,
+        },
+        {
+            (const uint8_t*)"*3\r",
+            strlen("*3\r"),
+            0,
+        },
+        {
+            (const uint8_t*)"",
+            0,
+            0,
+        },
+        {
+            (const uint8_t*)"*x\r\n",
+            strlen("*x\r\n"),
+            -1,
+        },
+        {
+            (const uint8_t*)"$3\r\nfoobar\r\n",
+            strlen("$3\r\nfoobar\r\n"),
+            -1,
+        },
+        {
+            (const uint8_t*)"GET foo\r\n",
+            strlen("GET foo\r\n"),
+            -1,
+        },
+    };
+    size_t i, len = arr_size(tests);
+    for (i = 0; i < len; ++i) {
+        frame_len_test t = tests[i];
+        ssize_t got = parse_frame_len(t.input, t.input_len);
+        ck_assert_int_eq(got, t.exp);
+    }
+}
+END_TEST
+
+START_TEST(test_frame_parser_feed_partial) {
+    const char* frames[] = {
+        "*3\r\n$3\r\nSET\r\n$3\r\nfoo\r\n$3\r\nbar\r\n",
+        "*2\r\n$3\r\nGET\r\n$5\r\nfoo\r\n\r\n",
+        "*2\r\n$4\r\nPUSH\r\n*2\r\n:-12\r\n%1\r\n$1\r\na\r\n#t\r\n",
+        "+PING\r\n",
+    };
+    size_t i, len = arr_size(frames);
+    for (i = 0; i < len; ++i) {
+        const uint8_t* input = (const uint8_t*)frames[i];
+        size_t j, input_len = strlen(frames[i]);
+        frame_parser fp = frame_parser_new();
+        for (j = 1; j < input_len; ++j) {
+            ck_assert_int_eq(frame_parser_feed(&fp, input, j), 0);
+            ck_assert_uint_eq(fp.pos, j);
+        }
+        ck_assert_int_eq(frame_parser_feed(&fp, input, input_len), input_len);
+        ck_assert_uint_eq(fp.pos, 0);
+        ck_assert_uint_eq(fp.pending, 1);
+    }
+}
+END_TEST
+
+START_TEST(test_frame_parser_feed_large_bulk) {
+    size_t value_len = 1 << 20;
+    const char* header = "*3\r\n$3\r\nSET\r\n$3\r\nfoo\r\n$1048576\r\n";
+    size_t header_len = strlen(header);
+    size_t input_len = header_len + value_len + 2;
+    uint8_t* input = malloc(input_len);
+    frame_parser fp = frame_parser_new();
+    cmd cmd;
+    ck_assert_ptr_nonnull(input);
+    memcpy(input, header, header_len);
+    memset(input + header_len, 'a', value_len);
+    memcpy(input + header_len + value_len, "\r\n", 2);
+
+    ck_assert_int_eq(frame_parser_feed(&fp, input, header_len + 100), 0);
+    ck_assert_int_eq(fp.state, FrameBulk);
+    ck_assert_uint_eq(fp.bulk_remaining, value_len - 100);
+    ck_assert_int_eq(frame_parser_feed(&fp, input, input_len - 1), 0);
+    ck_assert_int_eq(frame_parser_feed(&fp, input, input_len), input_len);
+
+    cmd = parse(input, input_len);
+    ck_assert_int_eq(cmd.type, Set);
+    ck_assert_uint_eq(vstr_len(&cmd.data.set.value.data.string), value_len);
+    object_free(&cmd.data.set.key);
+    object_free(&cmd.data.set.value);
+    free(input);
+}
+END_TEST
+
+START_TEST(test_frame_parser_detach_bulk) {
+    size_t value_len = 1 << 20;
+    const char* header = "*3\r\n$3\r\nSET\r\n$3\r\nfoo\r\n$1048576\r\n";
+    size_t header_len = strlen(header);
+    uint8_t* input = malloc(header_len + 100);
+    frame_parser fp = frame_parser_new();
+    vstr bulk = vstr_new_len(value_len);
+    char* spare;
+    size_t avail;
+    cmd cmd;
+    ck_assert_ptr_nonnull(input);
+    memcpy(input, header, header_len);
+    memset(input + header_len, 'a', 100);
+
+    /* the value is received apart from the frame, which ends up with a hole
+     * where it would have been */
+    ck_assert_int_eq(frame_parser_feed(&fp, input, header_len + 100), 0);
+    ck_assert_uint_eq(frame_parser_detach_bulk(&fp), header_len);
+    vstr_push_string_len(&bulk, (const char*)input + header_len, 100);
+    spare = vstr_spare(&bulk, &avail);
+    ck_assert_uint_eq(avail, value_len - 100);
+    memset(spare, 'a', value_len - 100);
+    vstr_commit(&bulk, value_len - 100);
+    frame_parser_skip_bulk(&fp, value_len - 100);
+    ck_assert_int_eq(fp.state, FrameBulkCr);
+
+    memcpy(input + header_len, "\r\n", 2);
+    ck_assert_int_eq(frame_parser_feed(&fp, input, header_len + 2),
+                     header_len + 2);
+
+    cmd = parse_with_bulk(input, header_len + 2, &bulk, header_len);
+    ck_assert_int_eq(cmd.type, Set);
+    ck_assert_str_eq(vstr_data(&cmd.data.set.key.data.string), "foo");
+    ck_assert_uint_eq(vstr_len(&cmd.data.set.value.data.string), value_len);
+    ck_assert_int_eq(vstr_data(&cmd.data.set.value.data.string)[0], 'a');
+    ck_assert_uint_eq(vstr_len(&bulk), 0);
+    object_free(&cmd.data.set.key);
+    object_free(&cmd.data.set.value);
+    free(input);
+}
+END_TEST
+
+START_TEST(test_parse_bin_cmd) {
+    builder b = builder_new();
+    const uint8_t* input;
+    size_t j, input_len;
+    frame_parser fp = frame_parser_new();
+    cmd cmd;
+
+    builder_set_proto(&b, PROTO_BIN);
+    builder_add_array(&b, 3);
+    builder_add_string(&b, "SET", 3);
+    builder_add_string(&b, "foo", 3);
+    builder_add_int(&b, -5);
+    input = builder_out(&b);
+    input_len = builder_len(&b);
+
+    /* each header has to be all there before it is consumed */
+    for (j = 0; j < input_len; ++j) {
+        ck_assert_int_eq(bin_frame_parser_feed(&fp, input, j), 0);
+    }
+    ck_assert_int_eq(bin_frame_parser_feed(&fp, input, input_len), input_len);
+    ck_assert_uint_eq(fp.pending, 1);
+
+    cmd = parse_bin(input, input_len);
+    ck_assert_int_eq(cmd.type, Set);
+    ck_assert_str_eq(vstr_data(&cmd.data.set.key.data.string), "foo");
+    ck_assert_int_eq(cmd.data.set.value.type, Int);
+    ck_assert_int_eq(cmd.data.set.value.data.num, -5);
+    object_free(&cmd.data.set.key);
+    object_free(&cmd.data.set.value);
+
+    builder_reset(&b);
+    builder_add_array(&b, 3);
+    builder_add_string(&b, "SET", 3);
+    builder_add_string(&b, "pi", 2);
+    builder_add_double(&b, 3.14159);
+    cmd = parse_bin(builder_out(&b), builder_len(&b));
+    ck_assert_int_eq(cmd.type, Set);
+    ck_assert_int_eq(cmd.data.set.value.type, Double);
+    ck_assert_double_eq(cmd.data.set.value.data.dbl, 3.14159);
+    object_free(&cmd.data.set.key);
+    object_free(&cmd.data.set.value);
+
+    /* a name on its own */
+    builder_reset(&b);
+    builder_add_ping(&b);
+    cmd = parse_bin(builder_out(&b), builder_len(&b));
+    ck_assert_int_eq(cmd.type, Ping);
+
+    builder_reset(&b);
+    builder_add_array(&b, 2);
+    builder_add_string(&b, "HELLO", 5);
+    builder_add_int(&b, PROTO_RESP);
+    cmd = parse_bin(builder_out(&b), builder_len(&b));
+    ck_assert_int_eq(cmd.type, Hello);
+    ck_assert_int_eq(cmd.data.hello.value.data.num, PROTO_RESP);
+
+    cmd = parse((const uint8_t*)"*2\r\n$5\r\nHELLO\r\n:2\r\n",
+                strlen("*2\r\n$5\r\nHELLO\r\n:2\r\n"));
+    ck_assert_int_eq(cmd.type, Hello);
+    ck_assert_int_eq(cmd.data.hello.value.data.num, PROTO_BIN);
+
+    builder_reset(&b);
+    builder_add_array(&b, 3);
+    builder_add_string(&b, "GET", 3);
+    builder_add_string(&b, "foo", 3);
+    builder_add_string(&b, "bar", 3);
+    cmd = parse_bin(builder_out(&b), builder_len(&b));
+    ck_assert_int_eq(cmd.type, Illegal);
+
+    /* the name is cut short */
+    builder_reset(&b);
+    builder_add_array(&b, 1);
+    builder_add_string(&b, "PING", 4);
+    cmd = parse_bin(builder_out(&b), builder_len(&b) - 1);
+    ck_assert_int_eq(cmd.type, Illegal);
+
+    ck_assert_int_eq(bin_frame_parser_feed(&fp, (const uint8_t*)"\x09", 1), -1);
+    builder_free(&b);
+}
+END_TEST
+
+START_TEST(test_parse_bin_from_server) {
+    builder b = builder_new();
+    frame_parser fp = frame_parser_new();
+    object arr, got = {0};
+    vstr s = vstr_from("hello");
+    int64_t num = INT64_MIN;
+    double dbl = -0.125;
+    int boolean = 1;
+    size_t i;
+    vec* v = vec_new(sizeof(object));
+    ck_assert_ptr_nonnull(v);
+
+    vec_push(&v, &got);
+    got = object_new(Int, &num);
+    vec_push(&v, &got);
+    got = object_new(Double, &dbl);
+    vec_push(&v, &got);
+    got = object_new(Bool, &boolean);
+    vec_push(&v, &got);
+    got = object_new(String, &s);
+    vec_push(&v, &got);
+    arr = object_new(Array, &v);
+
+    builder_set_proto(&b, PROTO_BIN);
+    ck_assert_int_eq(builder_add_object(&b, &arr), 0);
+    ck_assert_int_eq(bin_frame_parser_feed(&fp, builder_out(&b),
+                                           builder_len(&b)),
+                     builder_len(&b));
+
+    got = bin_parse_from_server(builder_out(&b), builder_len(&b));
+    ck_assert(got.type == Array);
+    ck_assert_uint_eq(got.data.vec->len, 5);
+    for (i = 0; i < 5; ++i) {
+        object* exp = vec_get_at(arr.data.vec, i);
+        object* el = vec_get_at(got.data.vec, i);
+        ck_assert_int_eq(el->type, exp->type);
+    }
+    ck_assert_int_eq(((object*)vec_get_at(got.data.vec, 1))->data.num,
+                     INT64_MIN);
+    ck_assert_double_eq(((object*)vec_get_at(got.data.vec, 2))->data.dbl,
+                        -0.125);
+    ck_assert_int_eq(((object*)vec_get_at(got.data.vec, 3))->data.boolean, 1);
+    ck_assert_str_eq(
+        vstr_data(&((object*)vec_get_at(got.data.vec, 4))->data.string),
+        "hello");
+    object_free(&got);
+
+    /* a count that runs past the end of the frame */
+    got = bin_parse_from_server(builder_out(&b), builder_len(&b) - 1);
+    ck_assert_int_eq(got.type, Null);
+
+    builder_reset(&b);
+    builder_add_err(&b, "EINVCMD", 7);
+    got = bin_parse_from_server(builder_out(&b), builder_len(&b));
+    ck_assert_int_eq(got.type, String);
+    ck_assert_str_eq(vstr_data(&got.data.string), "EINVCMD");
+    object_free(&got);
+
+    object_free(&arr);
+    builder_free(&b);
+}
+END_TEST
+
+START_TEST(test_bin_frame_parser_detach_bulk) {
+    size_t value_len = 1 << 20;
+    builder b = builder_new();
+    uint8_t* input;
+    size_t header_len;
+    frame_parser fp = frame_parser_new();
+    vstr bulk = vstr_new_len(value_len);
+    char* spare;
+    size_t avail;
+    cmd cmd;
+
+    builder_set_proto(&b, PROTO_BIN);
+    builder_add_array(&b, 3);
+    builder_add_string(&b, "SET", 3);
+    builder_add_string(&b, "foo", 3);
+    header_len = builder_len(&b) + 5;
+    input = malloc(header_len + 100);
+    ck_assert_ptr_nonnull(input);
+    memcpy(input, builder_out(&b), builder_len(&b));
+    input[builder_len(&b)] = BinString;
+    bin_put_u32(input + builder_len(&b) + 1, value_len);
+    memset(input + header_len, 'a', 100);
+
+    ck_assert_int_eq(bin_frame_parser_feed(&fp, input, header_len + 100), 0);
+    ck_assert_int_eq(fp.state, FrameBulk);
+    ck_assert_uint_eq(frame_parser_detach_bulk(&fp), header_len);
+    vstr_push_string_len(&bulk, (const char*)input + header_len, 100);
+    spare = vstr_spare(&bulk, &avail);
+    memset(spare, 'a', value_len - 100);
+    vstr_commit(&bulk, value_len - 100);
+    frame_parser_skip_bulk(&fp, value_len - 100);
+
+    /* nothing ends a string, so the frame is complete */
+    ck_assert_int_eq(fp.state, FrameType);
+    ck_assert_int_eq(bin_frame_parser_feed(&fp, input, header_len),
+                     header_len);
+
+    cmd = parse_bin_with_bulk(input, header_len, &bulk, header_len);
+    ck_assert_int_eq(cmd.type, Set);
+    ck_assert_uint_eq(vstr_len(&cmd.data.set.value.data.string), value_len);
+    ck_assert_uint_eq(vstr_len(&bulk), 0);
+    object_free(&cmd.data.set.key);
+    object_free(&cmd.data.set.value);
+    free(input);
+    builder_free(&b);
+}
+END_TEST
+
 Suite* suite(void) {
     Suite* s;
     TCase* tc_core;
@@ -460,12 +1119,26 @@ Suite* suite(void) {
     tcase_add_test(tc_core, test_simple_string_cmd);
     tcase_add_test(tc_core, test_parse_string_from_server);
     tcase_add_test(tc_core, test_parse_int_from_server);
+    tcase_add_test(tc_core, test_builder_output);
+    tcase_add_test(tc_core, test_builder_release);
     tcase_add_test(tc_core, test_parse_array);
     tcase_add_test(tc_core, test_parse_double);
+    tcase_add_test(tc_core, test_parse_double_matches_strtod);
     tcase_add_test(tc_core, test_parse_help_cmd);
     tcase_add_test(tc_core, test_parse_ht);
     tcase_add_test(tc_core, test_parse_booleans);
     tcase_add_test(tc_core, test_parse_array_to_short);
+    tcase_add_test(tc_core, test_parse_block_cmd);
+    tcase_add_test(tc_core, test_parse_cmd_arity);
+    tcase_add_test(tc_core, test_scan);
+    tcase_add_test(tc_core, test_parse_out_of_range);
+    tcase_add_test(tc_core, test_parse_frame_len);
+    tcase_add_test(tc_core, test_frame_parser_feed_partial);
+    tcase_add_test(tc_core, test_frame_parser_feed_large_bulk);
+    tcase_add_test(tc_core, test_frame_parser_detach_bulk);
+    tcase_add_test(tc_core, test_parse_bin_cmd);
+    tcase_add_test(tc_core, test_parse_bin_from_server);
+    tcase_add_test(tc_core, test_bin_frame_parser_detach_bulk);
     suite_add_tcase(s, tc_core);
     return s;
 }
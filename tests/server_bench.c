@@ -0,0 +1,173 @@
+#define _POSIX_C_SOURCE 200112L
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/* not run by ctest. Keeps [clients] connections busy with GETs of a short
+ * value against a running server on 127.0.0.1:6969, each with depth requests
+ * in flight, and prints the requests per second. Compares event backends by
+ * running it against a server with io-uring set to yes and to no:
+ *   ./tests/server_bench [clients] [depth] [seconds] */
+
+#define DEFAULT_CLIENTS 50
+#define DEFAULT_DEPTH 1
+#define DEFAULT_SECONDS 5
+#define PORT 6969
+
+static const char auth_req[] =
+    "*3\r\n$4\r\nAUTH\r\n$4\r\nroot\r\n$4\r\nroot\r\n";
+static const char set_req[] = "*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$5\r\nhello\r\n";
+static const char get_req[] = "*2\r\n$3\r\nGET\r\n$1\r\nk\r\n";
+static const char get_reply[] = "$5\r\nhello\r\n";
+
+#define const_len(s) (sizeof(s) - 1)
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static int send_all(int fd, const char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0) {
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* sends req and reads the 5 byte +OK\r\n it gets back */
+static int request_ok(int fd, const char* req, size_t len) {
+    char buf[5];
+    size_t got = 0;
+    if (send_all(fd, req, len) == -1) {
+        return -1;
+    }
+    while (got < sizeof buf) {
+        ssize_t n = read(fd, buf + got, sizeof buf - got);
+        if (n <= 0) {
+            return -1;
+        }
+        got += n;
+    }
+    return memcmp(buf, "+OK\r\n", sizeof buf) == 0 ? 0 : -1;
+}
+
+static int bench_connect(void) {
+    struct sockaddr_in addr = {0};
+    int one = 1;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof addr) == -1) {
+        close(fd);
+        return -1;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    if (request_ok(fd, auth_req, const_len(auth_req)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char** argv) {
+    int num_clients = argc > 1 ? atoi(argv[1]) : DEFAULT_CLIENTS;
+    int depth = argc > 2 ? atoi(argv[2]) : DEFAULT_DEPTH;
+    double seconds = argc > 3 ? atof(argv[3]) : DEFAULT_SECONDS;
+    size_t batch_len = const_len(get_req) * depth;
+    size_t reply_len = const_len(get_reply) * depth;
+    struct epoll_event events[256];
+    char buf[1 << 16];
+    char* batch;
+    int* fds;
+    size_t* left;
+    long long done = 0;
+    double start, end;
+    int epfd, i;
+
+    if (num_clients <= 0 || depth <= 0 || seconds <= 0) {
+        fprintf(stderr, "usage: %s [clients] [depth] [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    batch = malloc(batch_len);
+    fds = calloc(num_clients, sizeof *fds);
+    left = calloc(num_clients, sizeof *left);
+    epfd = epoll_create1(0);
+    if (batch == NULL || fds == NULL || left == NULL || epfd == -1) {
+        fprintf(stderr, "failed to set up\n");
+        return 1;
+    }
+    for (i = 0; i < depth; ++i) {
+        memcpy(batch + i * const_len(get_req), get_req, const_len(get_req));
+    }
+
+    for (i = 0; i < num_clients; ++i) {
+        struct epoll_event e = {0};
+        fds[i] = bench_connect();
+        if (fds[i] == -1) {
+            fprintf(stderr, "failed to connect to 127.0.0.1:%d\n", PORT);
+            return 1;
+        }
+        if (i == 0 && request_ok(fds[i], set_req, const_len(set_req)) == -1) {
+            fprintf(stderr, "failed to set the key\n");
+            return 1;
+        }
+        e.events = EPOLLIN;
+        e.data.u32 = i;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &e);
+    }
+
+    for (i = 0; i < num_clients; ++i) {
+        send_all(fds[i], batch, batch_len);
+        left[i] = reply_len;
+    }
+
+    start = now();
+    end = start + seconds;
+    while (now() < end) {
+        int num_events = epoll_wait(epfd, events, 256, 100), j;
+        for (j = 0; j < num_events; ++j) {
+            int c = events[j].data.u32;
+            ssize_t n = read(fds[c], buf, sizeof buf);
+            if (n <= 0) {
+                fprintf(stderr, "connection %d closed\n", c);
+                return 1;
+            }
+            left[c] -= n;
+            if (left[c] == 0) {
+                done += depth;
+                send_all(fds[c], batch, batch_len);
+                left[c] = reply_len;
+            }
+        }
+    }
+
+    printf("%d clients, depth %d: %.0f requests/s\n", num_clients, depth,
+           done / (now() - start));
+
+    for (i = 0; i < num_clients; ++i) {
+        close(fds[i]);
+    }
+    close(epfd);
+    free(batch);
+    free(fds);
+    free(left);
+    return 0;
+}
@@ -0,0 +1,552 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <check.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define TEST_PORT 16969
+
+/* past REPLY_REF_MIN, so GET replies refer to the stored value */
+#define BIG_LEN (256 * 1024)
+#define NUM_GETS 32
+
+/* enough that the KEYS reply takes many KEYS_STREAM_CHUNK sized chunks */
+#define NUM_KEYS 100000
+#define KEYS_BATCH 1000
+
+static pid_t server_pid = -1;
+#define CONF_TEMPLATE "/tmp/lexidb_server_test_XXXXXX"
+static char conf_path[sizeof CONF_TEMPLATE];
+
+/* extra_conf is appended to the config the server is started with */
+static void server_start(const char* extra_conf) {
+    const char* conf = "user root >root\naddress 127.0.0.1\nport 16969\n";
+    int fd;
+
+    /* mkstemp fills in the template, so each test starts from a fresh one */
+    memcpy(conf_path, CONF_TEMPLATE, sizeof CONF_TEMPLATE);
+    fd = mkstemp(conf_path);
+    ck_assert_int_ne(fd, -1);
+    ck_assert_int_eq(write(fd, conf, strlen(conf)), strlen(conf));
+    ck_assert_int_eq(write(fd, extra_conf, strlen(extra_conf)),
+                     strlen(extra_conf));
+    close(fd);
+
+    server_pid = fork();
+    ck_assert_int_ne(server_pid, -1);
+    if (server_pid == 0) {
+        /* so a failed assertion does not leave the server running */
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        execl(LEXIDB_PATH, LEXIDB_PATH, "--config", conf_path, (char*)NULL);
+        _exit(127);
+    }
+}
+
+static void server_stop(void) {
+    kill(server_pid, SIGTERM);
+    waitpid(server_pid, NULL, 0);
+    unlink(conf_path);
+}
+
+/* rcvbuf, when not 0, is set before connecting so the window stays small */
+static int client_connect(int rcvbuf) {
+    struct sockaddr_in addr = {0};
+    struct timeval timeout = {5, 0};
+    int one = 1, tries;
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(TEST_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    /* the server may still be starting */
+    for (tries = 0; tries < 100; ++tries) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        ck_assert_int_ne(fd, -1);
+        if (rcvbuf != 0) {
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+        }
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+        /* send_cmd writes a command in pieces */
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+        if (connect(fd, (struct sockaddr*)&addr, sizeof addr) == 0) {
+            return fd;
+        }
+        close(fd);
+        usleep(50 * 1000);
+    }
+    ck_assert_msg(0, "could not connect to the server");
+    return -1;
+}
+
+static void send_all(int fd, const void* buf, size_t len) {
+    const uint8_t* bytes = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, bytes, len);
+        ck_assert_int_gt(n, 0);
+        bytes += n;
+        len -= n;
+    }
+}
+
+static void recv_all(int fd, void* buf, size_t len) {
+    uint8_t* bytes = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, bytes, len);
+        ck_assert_int_gt(n, 0);
+        bytes += n;
+        len -= n;
+    }
+}
+
+static void expect_reply(int fd, const char* reply) {
+    char buf[64];
+    size_t len = strlen(reply);
+    recv_all(fd, buf, len);
+    ck_assert_mem_eq(buf, reply, len);
+}
+
+static void send_cmd(int fd, const char* cmd, const char* key,
+                     const uint8_t* val, size_t val_len) {
+    char header[128];
+    int n = snprintf(header, sizeof header,
+                     "*%d\r\n$%zu\r\n%s\r\n$%zu\r\n%s\r\n",
+                     val == NULL ? 2 : 3, strlen(cmd), cmd, strlen(key), key);
+    send_all(fd, header, n);
+    if (val != NULL) {
+        n = snprintf(header, sizeof header, "$%zu\r\n", val_len);
+        send_all(fd, header, n);
+        send_all(fd, val, val_len);
+        send_all(fd, "\r\n", 2);
+    }
+}
+
+/* reads up to and including the next \r\n, which is left off */
+static void recv_line(int fd, char* buf, size_t size) {
+    size_t len = 0;
+    for (;;) {
+        ck_assert_uint_lt(len, size);
+        recv_all(fd, buf + len, 1);
+        if (len > 0 && buf[len - 1] == '\r' && buf[len] == '\n') {
+            buf[len - 1] = '\0';
+            return;
+        }
+        len++;
+    }
+}
+
+/* sends INFO and returns the integer it has for name */
+static long long info_int(int fd, const char* name) {
+    const char* info = "$4\r\nINFO\r\n";
+    char line[128];
+    long long num_fields, i, value = -1;
+
+    send_all(fd, info, strlen(info));
+    recv_line(fd, line, sizeof line);
+    ck_assert_int_eq(line[0], '%');
+    num_fields = atoll(line + 1);
+
+    /* the keys are bulk strings, the values bulk strings or integers */
+    for (i = 0; i < num_fields; ++i) {
+        int found;
+        recv_line(fd, line, sizeof line);
+        recv_line(fd, line, sizeof line);
+        found = strcmp(line, name) == 0;
+        recv_line(fd, line, sizeof line);
+        if (line[0] == '$') {
+            recv_line(fd, line, sizeof line);
+        } else if (found) {
+            ck_assert_int_eq(line[0], ':');
+            value = atoll(line + 1);
+        }
+    }
+    ck_assert_msg(value != -1, "INFO has no integer %s", name);
+    return value;
+}
+
+/* fails if anything arrives on fd within ms */
+static void expect_nothing(int fd, int ms) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    ck_assert_int_eq(poll(&pfd, 1, ms), 0);
+}
+
+static long long now_ms(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+}
+
+/* buffers reads for replies too long to read a byte at a time */
+typedef struct {
+    int fd;
+    size_t pos;
+    size_t len;
+    char buf[4096];
+} reply_reader;
+
+static void reader_line(reply_reader* r, char* line, size_t size) {
+    size_t len = 0;
+    for (;;) {
+        if (r->pos == r->len) {
+            ssize_t n = read(r->fd, r->buf, sizeof r->buf);
+            ck_assert_int_gt(n, 0);
+            r->pos = 0;
+            r->len = n;
+        }
+        ck_assert_uint_lt(len, size);
+        line[len] = r->buf[r->pos++];
+        if (len > 0 && line[len - 1] == '\r' && line[len] == '\n') {
+            line[len - 1] = '\0';
+            return;
+        }
+        len++;
+    }
+}
+
+/* reads the next bulk string of a KEYS reply and returns the N of k:N */
+static long key_num(reply_reader* r) {
+    char line[32];
+    char* end;
+    long num;
+    reader_line(r, line, sizeof line);
+    ck_assert_int_eq(line[0], '$');
+    reader_line(r, line, sizeof line);
+    ck_assert_msg(strncmp(line, "k:", 2) == 0, "KEYS returned %s", line);
+    num = strtol(line + 2, &end, 10);
+    ck_assert(*end == '\0' && num >= 0 && num < NUM_KEYS);
+    return num;
+}
+
+static void expect_oks(int fd, int n) {
+    int i;
+    for (i = 0; i < n; ++i) {
+        expect_reply(fd, "+OK\r\n");
+    }
+}
+
+static int client_auth(int rcvbuf) {
+    const char* auth = "*3\r\n$4\r\nAUTH\r\n$4\r\nroot\r\n$4\r\nroot\r\n";
+    int fd = client_connect(rcvbuf);
+    send_all(fd, auth, strlen(auth));
+    expect_reply(fd, "+OK\r\n");
+    return fd;
+}
+
+START_TEST(test_queued_get_outlives_set_and_del) {
+    uint8_t *first = malloc(BIG_LEN), *second = malloc(BIG_LEN);
+    uint8_t* got = malloc(BIG_LEN);
+    char header[32];
+    int reader, writer, i;
+
+    for (i = 0; i < BIG_LEN; ++i) {
+        first[i] = (uint8_t)(i * 7);
+        second[i] = (uint8_t)~first[i];
+    }
+
+    server_start("");
+    reader = client_auth(4096);
+    writer = client_auth(0);
+
+    send_cmd(writer, "SET", "big", first, BIG_LEN);
+    expect_reply(writer, "+OK\r\n");
+
+    /* far more than the socket takes, so the replies stay queued */
+    for (i = 0; i < NUM_GETS; ++i) {
+        send_cmd(reader, "GET", "big", NULL, 0);
+    }
+    usleep(200 * 1000);
+
+    send_cmd(writer, "SET", "big", second, BIG_LEN);
+    expect_reply(writer, "+OK\r\n");
+    send_cmd(writer, "DEL", "big", NULL, 0);
+    expect_reply(writer, "+OK\r\n");
+    send_cmd(reader, "GET", "big", NULL, 0);
+
+    snprintf(header, sizeof header, "$%d\r\n", BIG_LEN);
+    for (i = 0; i < NUM_GETS; ++i) {
+        expect_reply(reader, header);
+        recv_all(reader, got, BIG_LEN);
+        ck_assert_mem_eq(got, first, BIG_LEN);
+        expect_reply(reader, "\r\n");
+    }
+    expect_reply(reader, "+NONE\r\n");
+
+    close(reader);
+    close(writer);
+    server_stop();
+    free(first);
+    free(second);
+    free(got);
+}
+END_TEST
+
+START_TEST(test_output_soft_limit_pauses_reads) {
+    uint8_t *val = malloc(BIG_LEN), *got = malloc(BIG_LEN);
+    char header[32];
+    int reader, writer, i;
+
+    for (i = 0; i < BIG_LEN; ++i) {
+        val[i] = (uint8_t)(i * 13);
+    }
+
+    server_start("client-output-buffer-limit normal 64mb 1mb\n");
+    reader = client_auth(4096);
+    writer = client_auth(0);
+
+    send_cmd(writer, "SET", "big", val, BIG_LEN);
+    expect_reply(writer, "+OK\r\n");
+    ck_assert_int_eq(info_int(writer, "output limit pauses"), 0);
+
+    /* the replies pass the soft limit long before the SET is reached */
+    for (i = 0; i < NUM_GETS; ++i) {
+        send_cmd(reader, "GET", "big", NULL, 0);
+    }
+    send_cmd(reader, "SET", "marker", (const uint8_t*)"1", 1);
+    usleep(200 * 1000);
+
+    send_cmd(writer, "GET", "marker", NULL, 0);
+    expect_reply(writer, "+NONE\r\n");
+    ck_assert_int_eq(info_int(writer, "output limit pauses"), 1);
+
+    /* draining the replies lets the rest of the pipeline run */
+    snprintf(header, sizeof header, "$%d\r\n", BIG_LEN);
+    for (i = 0; i < NUM_GETS; ++i) {
+        expect_reply(reader, header);
+        recv_all(reader, got, BIG_LEN);
+        ck_assert_mem_eq(got, val, BIG_LEN);
+        expect_reply(reader, "\r\n");
+    }
+    expect_reply(reader, "+OK\r\n");
+
+    send_cmd(writer, "GET", "marker", NULL, 0);
+    expect_reply(writer, "$1\r\n1\r\n");
+    ck_assert_int_eq(info_int(writer, "output limit disconnects"), 0);
+
+    close(reader);
+    close(writer);
+    server_stop();
+    free(val);
+    free(got);
+}
+END_TEST
+
+START_TEST(test_output_hard_limit_drops_client) {
+    size_t huge_len = 16 * 1024 * 1024, got = 0;
+    uint8_t* val = calloc(huge_len, 1);
+    uint8_t buf[4096];
+    int reader, writer;
+    ssize_t n;
+
+    server_start("client-output-buffer-limit normal 4mb 1mb\n");
+    reader = client_auth(4096);
+    writer = client_auth(0);
+
+    send_cmd(writer, "SET", "huge", val, huge_len);
+    expect_reply(writer, "+OK\r\n");
+
+    /* one reply past the hard limit that the reader is too slow to take */
+    send_cmd(reader, "GET", "huge", NULL, 0);
+    while ((n = read(reader, buf, sizeof buf)) > 0) {
+        got += n;
+    }
+    ck_assert_uint_lt(got, huge_len);
+
+    ck_assert_int_eq(info_int(writer, "output limit disconnects"), 1);
+    ck_assert_int_eq(info_int(writer, "num connections"), 1);
+
+    close(reader);
+    close(writer);
+    server_stop();
+    free(val);
+}
+END_TEST
+
+START_TEST(test_block_woken_by_push_and_enque) {
+    const char* bpop = "$4\r\nBPOP\r\n$4\r\nPING\r\n";
+    const char* bdeque = "$6\r\nBDEQUE\r\n$4\r\nPING\r\n";
+    int waiter, other;
+
+    server_start("");
+    waiter = client_auth(0);
+    other = client_auth(0);
+
+    /* the PING pipelined behind it waits until it is woken */
+    send_all(waiter, bpop, strlen(bpop));
+    expect_nothing(waiter, 100);
+    send_cmd(other, "PUSH", "a", NULL, 0);
+    expect_reply(other, "+OK\r\n");
+    expect_reply(waiter, "$1\r\na\r\n+PONG\r\n");
+
+    send_all(waiter, bdeque, strlen(bdeque));
+    expect_nothing(waiter, 100);
+    send_cmd(other, "ENQUE", "b", NULL, 0);
+    expect_reply(other, "+OK\r\n");
+    expect_reply(waiter, "$1\r\nb\r\n+PONG\r\n");
+
+    close(waiter);
+    close(other);
+    server_stop();
+}
+END_TEST
+
+START_TEST(test_block_timeout) {
+    const char* bpop = "*2\r\n$4\r\nBPOP\r\n:200\r\n";
+    long long start, waited;
+    int waiter;
+
+    server_start("");
+    waiter = client_auth(0);
+
+    start = now_ms();
+    send_all(waiter, bpop, strlen(bpop));
+    expect_reply(waiter, "+NONE\r\n");
+    waited = now_ms() - start;
+    ck_assert_int_ge(waited, 150);
+    ck_assert_int_lt(waited, 2000);
+
+    /* and the value pushed after it is left on the stack */
+    send_cmd(waiter, "PUSH", "a", NULL, 0);
+    expect_reply(waiter, "+OK\r\n");
+    send_all(waiter, "$3\r\nPOP\r\n", 9);
+    expect_reply(waiter, "$1\r\na\r\n");
+
+    close(waiter);
+    server_stop();
+}
+END_TEST
+
+START_TEST(test_block_client_gone) {
+    const char* bdeque = "$6\r\nBDEQUE\r\n";
+    int waiter, other;
+
+    server_start("");
+    waiter = client_auth(0);
+    other = client_auth(0);
+
+    send_all(waiter, bdeque, strlen(bdeque));
+    expect_nothing(waiter, 100);
+    close(waiter);
+    usleep(100 * 1000);
+
+    /* the value is not handed to the closed client */
+    send_cmd(other, "ENQUE", "z", NULL, 0);
+    expect_reply(other, "+OK\r\n");
+    send_all(other, "$5\r\nDEQUE\r\n", 11);
+    expect_reply(other, "$1\r\nz\r\n");
+    ck_assert_int_eq(info_int(other, "num connections"), 1);
+
+    close(other);
+    server_stop();
+}
+END_TEST
+
+START_TEST(test_keys_while_keyspace_changes) {
+    const char* keys = "$4\r\nKEYS\r\n";
+    reply_reader r = {0};
+    char* seen = calloc(NUM_KEYS, 1);
+    char key[32], line[32];
+    int reader, writer, i;
+
+    server_start("");
+    reader = client_auth(4096);
+    writer = client_auth(0);
+
+    for (i = 0; i < NUM_KEYS; ++i) {
+        snprintf(key, sizeof key, "k:%d", i);
+        send_cmd(writer, "SET", key, (const uint8_t*)"v", 1);
+        if (i % KEYS_BATCH == KEYS_BATCH - 1) {
+            expect_oks(writer, KEYS_BATCH);
+        }
+    }
+
+    r.fd = reader;
+    send_all(reader, keys, strlen(keys));
+    reader_line(&r, line, sizeof line);
+    ck_assert_int_eq(line[0], '*');
+    ck_assert_int_eq(atoi(line + 1), NUM_KEYS);
+    for (i = 0; i < KEYS_BATCH; ++i) {
+        long num = key_num(&r);
+        ck_assert_int_eq(seen[num], 0);
+        seen[num] = 1;
+    }
+
+    /* with the reply stalled part way, delete a third of the keys, overwrite
+     * a third and add as many new ones. Keys of both halves are touched */
+    for (i = 0; i < NUM_KEYS; ++i) {
+        snprintf(key, sizeof key, "k:%d", i);
+        if (i % 3 == 0) {
+            send_cmd(writer, "DEL", key, NULL, 0);
+        } else if (i % 3 == 1) {
+            send_cmd(writer, "SET", key, (const uint8_t*)"w", 1);
+        } else {
+            snprintf(key, sizeof key, "new:%d", i);
+            send_cmd(writer, "SET", key, (const uint8_t*)"v", 1);
+        }
+        if (i % KEYS_BATCH == KEYS_BATCH - 1) {
+            expect_oks(writer, KEYS_BATCH);
+        }
+    }
+
+    /* exactly the keys there were when KEYS ran, each once */
+    for (i = KEYS_BATCH; i < NUM_KEYS; ++i) {
+        long num = key_num(&r);
+        ck_assert_msg(seen[num] == 0, "KEYS returned k:%ld twice", num);
+        seen[num] = 1;
+    }
+    ck_assert_uint_eq(r.pos, r.len);
+    expect_nothing(reader, 100);
+
+    /* and reads from the client start again once the reply is done */
+    send_all(reader, "$4\r\nPING\r\n", 10);
+    expect_reply(reader, "+PONG\r\n");
+
+    close(reader);
+    close(writer);
+    server_stop();
+    free(seen);
+}
+END_TEST
+
+Suite* suite() {
+    Suite* s;
+    TCase* tc_core;
+    s = suite_create("server");
+    tc_core = tcase_create("Core");
+    tcase_set_timeout(tc_core, 30);
+    tcase_add_test(tc_core, test_queued_get_outlives_set_and_del);
+    tcase_add_test(tc_core, test_output_soft_limit_pauses_reads);
+    tcase_add_test(tc_core, test_output_hard_limit_drops_client);
+    tcase_add_test(tc_core, test_block_woken_by_push_and_enque);
+    tcase_add_test(tc_core, test_block_timeout);
+    tcase_add_test(tc_core, test_block_client_gone);
+    tcase_add_test(tc_core, test_keys_while_keyspace_changes);
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main() {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+    signal(SIGPIPE, SIG_IGN);
+    s = suite();
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
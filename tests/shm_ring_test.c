@@ -0,0 +1,192 @@
+#define _GNU_SOURCE
+#include "../src/shm_ring.h"
+#include <check.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define TEST_CAP 64
+
+/* the fds a client would send, duplicated since attaching takes them */
+static void dup_fds(shm_ring* client, int fds[SHM_RING_NUM_FDS]) {
+    size_t i;
+    for (i = 0; i < SHM_RING_NUM_FDS; ++i) {
+        fds[i] = dup(client->fds[i]);
+        ck_assert_int_ne(fds[i], -1);
+    }
+}
+
+static void attach_pair(shm_ring* client, shm_ring* server) {
+    int fds[SHM_RING_NUM_FDS];
+    ck_assert_int_eq(shm_ring_create(client, TEST_CAP), 0);
+    dup_fds(client, fds);
+    ck_assert_int_eq(shm_ring_attach(server, fds), 0);
+    ck_assert_uint_eq(server->cap, TEST_CAP);
+}
+
+START_TEST(test_round_trip) {
+    shm_ring client, server;
+    char buf[16];
+
+    attach_pair(&client, &server);
+
+    ck_assert_int_eq(shm_ring_read(&server, buf, sizeof buf), 0);
+    ck_assert_int_eq(shm_ring_write(&client, "ping", 4), 4);
+    ck_assert_int_eq(shm_ring_read(&server, buf, sizeof buf), 4);
+    ck_assert_mem_eq(buf, "ping", 4);
+
+    ck_assert_int_eq(shm_ring_write(&server, "pong", 4), 4);
+    ck_assert_int_eq(shm_ring_read(&client, buf, sizeof buf), 4);
+    ck_assert_mem_eq(buf, "pong", 4);
+
+    shm_ring_free(&server);
+    shm_ring_free(&client);
+}
+END_TEST
+
+START_TEST(test_wraparound) {
+    shm_ring client, server;
+    uint8_t in[40], out[40];
+    size_t round, i;
+
+    attach_pair(&client, &server);
+
+    /* 40 does not divide 64, so writes keep straddling the end */
+    for (round = 0; round < 10; ++round) {
+        for (i = 0; i < sizeof in; ++i) {
+            in[i] = (uint8_t)(round * sizeof in + i);
+        }
+        ck_assert_int_eq(shm_ring_write(&client, in, sizeof in), sizeof in);
+        ck_assert_int_eq(shm_ring_read(&server, out, sizeof out), sizeof out);
+        ck_assert_mem_eq(in, out, sizeof in);
+    }
+
+    shm_ring_free(&server);
+    shm_ring_free(&client);
+}
+END_TEST
+
+START_TEST(test_full) {
+    shm_ring client, server;
+    uint8_t in[TEST_CAP * 2] = {0}, out[TEST_CAP * 2];
+
+    attach_pair(&client, &server);
+
+    ck_assert_int_eq(shm_ring_write(&client, in, sizeof in), TEST_CAP);
+    ck_assert_int_eq(shm_ring_write(&client, in, sizeof in), 0);
+    ck_assert_int_eq(shm_ring_wait_space(&client), 1);
+
+    /* reading from a ring with a waiting writer wakes it */
+    ck_assert_int_eq(shm_ring_read(&server, out, 10), 10);
+    shm_ring_clear_wakeup(&client);
+    ck_assert_int_eq(shm_ring_wait_space(&client), 0);
+    ck_assert_int_eq(shm_ring_write(&client, in, sizeof in), 10);
+    ck_assert_int_eq(shm_ring_read(&server, out, sizeof out), TEST_CAP);
+
+    shm_ring_free(&server);
+    shm_ring_free(&client);
+}
+END_TEST
+
+START_TEST(test_eventfds_made_non_blocking) {
+    shm_ring client, server;
+    int fds[SHM_RING_NUM_FDS];
+    int flags;
+
+    ck_assert_int_eq(shm_ring_create(&client, TEST_CAP), 0);
+    dup_fds(&client, fds);
+    flags = fcntl(fds[1], F_GETFL);
+    ck_assert_int_eq(fcntl(fds[1], F_SETFL, flags & ~O_NONBLOCK), 0);
+    ck_assert_int_eq(shm_ring_attach(&server, fds), 0);
+    ck_assert(fcntl(server.fds[1], F_GETFL) & O_NONBLOCK);
+
+    shm_ring_free(&server);
+    shm_ring_free(&client);
+}
+END_TEST
+
+START_TEST(test_rejected_geometry) {
+    uint64_t bad_caps[] = {0, 48, TEST_CAP * 2};
+    size_t i;
+
+    for (i = 0; i < sizeof bad_caps / sizeof bad_caps[0]; ++i) {
+        shm_ring client, server;
+        int fds[SHM_RING_NUM_FDS];
+        ck_assert_int_eq(shm_ring_create(&client, TEST_CAP), 0);
+        /* the cap follows the magic and the version */
+        ck_assert_int_eq(pwrite(client.fds[0], &bad_caps[i], 8, 8), 8);
+        dup_fds(&client, fds);
+        ck_assert_int_eq(shm_ring_attach(&server, fds), -1);
+        ck_assert_int_eq(errno, EINVAL);
+        shm_ring_free(&client);
+    }
+}
+END_TEST
+
+START_TEST(test_rejected_fds) {
+    shm_ring client, server;
+    int fds[SHM_RING_NUM_FDS], pipe_fds[2];
+    char header[64] = {0};
+    uint32_t magic = 0x6c657869, version = 1;
+    uint64_t cap = TEST_CAP;
+
+    ck_assert_int_eq(shm_ring_create(&client, TEST_CAP), 0);
+
+    /* an unsealed region could be shrunk under the server */
+    dup_fds(&client, fds);
+    close(fds[0]);
+    fds[0] = memfd_create("unsealed", MFD_CLOEXEC);
+    ck_assert_int_ne(fds[0], -1);
+    memcpy(header, &magic, 4);
+    memcpy(header + 4, &version, 4);
+    memcpy(header + 8, &cap, 8);
+    ck_assert_int_eq(pwrite(fds[0], header, sizeof header, 0), sizeof header);
+    ck_assert_int_eq(ftruncate(fds[0], client.size), 0);
+    ck_assert_int_eq(shm_ring_attach(&server, fds), -1);
+    ck_assert_int_eq(errno, EPERM);
+
+    /* a pipe instead of an eventfd */
+    dup_fds(&client, fds);
+    ck_assert_int_eq(pipe(pipe_fds), 0);
+    close(fds[2]);
+    fds[2] = pipe_fds[0];
+    ck_assert_int_eq(shm_ring_attach(&server, fds), -1);
+    ck_assert_int_eq(errno, EINVAL);
+    close(pipe_fds[1]);
+
+    shm_ring_free(&client);
+}
+END_TEST
+
+Suite* suite() {
+    Suite* s;
+    TCase* tc_core;
+    s = suite_create("shm_ring");
+    tc_core = tcase_create("Core");
+    tcase_add_test(tc_core, test_round_trip);
+    tcase_add_test(tc_core, test_wraparound);
+    tcase_add_test(tc_core, test_full);
+    tcase_add_test(tc_core, test_eventfds_made_non_blocking);
+    tcase_add_test(tc_core, test_rejected_geometry);
+    tcase_add_test(tc_core, test_rejected_fds);
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main() {
+    int number_failed;
+    Suite* s;
+    SRunner* sr;
+    s = suite();
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}